@@ -0,0 +1,75 @@
+#!/usr/bin/env perl
+# Generates src/unicode_tables.h: the Alphabetic property and the simple
+# lowercase mapping of the Unicode Character Database, as sorted ranges.
+# They reproduce the tolower() and [:alpha:] letter_freq() was defined
+# with, for the native counting code.
+#
+# Run from the package root:  perl data-raw/unicode_tables.pl
+
+use strict;
+use warnings;
+use Unicode::UCD qw(prop_invlist prop_invmap);
+
+my $out = "src/unicode_tables.h";
+open(my $fh, ">", $out) or die "cannot write $out: $!";
+
+my $version = Unicode::UCD::UnicodeVersion();
+print $fh <<"HEADER";
+// unicode_tables.h
+// Generated by data-raw/unicode_tables.pl from Unicode $version; do not edit.
+// Included by corpus_stats.cpp only.
+
+#ifndef LBKEYBOARD_UNICODE_TABLES_H
+#define LBKEYBOARD_UNICODE_TABLES_H
+
+#include <cstdint>
+
+HEADER
+
+# Alphabetic: an inversion list, alternately the first codepoint in and
+# the first codepoint out of the property
+my @alpha = prop_invlist("Alphabetic");
+push @alpha, 0x110000 if @alpha % 2;
+my @ranges;
+for (my $i = 0; $i < @alpha; $i += 2) {
+  push @ranges, sprintf("{0x%04X, 0x%04X}", $alpha[$i], $alpha[$i + 1] - 1);
+}
+print $fh "// Alphabetic codepoints, as {first, last} ranges\n";
+print $fh "static const uint32_t ALPHABETIC_RANGES[][2] = {\n";
+print $fh wrap_entries(@ranges);
+print $fh "};\n\n";
+
+# Simple_Lowercase_Mapping in adjusted format: the first codepoint of
+# every range maps to the value, the following ones to the next values.
+# 0 means every codepoint of the range maps to itself.
+my ($starts, $values, $format, $default) = prop_invmap("Simple_Lowercase_Mapping");
+die "unexpected map format $format" unless $format eq "a" && $default eq "0";
+my @lower;
+for (my $i = 0; $i < @$starts; $i++) {
+  next if $values->[$i] eq "0";
+  my $last = ($i + 1 < @$starts ? $starts->[$i + 1] : 0x110000) - 1;
+  push @lower, sprintf("{0x%04X, 0x%04X, 0x%04X}", $starts->[$i], $last, $values->[$i]);
+}
+print $fh "// Simple lowercase mapping, as {first, last, lowercase of first} ranges\n";
+print $fh "static const uint32_t LOWERCASE_RANGES[][3] = {\n";
+print $fh wrap_entries(@lower);
+print $fh "};\n\n";
+
+print $fh "#endif\n";
+close($fh);
+printf "%s: %d alphabetic ranges, %d lowercase ranges\n", $out, scalar(@ranges), scalar(@lower);
+
+sub wrap_entries {
+  my @entries = @_;
+  my $text = "";
+  my $line = " ";
+  for my $i (0 .. $#entries) {
+    my $entry = $entries[$i] . ($i < $#entries ? "," : "");
+    if (length($line) + 1 + length($entry) > 90) {
+      $text .= "$line\n";
+      $line = " ";
+    }
+    $line .= " $entry";
+  }
+  return "$text$line\n";
+}
@@ -28,10 +28,8 @@ let
     inherit (pkgs.rPackages)
       # Direct dependencies (Imports)
       dplyr
-      GA
       ggplot2
       magrittr
-      purrr
       Rcpp
       scales
       stringr
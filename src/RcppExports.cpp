@@ -10,9 +10,373 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// anneal_optimize
+List anneal_optimize(SEXP corpus, CharacterVector layout, SEXP geometry, LogicalVector fixed, List rules, int iterations, int restarts, std::string cooling, double initial_temp, double final_temp, SEXP progress, int progress_every, int seed, std::string checkpoint, int checkpoint_every, SEXP checkpoint_settings, bool resume);
+RcppExport SEXP _lbkeyboard_anneal_optimize(SEXP corpusSEXP, SEXP layoutSEXP, SEXP geometrySEXP, SEXP fixedSEXP, SEXP rulesSEXP, SEXP iterationsSEXP, SEXP restartsSEXP, SEXP coolingSEXP, SEXP initial_tempSEXP, SEXP final_tempSEXP, SEXP progressSEXP, SEXP progress_everySEXP, SEXP seedSEXP, SEXP checkpointSEXP, SEXP checkpoint_everySEXP, SEXP checkpoint_settingsSEXP, SEXP resumeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type fixed(fixedSEXP);
+    Rcpp::traits::input_parameter< List >::type rules(rulesSEXP);
+    Rcpp::traits::input_parameter< int >::type iterations(iterationsSEXP);
+    Rcpp::traits::input_parameter< int >::type restarts(restartsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type cooling(coolingSEXP);
+    Rcpp::traits::input_parameter< double >::type initial_temp(initial_tempSEXP);
+    Rcpp::traits::input_parameter< double >::type final_temp(final_tempSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< int >::type progress_every(progress_everySEXP);
+    Rcpp::traits::input_parameter< int >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< std::string >::type checkpoint(checkpointSEXP);
+    Rcpp::traits::input_parameter< int >::type checkpoint_every(checkpoint_everySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type checkpoint_settings(checkpoint_settingsSEXP);
+    Rcpp::traits::input_parameter< bool >::type resume(resumeSEXP);
+    rcpp_result_gen = Rcpp::wrap(anneal_optimize(corpus, layout, geometry, fixed, rules, iterations, restarts, cooling, initial_temp, final_temp, progress, progress_every, seed, checkpoint, checkpoint_every, checkpoint_settings, resume));
+    return rcpp_result_gen;
+END_RCPP
+}
+// exact_optimize
+List exact_optimize(SEXP corpus, CharacterVector layout, SEXP geometry, LogicalVector fixed, List rules, double time_limit, int max_free, int n_threads);
+RcppExport SEXP _lbkeyboard_exact_optimize(SEXP corpusSEXP, SEXP layoutSEXP, SEXP geometrySEXP, SEXP fixedSEXP, SEXP rulesSEXP, SEXP time_limitSEXP, SEXP max_freeSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type fixed(fixedSEXP);
+    Rcpp::traits::input_parameter< List >::type rules(rulesSEXP);
+    Rcpp::traits::input_parameter< double >::type time_limit(time_limitSEXP);
+    Rcpp::traits::input_parameter< int >::type max_free(max_freeSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(exact_optimize(corpus, layout, geometry, fixed, rules, time_limit, max_free, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// checkpoint_read
+List checkpoint_read(std::string path);
+RcppExport SEXP _lbkeyboard_checkpoint_read(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(checkpoint_read(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_source_hash
+std::string corpus_source_hash(CharacterVector parts);
+RcppExport SEXP _lbkeyboard_corpus_source_hash(SEXP partsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type parts(partsSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_source_hash(parts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_save
+void corpus_save(SEXP corpus, std::string path, std::string source_hash);
+RcppExport SEXP _lbkeyboard_corpus_save(SEXP corpusSEXP, SEXP pathSEXP, SEXP source_hashSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< std::string >::type source_hash(source_hashSEXP);
+    corpus_save(corpus, path, source_hash);
+    return R_NilValue;
+END_RCPP
+}
+// corpus_load
+List corpus_load(std::string path);
+RcppExport SEXP _lbkeyboard_corpus_load(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_load(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_compile
+SEXP corpus_compile(CharacterVector text_samples, CharacterVector keys);
+RcppExport SEXP _lbkeyboard_corpus_compile(SEXP text_samplesSEXP, SEXP keysSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type text_samples(text_samplesSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type keys(keysSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_compile(text_samples, keys));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_compile_files
+SEXP corpus_compile_files(CharacterVector paths, CharacterVector keys, double chunk_bytes, int n_threads);
+RcppExport SEXP _lbkeyboard_corpus_compile_files(SEXP pathsSEXP, SEXP keysSEXP, SEXP chunk_bytesSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type paths(pathsSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type keys(keysSEXP);
+    Rcpp::traits::input_parameter< double >::type chunk_bytes(chunk_bytesSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_compile_files(paths, keys, chunk_bytes, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_combine
+SEXP corpus_combine(List corpora, NumericVector weights);
+RcppExport SEXP _lbkeyboard_corpus_combine(SEXP corporaSEXP, SEXP weightsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type corpora(corporaSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type weights(weightsSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_combine(corpora, weights));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_summary
+List corpus_summary(SEXP corpus);
+RcppExport SEXP _lbkeyboard_corpus_summary(SEXP corpusSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_summary(corpus));
+    return rcpp_result_gen;
+END_RCPP
+}
+// geometry_build
+SEXP geometry_build(NumericVector pos_x, NumericVector pos_y, IntegerVector pos_row, IntegerVector pos_col, double w_base, double w_same_finger, double w_same_hand, double w_row_change, double w_trigram, double w_layer, IntegerVector pos_layer);
+RcppExport SEXP _lbkeyboard_geometry_build(SEXP pos_xSEXP, SEXP pos_ySEXP, SEXP pos_rowSEXP, SEXP pos_colSEXP, SEXP w_baseSEXP, SEXP w_same_fingerSEXP, SEXP w_same_handSEXP, SEXP w_row_changeSEXP, SEXP w_trigramSEXP, SEXP w_layerSEXP, SEXP pos_layerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type pos_x(pos_xSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type pos_y(pos_ySEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type pos_row(pos_rowSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type pos_col(pos_colSEXP);
+    Rcpp::traits::input_parameter< double >::type w_base(w_baseSEXP);
+    Rcpp::traits::input_parameter< double >::type w_same_finger(w_same_fingerSEXP);
+    Rcpp::traits::input_parameter< double >::type w_same_hand(w_same_handSEXP);
+    Rcpp::traits::input_parameter< double >::type w_row_change(w_row_changeSEXP);
+    Rcpp::traits::input_parameter< double >::type w_trigram(w_trigramSEXP);
+    Rcpp::traits::input_parameter< double >::type w_layer(w_layerSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type pos_layer(pos_layerSEXP);
+    rcpp_result_gen = Rcpp::wrap(geometry_build(pos_x, pos_y, pos_row, pos_col, w_base, w_same_finger, w_same_hand, w_row_change, w_trigram, w_layer, pos_layer));
+    return rcpp_result_gen;
+END_RCPP
+}
+// geometry_summary
+List geometry_summary(SEXP geometry);
+RcppExport SEXP _lbkeyboard_geometry_summary(SEXP geometrySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    rcpp_result_gen = Rcpp::wrap(geometry_summary(geometry));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_layout_effort
+double corpus_layout_effort(SEXP corpus, CharacterVector layout, SEXP geometry);
+RcppExport SEXP _lbkeyboard_corpus_layout_effort(SEXP corpusSEXP, SEXP layoutSEXP, SEXP geometrySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_layout_effort(corpus, layout, geometry));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_effort_batch
+SEXP corpus_effort_batch(SEXP corpus, IntegerMatrix layouts, CharacterVector keys, SEXP geometry, List rules, bool breakdown, int n_threads);
+RcppExport SEXP _lbkeyboard_corpus_effort_batch(SEXP corpusSEXP, SEXP layoutsSEXP, SEXP keysSEXP, SEXP geometrySEXP, SEXP rulesSEXP, SEXP breakdownSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type layouts(layoutsSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type keys(keysSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    Rcpp::traits::input_parameter< List >::type rules(rulesSEXP);
+    Rcpp::traits::input_parameter< bool >::type breakdown(breakdownSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_effort_batch(corpus, layouts, keys, geometry, rules, breakdown, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_swap_delta
+NumericVector corpus_swap_delta(SEXP corpus, CharacterVector layout, SEXP geometry, IntegerVector i, IntegerVector j, bool verify, int n_threads);
+RcppExport SEXP _lbkeyboard_corpus_swap_delta(SEXP corpusSEXP, SEXP layoutSEXP, SEXP geometrySEXP, SEXP iSEXP, SEXP jSEXP, SEXP verifySEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type i(iSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type j(jSEXP);
+    Rcpp::traits::input_parameter< bool >::type verify(verifySEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_swap_delta(corpus, layout, geometry, i, j, verify, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// effort_kernel_select
+std::string effort_kernel_select(std::string kernel);
+RcppExport SEXP _lbkeyboard_effort_kernel_select(SEXP kernelSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type kernel(kernelSEXP);
+    rcpp_result_gen = Rcpp::wrap(effort_kernel_select(kernel));
+    return rcpp_result_gen;
+END_RCPP
+}
+// corpus_append
+void corpus_append(SEXP corpus, CharacterVector text_samples, List trackers);
+RcppExport SEXP _lbkeyboard_corpus_append(SEXP corpusSEXP, SEXP text_samplesSEXP, SEXP trackersSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type text_samples(text_samplesSEXP);
+    Rcpp::traits::input_parameter< List >::type trackers(trackersSEXP);
+    corpus_append(corpus, text_samples, trackers);
+    return R_NilValue;
+END_RCPP
+}
+// corpus_remove
+void corpus_remove(SEXP corpus, CharacterVector text_samples, List trackers);
+RcppExport SEXP _lbkeyboard_corpus_remove(SEXP corpusSEXP, SEXP text_samplesSEXP, SEXP trackersSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type text_samples(text_samplesSEXP);
+    Rcpp::traits::input_parameter< List >::type trackers(trackersSEXP);
+    corpus_remove(corpus, text_samples, trackers);
+    return R_NilValue;
+END_RCPP
+}
+// corpus_batches
+NumericVector corpus_batches(SEXP corpus);
+RcppExport SEXP _lbkeyboard_corpus_batches(SEXP corpusSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    rcpp_result_gen = Rcpp::wrap(corpus_batches(corpus));
+    return rcpp_result_gen;
+END_RCPP
+}
+// tracker_create
+SEXP tracker_create(SEXP corpus, IntegerMatrix layouts, CharacterVector keys, SEXP geometry);
+RcppExport SEXP _lbkeyboard_tracker_create(SEXP corpusSEXP, SEXP layoutsSEXP, SEXP keysSEXP, SEXP geometrySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type layouts(layoutsSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type keys(keysSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    rcpp_result_gen = Rcpp::wrap(tracker_create(corpus, layouts, keys, geometry));
+    return rcpp_result_gen;
+END_RCPP
+}
+// tracker_effort
+SEXP tracker_effort(SEXP tracker, SEXP corpus, bool breakdown);
+RcppExport SEXP _lbkeyboard_tracker_effort(SEXP trackerSEXP, SEXP corpusSEXP, SEXP breakdownSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type tracker(trackerSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< bool >::type breakdown(breakdownSEXP);
+    rcpp_result_gen = Rcpp::wrap(tracker_effort(tracker, corpus, breakdown));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ga_optimize
+SEXP ga_optimize(SEXP corpus, CharacterVector layout, SEXP geometry, LogicalVector fixed, List rules, int population_size, int generations, double mutation_rate, double crossover_rate, int tournament_size, int elite_count, int patience, std::string crossover, int n_islands, int migration_interval, int migrants, std::string topology, NumericVector island_mutation_rates, NumericVector island_crossover_rates, SEXP progress, int progress_every, double cache_capacity, std::string cache_eviction, int seed, int n_threads, bool background, std::string checkpoint, int checkpoint_every, SEXP checkpoint_settings, bool resume);
+RcppExport SEXP _lbkeyboard_ga_optimize(SEXP corpusSEXP, SEXP layoutSEXP, SEXP geometrySEXP, SEXP fixedSEXP, SEXP rulesSEXP, SEXP population_sizeSEXP, SEXP generationsSEXP, SEXP mutation_rateSEXP, SEXP crossover_rateSEXP, SEXP tournament_sizeSEXP, SEXP elite_countSEXP, SEXP patienceSEXP, SEXP crossoverSEXP, SEXP n_islandsSEXP, SEXP migration_intervalSEXP, SEXP migrantsSEXP, SEXP topologySEXP, SEXP island_mutation_ratesSEXP, SEXP island_crossover_ratesSEXP, SEXP progressSEXP, SEXP progress_everySEXP, SEXP cache_capacitySEXP, SEXP cache_evictionSEXP, SEXP seedSEXP, SEXP n_threadsSEXP, SEXP backgroundSEXP, SEXP checkpointSEXP, SEXP checkpoint_everySEXP, SEXP checkpoint_settingsSEXP, SEXP resumeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type fixed(fixedSEXP);
+    Rcpp::traits::input_parameter< List >::type rules(rulesSEXP);
+    Rcpp::traits::input_parameter< int >::type population_size(population_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type generations(generationsSEXP);
+    Rcpp::traits::input_parameter< double >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< double >::type crossover_rate(crossover_rateSEXP);
+    Rcpp::traits::input_parameter< int >::type tournament_size(tournament_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type elite_count(elite_countSEXP);
+    Rcpp::traits::input_parameter< int >::type patience(patienceSEXP);
+    Rcpp::traits::input_parameter< std::string >::type crossover(crossoverSEXP);
+    Rcpp::traits::input_parameter< int >::type n_islands(n_islandsSEXP);
+    Rcpp::traits::input_parameter< int >::type migration_interval(migration_intervalSEXP);
+    Rcpp::traits::input_parameter< int >::type migrants(migrantsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type topology(topologySEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type island_mutation_rates(island_mutation_ratesSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type island_crossover_rates(island_crossover_ratesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< int >::type progress_every(progress_everySEXP);
+    Rcpp::traits::input_parameter< double >::type cache_capacity(cache_capacitySEXP);
+    Rcpp::traits::input_parameter< std::string >::type cache_eviction(cache_evictionSEXP);
+    Rcpp::traits::input_parameter< int >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type background(backgroundSEXP);
+    Rcpp::traits::input_parameter< std::string >::type checkpoint(checkpointSEXP);
+    Rcpp::traits::input_parameter< int >::type checkpoint_every(checkpoint_everySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type checkpoint_settings(checkpoint_settingsSEXP);
+    Rcpp::traits::input_parameter< bool >::type resume(resumeSEXP);
+    rcpp_result_gen = Rcpp::wrap(ga_optimize(corpus, layout, geometry, fixed, rules, population_size, generations, mutation_rate, crossover_rate, tournament_size, elite_count, patience, crossover, n_islands, migration_interval, migrants, topology, island_mutation_rates, island_crossover_rates, progress, progress_every, cache_capacity, cache_eviction, seed, n_threads, background, checkpoint, checkpoint_every, checkpoint_settings, resume));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ga_job_poll
+List ga_job_poll(SEXP job);
+RcppExport SEXP _lbkeyboard_ga_job_poll(SEXP jobSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type job(jobSEXP);
+    rcpp_result_gen = Rcpp::wrap(ga_job_poll(job));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ga_job_cancel
+void ga_job_cancel(SEXP job);
+RcppExport SEXP _lbkeyboard_ga_job_cancel(SEXP jobSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type job(jobSEXP);
+    ga_job_cancel(job);
+    return R_NilValue;
+END_RCPP
+}
+// ga_job_result
+List ga_job_result(SEXP job, bool wait);
+RcppExport SEXP _lbkeyboard_ga_job_result(SEXP jobSEXP, SEXP waitSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type job(jobSEXP);
+    Rcpp::traits::input_parameter< bool >::type wait(waitSEXP);
+    rcpp_result_gen = Rcpp::wrap(ga_job_result(job, wait));
+    return rcpp_result_gen;
+END_RCPP
+}
 // layout_effort
-double layout_effort(CharacterVector layout, NumericVector pos_x, NumericVector pos_y, IntegerVector pos_row, IntegerVector pos_col, CharacterVector text_samples, NumericVector char_freq, CharacterVector char_list, double w_base, double w_same_finger, double w_same_hand, double w_row_change, double w_trigram);
-RcppExport SEXP _lbkeyboard_layout_effort(SEXP layoutSEXP, SEXP pos_xSEXP, SEXP pos_ySEXP, SEXP pos_rowSEXP, SEXP pos_colSEXP, SEXP text_samplesSEXP, SEXP char_freqSEXP, SEXP char_listSEXP, SEXP w_baseSEXP, SEXP w_same_fingerSEXP, SEXP w_same_handSEXP, SEXP w_row_changeSEXP, SEXP w_trigramSEXP) {
+double layout_effort(CharacterVector layout, NumericVector pos_x, NumericVector pos_y, IntegerVector pos_row, IntegerVector pos_col, CharacterVector text_samples, NumericVector char_freq, CharacterVector char_list, double w_base, double w_same_finger, double w_same_hand, double w_row_change, double w_trigram, double w_layer, IntegerVector pos_layer);
+RcppExport SEXP _lbkeyboard_layout_effort(SEXP layoutSEXP, SEXP pos_xSEXP, SEXP pos_ySEXP, SEXP pos_rowSEXP, SEXP pos_colSEXP, SEXP text_samplesSEXP, SEXP char_freqSEXP, SEXP char_listSEXP, SEXP w_baseSEXP, SEXP w_same_fingerSEXP, SEXP w_same_handSEXP, SEXP w_row_changeSEXP, SEXP w_trigramSEXP, SEXP w_layerSEXP, SEXP pos_layerSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -29,13 +393,15 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type w_same_hand(w_same_handSEXP);
     Rcpp::traits::input_parameter< double >::type w_row_change(w_row_changeSEXP);
     Rcpp::traits::input_parameter< double >::type w_trigram(w_trigramSEXP);
-    rcpp_result_gen = Rcpp::wrap(layout_effort(layout, pos_x, pos_y, pos_row, pos_col, text_samples, char_freq, char_list, w_base, w_same_finger, w_same_hand, w_row_change, w_trigram));
+    Rcpp::traits::input_parameter< double >::type w_layer(w_layerSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type pos_layer(pos_layerSEXP);
+    rcpp_result_gen = Rcpp::wrap(layout_effort(layout, pos_x, pos_y, pos_row, pos_col, text_samples, char_freq, char_list, w_base, w_same_finger, w_same_hand, w_row_change, w_trigram, w_layer, pos_layer));
     return rcpp_result_gen;
 END_RCPP
 }
 // effort_breakdown
-List effort_breakdown(CharacterVector layout, NumericVector pos_x, NumericVector pos_y, IntegerVector pos_row, IntegerVector pos_col, CharacterVector text_samples, NumericVector char_freq, CharacterVector char_list);
-RcppExport SEXP _lbkeyboard_effort_breakdown(SEXP layoutSEXP, SEXP pos_xSEXP, SEXP pos_ySEXP, SEXP pos_rowSEXP, SEXP pos_colSEXP, SEXP text_samplesSEXP, SEXP char_freqSEXP, SEXP char_listSEXP) {
+List effort_breakdown(CharacterVector layout, NumericVector pos_x, NumericVector pos_y, IntegerVector pos_row, IntegerVector pos_col, CharacterVector text_samples, NumericVector char_freq, CharacterVector char_list, double w_base, double w_same_finger, double w_same_hand, double w_row_change, double w_trigram, double w_layer, IntegerVector pos_layer);
+RcppExport SEXP _lbkeyboard_effort_breakdown(SEXP layoutSEXP, SEXP pos_xSEXP, SEXP pos_ySEXP, SEXP pos_rowSEXP, SEXP pos_colSEXP, SEXP text_samplesSEXP, SEXP char_freqSEXP, SEXP char_listSEXP, SEXP w_baseSEXP, SEXP w_same_fingerSEXP, SEXP w_same_handSEXP, SEXP w_row_changeSEXP, SEXP w_trigramSEXP, SEXP w_layerSEXP, SEXP pos_layerSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -47,7 +413,14 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< CharacterVector >::type text_samples(text_samplesSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type char_freq(char_freqSEXP);
     Rcpp::traits::input_parameter< CharacterVector >::type char_list(char_listSEXP);
-    rcpp_result_gen = Rcpp::wrap(effort_breakdown(layout, pos_x, pos_y, pos_row, pos_col, text_samples, char_freq, char_list));
+    Rcpp::traits::input_parameter< double >::type w_base(w_baseSEXP);
+    Rcpp::traits::input_parameter< double >::type w_same_finger(w_same_fingerSEXP);
+    Rcpp::traits::input_parameter< double >::type w_same_hand(w_same_handSEXP);
+    Rcpp::traits::input_parameter< double >::type w_row_change(w_row_changeSEXP);
+    Rcpp::traits::input_parameter< double >::type w_trigram(w_trigramSEXP);
+    Rcpp::traits::input_parameter< double >::type w_layer(w_layerSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type pos_layer(pos_layerSEXP);
+    rcpp_result_gen = Rcpp::wrap(effort_breakdown(layout, pos_x, pos_y, pos_row, pos_col, text_samples, char_freq, char_list, w_base, w_same_finger, w_same_hand, w_row_change, w_trigram, w_layer, pos_layer));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -62,11 +435,76 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// count_ngrams
+List count_ngrams(CharacterVector text, bool only_alpha, IntegerVector n);
+RcppExport SEXP _lbkeyboard_count_ngrams(SEXP textSEXP, SEXP only_alphaSEXP, SEXP nSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type text(textSEXP);
+    Rcpp::traits::input_parameter< bool >::type only_alpha(only_alphaSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type n(nSEXP);
+    rcpp_result_gen = Rcpp::wrap(count_ngrams(text, only_alpha, n));
+    return rcpp_result_gen;
+END_RCPP
+}
+// pareto_optimize
+List pareto_optimize(SEXP corpus, CharacterVector layout, SEXP geometry, LogicalVector fixed, List rules, CharacterVector objectives, int population_size, int generations, double mutation_rate, double crossover_rate, std::string crossover, SEXP progress, int progress_every, int seed, int n_threads);
+RcppExport SEXP _lbkeyboard_pareto_optimize(SEXP corpusSEXP, SEXP layoutSEXP, SEXP geometrySEXP, SEXP fixedSEXP, SEXP rulesSEXP, SEXP objectivesSEXP, SEXP population_sizeSEXP, SEXP generationsSEXP, SEXP mutation_rateSEXP, SEXP crossover_rateSEXP, SEXP crossoverSEXP, SEXP progressSEXP, SEXP progress_everySEXP, SEXP seedSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type corpus(corpusSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type geometry(geometrySEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type fixed(fixedSEXP);
+    Rcpp::traits::input_parameter< List >::type rules(rulesSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type objectives(objectivesSEXP);
+    Rcpp::traits::input_parameter< int >::type population_size(population_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type generations(generationsSEXP);
+    Rcpp::traits::input_parameter< double >::type mutation_rate(mutation_rateSEXP);
+    Rcpp::traits::input_parameter< double >::type crossover_rate(crossover_rateSEXP);
+    Rcpp::traits::input_parameter< std::string >::type crossover(crossoverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< int >::type progress_every(progress_everySEXP);
+    Rcpp::traits::input_parameter< int >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(pareto_optimize(corpus, layout, geometry, fixed, rules, objectives, population_size, generations, mutation_rate, crossover_rate, crossover, progress, progress_every, seed, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_lbkeyboard_layout_effort", (DL_FUNC) &_lbkeyboard_layout_effort, 13},
-    {"_lbkeyboard_effort_breakdown", (DL_FUNC) &_lbkeyboard_effort_breakdown, 8},
+    {"_lbkeyboard_anneal_optimize", (DL_FUNC) &_lbkeyboard_anneal_optimize, 17},
+    {"_lbkeyboard_exact_optimize", (DL_FUNC) &_lbkeyboard_exact_optimize, 8},
+    {"_lbkeyboard_checkpoint_read", (DL_FUNC) &_lbkeyboard_checkpoint_read, 1},
+    {"_lbkeyboard_corpus_source_hash", (DL_FUNC) &_lbkeyboard_corpus_source_hash, 1},
+    {"_lbkeyboard_corpus_save", (DL_FUNC) &_lbkeyboard_corpus_save, 3},
+    {"_lbkeyboard_corpus_load", (DL_FUNC) &_lbkeyboard_corpus_load, 1},
+    {"_lbkeyboard_corpus_compile", (DL_FUNC) &_lbkeyboard_corpus_compile, 2},
+    {"_lbkeyboard_corpus_compile_files", (DL_FUNC) &_lbkeyboard_corpus_compile_files, 4},
+    {"_lbkeyboard_corpus_combine", (DL_FUNC) &_lbkeyboard_corpus_combine, 2},
+    {"_lbkeyboard_corpus_summary", (DL_FUNC) &_lbkeyboard_corpus_summary, 1},
+    {"_lbkeyboard_geometry_build", (DL_FUNC) &_lbkeyboard_geometry_build, 11},
+    {"_lbkeyboard_geometry_summary", (DL_FUNC) &_lbkeyboard_geometry_summary, 1},
+    {"_lbkeyboard_corpus_layout_effort", (DL_FUNC) &_lbkeyboard_corpus_layout_effort, 3},
+    {"_lbkeyboard_corpus_effort_batch", (DL_FUNC) &_lbkeyboard_corpus_effort_batch, 7},
+    {"_lbkeyboard_corpus_swap_delta", (DL_FUNC) &_lbkeyboard_corpus_swap_delta, 7},
+    {"_lbkeyboard_effort_kernel_select", (DL_FUNC) &_lbkeyboard_effort_kernel_select, 1},
+    {"_lbkeyboard_corpus_append", (DL_FUNC) &_lbkeyboard_corpus_append, 3},
+    {"_lbkeyboard_corpus_remove", (DL_FUNC) &_lbkeyboard_corpus_remove, 3},
+    {"_lbkeyboard_corpus_batches", (DL_FUNC) &_lbkeyboard_corpus_batches, 1},
+    {"_lbkeyboard_tracker_create", (DL_FUNC) &_lbkeyboard_tracker_create, 4},
+    {"_lbkeyboard_tracker_effort", (DL_FUNC) &_lbkeyboard_tracker_effort, 3},
+    {"_lbkeyboard_ga_optimize", (DL_FUNC) &_lbkeyboard_ga_optimize, 30},
+    {"_lbkeyboard_ga_job_poll", (DL_FUNC) &_lbkeyboard_ga_job_poll, 1},
+    {"_lbkeyboard_ga_job_cancel", (DL_FUNC) &_lbkeyboard_ga_job_cancel, 1},
+    {"_lbkeyboard_ga_job_result", (DL_FUNC) &_lbkeyboard_ga_job_result, 2},
+    {"_lbkeyboard_layout_effort", (DL_FUNC) &_lbkeyboard_layout_effort, 15},
+    {"_lbkeyboard_effort_breakdown", (DL_FUNC) &_lbkeyboard_effort_breakdown, 15},
     {"_lbkeyboard_random_layout", (DL_FUNC) &_lbkeyboard_random_layout, 1},
+    {"_lbkeyboard_count_ngrams", (DL_FUNC) &_lbkeyboard_count_ngrams, 3},
+    {"_lbkeyboard_pareto_optimize", (DL_FUNC) &_lbkeyboard_pareto_optimize, 15},
     {NULL, NULL, 0}
 };
 
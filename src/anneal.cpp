@@ -0,0 +1,389 @@
+// anneal.cpp
+// Simulated annealing on key swaps for keyboard layout optimization
+// Each move swaps two free positions and is scored incrementally with
+// SwapDelta, so a move costs a fraction of a full evaluation.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// COOLING SCHEDULES
+// -----------------------------------------------------------------
+
+enum CoolingSchedule { COOL_EXPONENTIAL, COOL_LINEAR, COOL_LOGARITHMIC };
+
+struct AnnealConfig {
+  int iterations;       // moves per restart
+  int restarts;         // number of cooling cycles
+  CoolingSchedule schedule;
+  double initial_temp;  // <= 0: calibrate from the starting layout
+  double final_temp;    // <= 0: initial_temp * 1e-3
+};
+
+// Temperature at step s of n, going from t0 to t_end
+static double temperature(CoolingSchedule schedule, double t0, double t_end, int s, int n) {
+  double frac = n > 1 ? static_cast<double>(s) / (n - 1) : 1.0;
+  switch (schedule) {
+    case COOL_LINEAR:
+      return t0 + (t_end - t0) * frac;
+    case COOL_LOGARITHMIC: {
+      // t0 / (1 + a log(1 + s)), with a chosen so the last step reaches t_end
+      double a = (t0 / t_end - 1.0) / std::log1p(std::max(1, n - 1));
+      return t0 / (1.0 + a * std::log1p(s));
+    }
+    case COOL_EXPONENTIAL:
+    default:
+      return t0 * std::pow(t_end / t0, frac);
+  }
+}
+
+// -----------------------------------------------------------------
+// SIMULATED ANNEALING
+// -----------------------------------------------------------------
+
+struct AnnealResult {
+  KeyboardLayout best;
+  double best_score;
+  std::vector<double> history_best;  // best objective so far, per block of moves
+  std::vector<double> history_mean;  // mean current objective over the block
+  double evaluations;
+  double accepted;
+  Telemetry telemetry;      // one entry per history block
+  std::string stop_reason;  // "iterations" or "callback"
+};
+
+// Number of moves summarized by one history row
+static const int HISTORY_BLOCK = 100;
+
+// Tracks the current layout's effort and rule penalty under swaps
+class AnnealState {
+public:
+  explicit AnnealState(const Objective& objective)
+    : obj_(objective),
+      sd_(*objective.corpus, *objective.costs),
+      penalty_(0.0) {}
+
+  void reset(const KeyboardLayout& layout) {
+    sd_.reset(layout);
+    penalty_ = rule_penalty(sd_.pos_of_sym(), *obj_.rules, *obj_.geometry, *obj_.corpus);
+  }
+
+  // The tracked effort and penalty as accumulated over the applied swaps
+  void save(StateWriter& out) const {
+    out.put_layout(sd_.layout());
+    out.put(sd_.effort());
+    out.put(penalty_);
+  }
+
+  void load(StateReader& in) {
+    KeyboardLayout layout = in.get_layout();
+    double effort = in.get<double>();
+    if (layout.n_keys != obj_.costs->n) throw std::runtime_error("checkpoint state is corrupt");
+    sd_.restore(layout, effort);
+    penalty_ = in.get<double>();
+  }
+
+  double score() const { return sd_.effort() + penalty_; }
+  const KeyboardLayout& layout() const { return sd_.layout(); }
+  const SwapDelta& effort_delta() const { return sd_; }
+
+  // Objective change of swapping i and j; also returns the penalty change
+  double delta(int i, int j, double& penalty_delta) {
+    penalty_delta = 0.0;
+    if (obj_.rules->has_penalties()) {
+      scratch_ = sd_.pos_of_sym();
+      std::swap(scratch_[sd_.layout().keys[i]], scratch_[sd_.layout().keys[j]]);
+      penalty_delta = rule_penalty(scratch_, *obj_.rules, *obj_.geometry, *obj_.corpus) -
+                      penalty_;
+    }
+    return sd_.delta(i, j) + penalty_delta;
+  }
+
+  void apply(int i, int j, double penalty_delta) {
+    sd_.apply(i, j);
+    penalty_ += penalty_delta;
+  }
+
+private:
+  const Objective& obj_;
+  SwapDelta sd_;
+  double penalty_;
+  std::vector<int> scratch_;
+};
+
+static void pick_swap(const std::vector<int>& free, std::mt19937& rng, int& i, int& j) {
+  std::uniform_int_distribution<int> pick(0, free.size() - 1);
+  int a = pick(rng);
+  int b = pick(rng);
+  while (b == a) b = pick(rng);
+  i = free[a];
+  j = free[b];
+}
+
+// Random swaps sampled to calibrate the initial temperature
+static const int CALIBRATION_MOVES = 200;
+
+// Initial temperature at which an average uphill move is accepted with
+// probability 0.8, estimated from random swaps of the starting layout.
+// Only the effort term is sampled: rule penalties are orders of magnitude
+// larger and would keep the search hot for the whole run.
+static double calibrate_temperature(const SwapDelta& sd, const std::vector<int>& free,
+                                    std::mt19937& rng) {
+  double sum = 0.0;
+  int n_up = 0;
+  for (int s = 0; s < CALIBRATION_MOVES; s++) {
+    int i, j;
+    pick_swap(free, rng, i, j);
+    double d = sd.delta(i, j);
+    if (d > 0.0) {
+      sum += d;
+      n_up++;
+    }
+  }
+  if (n_up == 0) return 1.0;
+  return (sum / n_up) / -std::log(0.8);
+}
+
+// Settings a checkpointed annealing state depends on
+static uint64_t anneal_config_hash(const AnnealConfig& cfg) {
+  return Fingerprint().add(cfg.iterations).add(cfg.restarts)
+    .add(static_cast<int>(cfg.schedule)).add(cfg.initial_temp).add(cfg.final_temp).value();
+}
+
+// Checkpoints are taken between history blocks. A `resume` checkpoint
+// restores the restart and move to continue from, the temperatures, the
+// RNG stream and the tracked layout, so the run ends exactly as the one
+// that wrote it would have.
+static AnnealResult run_anneal(
+    const Objective& objective,
+    const KeyboardLayout& initial,
+    const AnnealConfig& cfg,
+    std::mt19937& rng,
+    const CheckpointPlan& checkpoints,
+    const Checkpoint* resume,
+    const ProgressCallback& progress
+) {
+  Stopwatch clock;
+  const RuleSet& rules = *objective.rules;
+  std::vector<int> free = free_positions(rules, initial.n_keys);
+  std::uniform_real_distribution<double> unif(0.0, 1.0);
+
+  AnnealResult result;
+  result.evaluations = 0.0;
+  result.accepted = 0.0;
+  result.stop_reason = "iterations";
+  Telemetry& telemetry = result.telemetry;
+
+  KeyboardLayout start = initial;
+  Stopwatch phase;
+  repair_layout(start, rules, *objective.geometry);
+  telemetry.repair_seconds += phase.seconds();
+  phase.reset();
+  AnnealState state(objective);
+  state.reset(start);
+  telemetry.scoring_seconds += phase.seconds();
+  telemetry.initial_evaluations = 1.0;
+  result.best = state.layout();
+  result.best_score = state.score();
+  if (free.size() < 2) return result;
+
+  double t0 = cfg.initial_temp;
+  double t_end = 0.0;
+  int r0 = 0;
+  int s0 = 0;
+  int saved = 0;
+  if (resume != NULL) {
+    StateReader in(resume->state);
+    saved = in.get<int32_t>();
+    clock.resume_from(in.get<double>());
+    r0 = in.get<int32_t>();
+    s0 = in.get<int32_t>();
+    t0 = in.get<double>();
+    t_end = in.get<double>();
+    in.get_rng(rng);
+    state.load(in);
+    result.best = in.get_layout();
+    result.best_score = in.get<double>();
+    result.evaluations = in.get<double>();
+    result.accepted = in.get<double>();
+    in.get_vector(result.history_best);
+    in.get_vector(result.history_mean);
+    in.get_telemetry(telemetry);
+  } else {
+    if (t0 <= 0.0) {
+      phase.reset();
+      t0 = calibrate_temperature(state.effort_delta(), free, rng);
+      telemetry.scoring_seconds += phase.seconds();
+      telemetry.initial_evaluations += CALIBRATION_MOVES;
+    }
+    t_end = cfg.final_temp > 0.0 ? std::min(cfg.final_temp, t0) : t0 * 1e-3;
+  }
+
+  bool stop = false;
+  for (int r = r0; r < cfg.restarts && !stop; r++) {
+    // Every restart reheats from the best layout found so far
+    bool resumed = r == r0 && s0 > 0;
+    if (!resumed) state.reset(result.best);
+    double block_sum = 0.0;
+    double block_accepted = 0.0;
+    double block_scoring = 0.0;
+    int block_n = 0;
+    phase.reset();
+
+    for (int s = resumed ? s0 : 0; s < cfg.iterations; s++) {
+      double t = temperature(cfg.schedule, t0, t_end, s, cfg.iterations);
+      int i, j;
+      pick_swap(free, rng, i, j);
+      double pd;
+      Stopwatch scoring;
+      double d = state.delta(i, j, pd);
+      block_scoring += scoring.seconds();
+      result.evaluations += 1.0;
+
+      if (d <= 0.0 || unif(rng) < std::exp(-d / t)) {
+        state.apply(i, j, pd);
+        result.accepted += 1.0;
+        block_accepted += 1.0;
+        if (state.score() < result.best_score) {
+          result.best = state.layout();
+          result.best_score = state.score();
+        }
+      }
+
+      block_sum += state.score();
+      if (++block_n == HISTORY_BLOCK || s == cfg.iterations - 1) {
+        result.history_best.push_back(result.best_score);
+        result.history_mean.push_back(block_sum / block_n);
+        telemetry.evaluations.push_back(block_n);
+        telemetry.elapsed.push_back(clock.seconds());
+        telemetry.acceptance.push_back(block_accepted / block_n);
+        telemetry.scoring_seconds += block_scoring;
+        telemetry.variation_seconds += phase.seconds() - block_scoring;
+
+        int block = result.history_best.size();
+        if (progress.due(block) &&
+            !progress.report(progress_info(block, result.best_score, block_sum / block_n,
+                                           telemetry, clock.seconds()))) {
+          result.stop_reason = "callback";
+          stop = true;
+          break;
+        }
+        block_sum = 0.0;
+        block_accepted = 0.0;
+        block_scoring = 0.0;
+        block_n = 0;
+        if (checkpoints.due(block, saved)) {
+          // Continue with the next move, or the next restart after the last
+          bool last = s == cfg.iterations - 1;
+          StateWriter out;
+          out.put(static_cast<int32_t>(block));
+          out.put(clock.seconds());
+          out.put(static_cast<int32_t>(last ? r + 1 : r));
+          out.put(static_cast<int32_t>(last ? 0 : s + 1));
+          out.put(t0);
+          out.put(t_end);
+          out.put_rng(rng);
+          state.save(out);
+          out.put_layout(result.best);
+          out.put(result.best_score);
+          out.put(result.evaluations);
+          out.put(result.accepted);
+          out.put_vector(result.history_best);
+          out.put_vector(result.history_mean);
+          out.put_telemetry(telemetry);
+          checkpoints.write(out);
+          saved = block;
+        }
+        phase.reset();
+        Rcpp::checkUserInterrupt();
+      }
+    }
+  }
+
+  // Rescore exactly, without the accumulated floating-point drift
+  result.best_score = objective(result.best);
+  return result;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Run simulated annealing on a compiled corpus. `progress`, when not
+// NULL, is called every progress_every history blocks of 100 moves.
+// Checkpoints are written every checkpoint_every blocks, as in
+// ga_optimize().
+// [[Rcpp::export]]
+List anneal_optimize(
+    SEXP corpus,
+    CharacterVector layout,
+    SEXP geometry,
+    LogicalVector fixed,
+    List rules,
+    int iterations = 20000,
+    int restarts = 5,
+    std::string cooling = "exponential",
+    double initial_temp = 0.0,
+    double final_temp = 0.0,
+    SEXP progress = R_NilValue,
+    int progress_every = 10,
+    int seed = 1,
+    std::string checkpoint = "",
+    int checkpoint_every = 0,
+    SEXP checkpoint_settings = R_NilValue,
+    bool resume = false
+) {
+  Stopwatch clock;
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  KeyboardLayout initial = layout_from_labels(cs, layout);
+  if (initial.n_keys != kg.geometry.n) stop("layout must have one key per geometry position");
+  if (fixed.size() != initial.n_keys) {
+    stop("fixed must have one entry per layout position");
+  }
+  if (iterations < 1) stop("iterations must be at least 1");
+  if (restarts < 1) stop("restarts must be at least 1");
+  if (progress_every < 1) stop("progress_every must be at least 1");
+
+  CoolingSchedule schedule;
+  if (cooling == "exponential") {
+    schedule = COOL_EXPONENTIAL;
+  } else if (cooling == "linear") {
+    schedule = COOL_LINEAR;
+  } else if (cooling == "logarithmic") {
+    schedule = COOL_LOGARITHMIC;
+  } else {
+    stop("cooling must be 'exponential', 'linear' or 'logarithmic'");
+  }
+
+  RuleSet rs = rules_from_list(rules, fixed, cs);
+  Objective objective = {&cs, &kg.geometry, &kg.costs, &rs, NULL};
+
+  AnnealConfig cfg = {iterations, restarts, schedule, initial_temp, final_temp};
+  Checkpoint resumed;
+  CheckpointPlan checkpoints = checkpoint_plan(
+    CHECKPOINT_ANNEAL, cs, kg, rs, anneal_config_hash(cfg), checkpoint, checkpoint_every,
+    checkpoint_settings, resume, resumed);
+  std::mt19937 rng(static_cast<uint32_t>(seed));
+  AnnealResult res = run_anneal(objective, initial, cfg, rng, checkpoints,
+                                resume ? &resumed : NULL,
+                                ProgressCallback(progress, progress_every));
+
+  return List::create(
+    Named("layout") = layout_labels(cs, res.best),
+    Named("effort") = objective.effort(res.best),
+    Named("objective") = res.best_score,
+    Named("history_best") = wrap(res.history_best),
+    Named("history_mean") = wrap(res.history_mean),
+    Named("evaluations") = res.evaluations,
+    Named("acceptance_rate") = res.evaluations > 0 ? res.accepted / res.evaluations : 0.0,
+    Named("telemetry") = telemetry_list(res.telemetry, clock.seconds(), res.stop_reason)
+  );
+}
@@ -0,0 +1,692 @@
+// branch_bound.cpp
+// Exact branch-and-bound solver for layouts with few free keys
+// Placing the free keys is a quadratic assignment problem: unigram costs
+// and bigrams with fixed keys are linear in the placement, bigrams between
+// free keys are quadratic. Nodes are bounded with a Gilmore-Lawler bound
+// over those terms, solved as a linear assignment problem. Trigram costs
+// and rule penalties are non-negative, so leaving the ones that are not
+// yet determined out of the bound keeps it valid; they are added exactly
+// as soon as all their keys are placed.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// LINEAR ASSIGNMENT
+// -----------------------------------------------------------------
+
+// Minimum-cost perfect matching of a k x k row-major cost matrix
+// (Hungarian algorithm with potentials, O(k^3)). `perm` receives the
+// column assigned to each row.
+static double solve_assignment(const std::vector<double>& cost, int k, std::vector<int>& perm) {
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<double> u(k + 1, 0.0), v(k + 1, 0.0), minv(k + 1);
+  std::vector<int> p(k + 1, 0), way(k + 1, 0);
+  std::vector<char> used(k + 1);
+  for (int i = 1; i <= k; i++) {
+    p[0] = i;
+    int j0 = 0;
+    std::fill(minv.begin(), minv.end(), inf);
+    std::fill(used.begin(), used.end(), 0);
+    do {
+      used[j0] = 1;
+      int i0 = p[j0], j1 = 0;
+      double delta = inf;
+      for (int j = 1; j <= k; j++) {
+        if (used[j]) continue;
+        double cur = cost[(i0 - 1) * k + (j - 1)] - u[i0] - v[j];
+        if (cur < minv[j]) {
+          minv[j] = cur;
+          way[j] = j0;
+        }
+        if (minv[j] < delta) {
+          delta = minv[j];
+          j1 = j;
+        }
+      }
+      for (int j = 0; j <= k; j++) {
+        if (used[j]) {
+          u[p[j]] += delta;
+          v[j] -= delta;
+        } else {
+          minv[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (p[j0] != 0);
+    do {
+      int j1 = way[j0];
+      p[j0] = p[j1];
+      j0 = j1;
+    } while (j0);
+  }
+
+  perm.assign(k, -1);
+  double total = 0.0;
+  for (int j = 1; j <= k; j++) {
+    if (p[j] == 0) continue;
+    perm[p[j] - 1] = j - 1;
+    total += cost[(p[j] - 1) * k + (j - 1)];
+  }
+  return total;
+}
+
+// -----------------------------------------------------------------
+// PROBLEM
+// -----------------------------------------------------------------
+
+// The effort of a layout split by how it depends on the free keys. Free
+// keys are numbered 0..m-1 in branching order and free positions 0..m-1.
+struct ExactProblem {
+  int m;
+  std::vector<int> free_sym;  // corpus symbol of each free key
+  std::vector<int> free_pos;  // layout position of each free slot
+  double constant;            // effort among fixed keys
+  std::vector<double> linear; // m * m: key i on slot j, with fixed keys
+  std::vector<double> flow;   // m * m: bigram count of key i then key j
+  std::vector<double> dist;   // m * m: cost of slot j right after slot i
+
+  // Trigrams with two or more distinct free keys. key[r] is the free key
+  // at role r, or -1 when the symbol is fixed at position pos[r].
+  struct Tri {
+    int key[3];
+    int pos[3];
+    double count;
+  };
+  std::vector<Tri> tris;
+};
+
+static ExactProblem build_problem(const Objective& objective, const KeyboardLayout& layout,
+                                  const std::vector<int>& free) {
+  const CorpusStats& cs = *objective.corpus;
+  const CostTables& costs = *objective.costs;
+  int k = cs.size();
+  std::vector<int> pos_of_sym;
+  layout.positions(k, pos_of_sym);
+
+  ExactProblem pb;
+  pb.m = free.size();
+  int m = pb.m;
+
+  // Branch on the keys with the most bigram traffic first: their
+  // placement moves the bound the most
+  std::vector<int> keys(m);
+  std::vector<double> traffic(m, 0.0);
+  for (int i = 0; i < m; i++) {
+    keys[i] = layout.keys[free[i]];
+    for (int s = 0; s < k; s++) {
+      traffic[i] += cs.bigram[keys[i] * k + s] + cs.bigram[s * k + keys[i]];
+    }
+  }
+  std::vector<int> order(m);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return traffic[a] > traffic[b];
+  });
+  pb.free_sym.resize(m);
+  for (int i = 0; i < m; i++) pb.free_sym[i] = keys[order[i]];
+  pb.free_pos = free;
+
+  std::vector<int> key_of_sym(k, -1);
+  for (int i = 0; i < m; i++) key_of_sym[pb.free_sym[i]] = i;
+  // Fixed symbols keep their position; free ones are "unknown" (-1 here)
+  std::vector<int> fixed_pos(k, -1);
+  for (int s = 0; s < k; s++) {
+    if (key_of_sym[s] < 0) fixed_pos[s] = pos_of_sym[s];
+  }
+
+  double scale = cs.base_scale();
+  pb.constant = 0.0;
+  pb.linear.assign(m * m, 0.0);
+  pb.flow.assign(m * m, 0.0);
+  pb.dist.assign(m * m, 0.0);
+
+  for (int s = 0; s < k; s++) {
+    if (fixed_pos[s] >= 0) pb.constant += cs.unigram[s] * costs.base[fixed_pos[s]] * scale;
+  }
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < m; j++) {
+      pb.linear[i * m + j] = cs.unigram[pb.free_sym[i]] * costs.base[free[j]] * scale;
+      pb.dist[i * m + j] = costs.bigram(free[i], free[j]);
+    }
+  }
+
+  for (int a = 0; a < k; a++) {
+    for (int b = 0; b < k; b++) {
+      double count = cs.bigram[a * k + b];
+      if (count == 0.0) continue;
+      int ka = key_of_sym[a], kb = key_of_sym[b];
+      int pa = fixed_pos[a], pb_ = fixed_pos[b];
+      if (ka < 0 && pa < 0) continue;  // not on the layout
+      if (kb < 0 && pb_ < 0) continue;
+      if (ka < 0 && kb < 0) {
+        pb.constant += count * costs.bigram(pa, pb_);
+      } else if (ka >= 0 && kb >= 0) {
+        if (ka == kb) {
+          for (int j = 0; j < m; j++) {
+            pb.linear[ka * m + j] += count * costs.bigram(free[j], free[j]);
+          }
+        } else {
+          pb.flow[ka * m + kb] += count;
+        }
+      } else if (ka >= 0) {
+        for (int j = 0; j < m; j++) pb.linear[ka * m + j] += count * costs.bigram(free[j], pb_);
+      } else {
+        for (int j = 0; j < m; j++) pb.linear[kb * m + j] += count * costs.bigram(pa, free[j]);
+      }
+    }
+  }
+
+  for (size_t t = 0; t < cs.trigrams.size(); t++) {
+    const Trigram& tg = cs.trigrams[t];
+    int sym[3] = {tg.a, tg.b, tg.c};
+    ExactProblem::Tri tri;
+    tri.count = tg.count;
+    int first_free = -1;
+    bool several = false, off_layout = false;
+    for (int r = 0; r < 3; r++) {
+      tri.key[r] = key_of_sym[sym[r]];
+      tri.pos[r] = fixed_pos[sym[r]];
+      if (tri.key[r] < 0 && tri.pos[r] < 0) off_layout = true;
+      if (tri.key[r] >= 0) {
+        if (first_free < 0) {
+          first_free = tri.key[r];
+        } else if (tri.key[r] != first_free) {
+          several = true;
+        }
+      }
+    }
+    if (off_layout) continue;
+    if (first_free < 0) {
+      pb.constant += tg.count * costs.trigram(tri.pos[0], tri.pos[1], tri.pos[2]);
+    } else if (!several) {
+      // Only one free key, possibly repeated: linear in its slot
+      for (int j = 0; j < m; j++) {
+        int p[3];
+        for (int r = 0; r < 3; r++) p[r] = tri.key[r] >= 0 ? free[j] : tri.pos[r];
+        pb.linear[first_free * m + j] += tg.count * costs.trigram(p[0], p[1], p[2]);
+      }
+    } else {
+      pb.tris.push_back(tri);
+    }
+  }
+  return pb;
+}
+
+// -----------------------------------------------------------------
+// SEARCH
+// -----------------------------------------------------------------
+
+// State shared by the threads exploring subtrees
+struct SharedSearch {
+  std::atomic<double> incumbent;
+  KeyboardLayout best;
+  std::vector<double> history_best;   // incumbent after every improvement
+  std::atomic<bool> timed_out;
+  std::atomic<long long> nodes;
+  Stopwatch clock;
+  double time_limit;
+};
+
+// Whether the time limit has run out, noting it for the other threads
+static bool out_of_time(SharedSearch& shared) {
+  if (!shared.timed_out && shared.clock.seconds() > shared.time_limit) {
+    shared.timed_out = true;
+  }
+  return shared.timed_out;
+}
+
+// A partial assignment of the first keys in branching order
+struct SubTree {
+  std::vector<int> slots;  // slot of key i, for i < depth
+  double bound;
+  bool finished;
+};
+
+class BranchAndBound {
+public:
+  BranchAndBound(const ExactProblem& pb, const Objective& objective,
+                 const KeyboardLayout& layout, SharedSearch& shared)
+    : pb_(pb), obj_(objective), layout_(layout), shared_(shared), m_(pb.m),
+      slot_of_(pb.m, -1), key_at_(pb.m, -1), nodes_(0), stop_(false) {}
+
+  // Lower bound of every completion of `slots` (keys 0..depth-1 placed)
+  double root_bound(const std::vector<int>& slots) {
+    place_all(slots);
+    std::vector<double> lap;
+    std::vector<int> slot_order;
+    double b = cost_ + bound(slots.size(), lap, slot_order);
+    unplace_all(slots);
+    return b;
+  }
+
+  // Explore a subtree; false if it was cut short by the time limit
+  bool explore(const std::vector<int>& slots) {
+    place_all(slots);
+    search(slots.size());
+    unplace_all(slots);
+    shared_.nodes += nodes_;
+    nodes_ = 0;
+    return !stop_;
+  }
+
+  // Children of a subtree, for splitting the search across threads
+  std::vector<std::vector<int>> children(const std::vector<int>& slots) {
+    std::vector<std::vector<int>> out;
+    place_all(slots);
+    for (int j = 0; j < m_; j++) {
+      if (key_at_[j] >= 0) continue;
+      out.push_back(slots);
+      out.back().push_back(j);
+    }
+    unplace_all(slots);
+    return out;
+  }
+
+private:
+  double place(int key, int slot) {
+    const std::vector<double>& flow = pb_.flow;
+    const std::vector<double>& dist = pb_.dist;
+    double added = pb_.linear[key * m_ + slot];
+    for (int v = 0; v < m_; v++) {
+      int r = slot_of_[v];
+      if (r < 0) continue;
+      added += flow[key * m_ + v] * dist[slot * m_ + r] + flow[v * m_ + key] * dist[r * m_ + slot];
+    }
+    slot_of_[key] = slot;
+    key_at_[slot] = key;
+    // Trigrams completed by this key
+    for (size_t t = 0; t < pb_.tris.size(); t++) {
+      const ExactProblem::Tri& tri = pb_.tris[t];
+      bool has_key = false, complete = true;
+      int p[3];
+      for (int r = 0; r < 3; r++) {
+        if (tri.key[r] < 0) {
+          p[r] = tri.pos[r];
+          continue;
+        }
+        has_key = has_key || tri.key[r] == key;
+        if (slot_of_[tri.key[r]] < 0) {
+          complete = false;
+          break;
+        }
+        p[r] = pb_.free_pos[slot_of_[tri.key[r]]];
+      }
+      if (has_key && complete) added += tri.count * obj_.costs->trigram(p[0], p[1], p[2]);
+    }
+    return added;
+  }
+
+  void unplace(int key) {
+    key_at_[slot_of_[key]] = -1;
+    slot_of_[key] = -1;
+  }
+
+  void place_all(const std::vector<int>& slots) {
+    cost_ = pb_.constant;
+    for (size_t i = 0; i < slots.size(); i++) cost_ += place(i, slots[i]);
+  }
+
+  void unplace_all(const std::vector<int>& slots) {
+    for (size_t i = 0; i < slots.size(); i++) unplace(i);
+  }
+
+  // Gilmore-Lawler bound on the cost still to come with keys 0..depth-1
+  // placed. Fills the reduced cost matrix of the next key's slots.
+  double bound(int depth, std::vector<double>& lap, std::vector<int>& slot_order) {
+    int k = m_ - depth;
+    if (k == 0) return 0.0;
+    std::vector<int> open_slots;
+    for (int j = 0; j < m_; j++) {
+      if (key_at_[j] < 0) open_slots.push_back(j);
+    }
+    const std::vector<double>& flow = pb_.flow;
+    const std::vector<double>& dist = pb_.dist;
+
+    // Flows between unplaced keys, largest first; distances between open
+    // slots, smallest first. Their scalar product bounds the quadratic
+    // cost of a key on a slot from below.
+    std::vector<std::vector<double>> flow_out(k), flow_in(k), dist_out(k), dist_in(k);
+    for (int a = 0; a < k; a++) {
+      int i = depth + a;
+      int j = open_slots[a];
+      for (int b = 0; b < k; b++) {
+        if (b == a) continue;
+        flow_out[a].push_back(flow[i * m_ + depth + b]);
+        flow_in[a].push_back(flow[(depth + b) * m_ + i]);
+        dist_out[a].push_back(dist[j * m_ + open_slots[b]]);
+        dist_in[a].push_back(dist[open_slots[b] * m_ + j]);
+      }
+      std::sort(flow_out[a].begin(), flow_out[a].end(), std::greater<double>());
+      std::sort(flow_in[a].begin(), flow_in[a].end(), std::greater<double>());
+      std::sort(dist_out[a].begin(), dist_out[a].end());
+      std::sort(dist_in[a].begin(), dist_in[a].end());
+    }
+
+    lap.assign(k * k, 0.0);
+    for (int a = 0; a < k; a++) {
+      int i = depth + a;
+      for (int b = 0; b < k; b++) {
+        int j = open_slots[b];
+        double c = pb_.linear[i * m_ + j];
+        for (int v = 0; v < depth; v++) {
+          int r = slot_of_[v];
+          c += flow[i * m_ + v] * dist[j * m_ + r] + flow[v * m_ + i] * dist[r * m_ + j];
+        }
+        double out = 0.0, in = 0.0;
+        for (int t = 0; t < k - 1; t++) {
+          out += flow_out[a][t] * dist_out[b][t];
+          in += flow_in[a][t] * dist_in[b][t];
+        }
+        lap[a * k + b] = c + 0.5 * (out + in);
+      }
+    }
+
+    // Trigrams whose only unplaced key is i are linear in its slot
+    for (size_t t = 0; t < pb_.tris.size(); t++) {
+      const ExactProblem::Tri& tri = pb_.tris[t];
+      int open_key = -1;
+      bool linear = true;
+      for (int r = 0; r < 3 && linear; r++) {
+        int key = tri.key[r];
+        if (key < 0 || slot_of_[key] >= 0) continue;
+        if (open_key < 0) {
+          open_key = key;
+        } else if (open_key != key) {
+          linear = false;
+        }
+      }
+      if (!linear || open_key < 0) continue;
+      for (int b = 0; b < k; b++) {
+        int p[3];
+        for (int r = 0; r < 3; r++) {
+          int key = tri.key[r];
+          if (key < 0) {
+            p[r] = tri.pos[r];
+          } else {
+            p[r] = pb_.free_pos[key == open_key ? open_slots[b] : slot_of_[key]];
+          }
+        }
+        lap[(open_key - depth) * k + b] += tri.count * obj_.costs->trigram(p[0], p[1], p[2]);
+      }
+    }
+
+    std::vector<int> perm;
+    double b = solve_assignment(lap, k, perm);
+
+    // Try the next key's slots in order of their reduced cost
+    std::vector<int> idx(k);
+    std::iota(idx.begin(), idx.end(), 0);
+    std::sort(idx.begin(), idx.end(), [&](int x, int y) { return lap[x] < lap[y]; });
+    slot_order.resize(k);
+    for (int b2 = 0; b2 < k; b2++) slot_order[b2] = open_slots[idx[b2]];
+    return b;
+  }
+
+  bool prune(double lower) const {
+    double inc = shared_.incumbent.load();
+    return lower >= inc - 1e-9 * std::abs(inc);
+  }
+
+  void search(int depth) {
+    if (stop_) return;
+    if ((++nodes_ & 255) == 0 && out_of_time(shared_)) {
+      stop_ = true;
+      return;
+    }
+
+    if (depth == m_) {
+      if (!prune(cost_)) leaf();
+      return;
+    }
+
+    std::vector<double> lap;
+    std::vector<int> slot_order;
+    double lower = cost_ + bound(depth, lap, slot_order);
+    if (prune(lower)) return;
+
+    for (size_t c = 0; c < slot_order.size() && !stop_; c++) {
+      double saved = cost_;
+      cost_ += place(depth, slot_order[c]);
+      search(depth + 1);
+      unplace(depth);
+      cost_ = saved;
+    }
+  }
+
+  // Complete assignment cheaper than the incumbent: rescore it with the
+  // rule penalties and keep it if it still wins
+  void leaf() {
+    KeyboardLayout candidate = layout_;
+    for (int i = 0; i < m_; i++) candidate.keys[pb_.free_pos[slot_of_[i]]] = pb_.free_sym[i];
+    double score = obj_.rules->has_penalties() ? obj_(candidate) : cost_;
+#ifdef _OPENMP
+    #pragma omp critical(exact_incumbent)
+#endif
+    {
+      if (score < shared_.incumbent.load()) {
+        shared_.incumbent.store(score);
+        shared_.best = candidate;
+        shared_.history_best.push_back(score);
+      }
+    }
+  }
+
+  const ExactProblem& pb_;
+  const Objective& obj_;
+  const KeyboardLayout& layout_;
+  SharedSearch& shared_;
+  int m_;
+  std::vector<int> slot_of_;  // slot of each key, -1 if unplaced
+  std::vector<int> key_at_;   // key on each slot, -1 if open
+  double cost_;
+  long long nodes_;
+  bool stop_;
+};
+
+// First-improvement pairwise swaps of free keys, for a good incumbent.
+// Stops early, with the best layout so far, when the time limit runs out.
+static KeyboardLayout improve_by_swaps(const Objective& objective, KeyboardLayout layout,
+                                       const std::vector<int>& free, double& score,
+                                       double& evaluations, SharedSearch& shared) {
+  score = objective(layout);
+  evaluations += 1;
+  bool improved = true;
+  while (improved) {
+    improved = false;
+    for (size_t a = 0; a < free.size(); a++) {
+      for (size_t b = a + 1; b < free.size(); b++) {
+        if (out_of_time(shared)) return layout;
+        KeyboardLayout candidate = layout.with_swap(free[a], free[b]);
+        double s = objective(candidate);
+        evaluations += 1;
+        if (s < score - 1e-12 * std::abs(score)) {
+          layout = candidate;
+          score = s;
+          improved = true;
+        }
+      }
+    }
+  }
+  return layout;
+}
+
+// -----------------------------------------------------------------
+// DRIVER
+// -----------------------------------------------------------------
+
+struct ExactResult {
+  KeyboardLayout best;
+  double best_score;
+  std::vector<double> history_best;  // incumbent after every improvement
+  bool optimal;                      // search completed: best is the optimum
+  double lower_bound;                // on the optimum objective
+  double nodes;
+  double seconds;
+  Telemetry telemetry;               // totals only, there are no generations
+};
+
+// Exact optimum over the free positions, or the best layout found and a
+// lower bound when time_limit (seconds) runs out. Subtrees are explored
+// by n_threads threads sharing the incumbent.
+static ExactResult run_exact(const Objective& objective, const KeyboardLayout& initial,
+                             const std::vector<int>& free, double time_limit, int n_threads) {
+  SharedSearch shared;
+  shared.time_limit = time_limit;
+  shared.timed_out = false;
+  shared.nodes = 0;
+
+  // Start from a local optimum so the first incumbent already prunes well
+  Telemetry telemetry;
+  double start_score;
+  shared.best = improve_by_swaps(objective, initial, free, start_score,
+                                 telemetry.initial_evaluations, shared);
+  shared.incumbent = start_score;
+  shared.history_best.push_back(start_score);
+  double search_start = shared.clock.seconds();
+
+  double lower_bound = start_score;
+  bool optimal = true;
+  if (free.size() >= 2) {
+    ExactProblem pb = build_problem(objective, initial, free);
+    int threads = n_threads;
+
+    // Split the tree into subtrees until every thread has several to
+    // pick from, then explore the most promising ones first. The bound
+    // of the whole tree stands in for those of subtrees not bounded in
+    // time.
+    BranchAndBound splitter(pb, objective, initial, shared);
+    double root = splitter.root_bound(std::vector<int>());
+    std::vector<std::vector<int>> frontier(1);
+    int depth = 0;
+    while (static_cast<int>(frontier.size()) < 8 * threads && depth < pb.m - 1 && depth < 3 &&
+           !out_of_time(shared)) {
+      std::vector<std::vector<int>> next;
+      for (size_t t = 0; t < frontier.size(); t++) {
+        std::vector<std::vector<int>> kids = splitter.children(frontier[t]);
+        next.insert(next.end(), kids.begin(), kids.end());
+      }
+      frontier.swap(next);
+      depth++;
+    }
+    std::vector<SubTree> tasks(frontier.size());
+    for (size_t t = 0; t < frontier.size(); t++) {
+      tasks[t].slots = frontier[t];
+      tasks[t].bound = out_of_time(shared) ? root : splitter.root_bound(frontier[t]);
+      tasks[t].finished = false;
+    }
+    std::stable_sort(tasks.begin(), tasks.end(), [](const SubTree& a, const SubTree& b) {
+      return a.bound < b.bound;
+    });
+
+    int n_tasks = tasks.size();
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(threads) if (threads > 1)
+#endif
+    {
+      BranchAndBound solver(pb, objective, initial, shared);
+#ifdef _OPENMP
+      #pragma omp for schedule(dynamic, 1)
+#endif
+      for (int t = 0; t < n_tasks; t++) {
+        if (out_of_time(shared)) continue;
+        tasks[t].finished = solver.explore(tasks[t].slots);
+      }
+    }
+
+    // Unfinished subtrees still hold their root bound, unless that bound
+    // already rules them out
+    double incumbent = shared.incumbent.load();
+    for (int t = 0; t < n_tasks; t++) {
+      if (tasks[t].finished || tasks[t].bound >= incumbent - 1e-9 * std::abs(incumbent)) {
+        continue;
+      }
+      optimal = false;
+      lower_bound = std::min(lower_bound, tasks[t].bound);
+    }
+  }
+
+  ExactResult res;
+  res.best = shared.best;
+  res.best_score = objective(shared.best);
+  res.history_best = shared.history_best;
+  res.optimal = optimal;
+  res.lower_bound = optimal ? res.best_score : lower_bound;
+  res.nodes = static_cast<double>(shared.nodes.load());
+  res.seconds = shared.clock.seconds();
+  // Evaluations are full scores, as for the other optimizers; search
+  // nodes are reported apart
+  res.telemetry = telemetry;
+  res.telemetry.scoring_seconds = res.seconds - search_start;
+  return res;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Exact optimum over the free keys by branch and bound. Subtrees are
+// explored in parallel; when time_limit (seconds) runs out, the best
+// layout found is returned with a lower bound on the optimum.
+// [[Rcpp::export]]
+List exact_optimize(
+    SEXP corpus,
+    CharacterVector layout,
+    SEXP geometry,
+    LogicalVector fixed,
+    List rules,
+    double time_limit = 60.0,
+    int max_free = 20,
+    int n_threads = 1
+) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  KeyboardLayout initial = layout_from_labels(cs, layout);
+  if (initial.n_keys != kg.geometry.n) stop("layout must have one key per geometry position");
+  if (fixed.size() != initial.n_keys) {
+    stop("fixed must have one entry per layout position");
+  }
+  const CostTables& costs = kg.costs;
+  if (*std::min_element(costs.finger_tri.begin(), costs.finger_tri.end()) < 0.0) {
+    stop("the exact solver needs non-negative effort weights");
+  }
+
+  RuleSet rs = rules_from_list(rules, fixed, cs);
+  Objective objective = {&cs, &kg.geometry, &kg.costs, &rs, NULL};
+  std::vector<int> free = free_positions(rs, initial.n_keys);
+  if (static_cast<int>(free.size()) > max_free) {
+    stop("the exact solver handles at most " + std::to_string(max_free) +
+         " free keys, got " + std::to_string(free.size()) + "; fix more keys");
+  }
+
+  ExactResult res = run_exact(objective, initial, free, time_limit, resolve_threads(n_threads));
+  double gap = res.best_score > 0.0
+    ? std::max(0.0, (res.best_score - res.lower_bound) / res.best_score) : 0.0;
+
+  List telemetry = telemetry_list(res.telemetry, res.seconds,
+                                  res.optimal ? "optimal" : "time_limit");
+  telemetry.push_back(res.nodes, "nodes");
+  return List::create(
+    Named("layout") = layout_labels(cs, res.best),
+    Named("effort") = objective.effort(res.best),
+    Named("objective") = res.best_score,
+    Named("history_best") = wrap(res.history_best),
+    Named("history_mean") = NumericVector(res.history_best.size(), NA_REAL),
+    Named("evaluations") = res.telemetry.total_evaluations(),
+    Named("optimal") = res.optimal,
+    Named("lower_bound") = res.lower_bound,
+    Named("gap") = gap,
+    Named("nodes") = res.nodes,
+    Named("telemetry") = telemetry
+  );
+}
@@ -0,0 +1,314 @@
+// checkpoint.cpp
+// Optimizer checkpoints: periodic snapshots of a run's full state, so a
+// crashed or preempted run can be resumed where it stopped
+// A checkpoint stores the state itself (populations or annealing state,
+// RNG streams, history) but only fingerprints of the corpus, geometry and
+// rules, which are rebuilt from the same inputs on resume and refused
+// when they differ.
+//
+// Layout (native byte order, checked on load):
+//   0  char[4]  magic "LBKS"
+//   4  uint32   format version
+//   8  uint32   byte order mark 0x01020304
+//  12  uint32   method (1 = genetic, 2 = annealing)
+//  16  uint64   corpus fingerprint
+//  24  uint64   geometry fingerprint (positions and effort weights)
+//  32  uint64   rules fingerprint
+//  40  uint64   optimizer settings fingerprint
+//  48  uint64   length of the caller's settings, then the bytes
+//      uint64   length of the state, then the bytes
+//      uint64   FNV-1a checksum of everything before it
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace Rcpp;
+
+static const char CHECKPOINT_MAGIC[4] = {'L', 'B', 'K', 'S'};
+static const uint32_t CHECKPOINT_VERSION = 1;
+static const uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+// -----------------------------------------------------------------
+// STATE SERIALIZATION
+// -----------------------------------------------------------------
+
+void StateWriter::put_string(const std::string& s) {
+  put(static_cast<uint64_t>(s.size()));
+  bytes_.append(s);
+}
+
+// The engine's own text form: portable and exact
+void StateWriter::put_rng(const std::mt19937& rng) {
+  std::ostringstream out;
+  out << rng;
+  put_string(out.str());
+}
+
+void StateWriter::put_layout(const KeyboardLayout& layout) {
+  put_vector(layout.keys);
+}
+
+void StateWriter::put_layouts(const std::vector<KeyboardLayout>& layouts) {
+  put(static_cast<uint64_t>(layouts.size()));
+  for (size_t i = 0; i < layouts.size(); i++) put_layout(layouts[i]);
+}
+
+void StateWriter::put_telemetry(const Telemetry& t) {
+  put_vector(t.evaluations);
+  put_vector(t.elapsed);
+  put_vector(t.diversity);
+  put_vector(t.acceptance);
+  put(t.initial_evaluations);
+  put(t.scoring_seconds);
+  put(t.repair_seconds);
+  put(t.variation_seconds);
+}
+
+std::string StateReader::get_string() {
+  uint64_t n = get<uint64_t>();
+  if (n > bytes_.size() - pos_) corrupt();
+  return std::string(take(n), n);
+}
+
+void StateReader::get_rng(std::mt19937& rng) {
+  std::istringstream in(get_string());
+  in >> rng;
+  if (in.fail()) corrupt();
+}
+
+KeyboardLayout StateReader::get_layout() {
+  std::vector<int> keys;
+  get_vector(keys);
+  return KeyboardLayout(keys);
+}
+
+void StateReader::get_layouts(std::vector<KeyboardLayout>& layouts) {
+  uint64_t n = get<uint64_t>();
+  if (n > bytes_.size() - pos_) corrupt();
+  layouts.resize(n);
+  for (size_t i = 0; i < n; i++) layouts[i] = get_layout();
+}
+
+void StateReader::get_telemetry(Telemetry& t) {
+  get_vector(t.evaluations);
+  get_vector(t.elapsed);
+  get_vector(t.diversity);
+  get_vector(t.acceptance);
+  t.initial_evaluations = get<double>();
+  t.scoring_seconds = get<double>();
+  t.repair_seconds = get<double>();
+  t.variation_seconds = get<double>();
+}
+
+// -----------------------------------------------------------------
+// FINGERPRINTS
+// -----------------------------------------------------------------
+
+// The counts effort is computed from; batch bookkeeping is left out, so
+// a corpus saved and loaded again keeps its fingerprint
+uint64_t corpus_fingerprint(const CorpusStats& cs) {
+  Fingerprint f;
+  for (int s = 0; s < cs.size(); s++) f.add(cs.symbols[s]);
+  f.add(cs.unigram).add(cs.bigram).add(cs.n_chars).add(cs.n_alpha);
+  for (size_t i = 0; i < cs.trigrams.size(); i++) {
+    const Trigram& t = cs.trigrams[i];
+    f.add(t.a).add(t.b).add(t.c).add(t.count);
+  }
+  return f.value();
+}
+
+uint64_t geometry_fingerprint(const KeyboardGeometry& kg) {
+  const Geometry& g = kg.geometry;
+  const EffortWeights& w = kg.costs.weights;
+  Fingerprint f;
+  f.add(g.x).add(g.y).add(g.row).add(g.col).add(g.layer);
+  f.add(w.base).add(w.same_finger).add(w.same_hand).add(w.row_change).add(w.trigram)
+    .add(w.layer);
+  return f.value();
+}
+
+uint64_t rules_fingerprint(const RuleSet& rules) {
+  Fingerprint f;
+  f.add(rules.fixed);
+  f.add(rules.hand_pref_syms).add(rules.hand_pref_targets).add(rules.hand_pref_weight);
+  f.add(rules.row_pref_syms).add(rules.row_pref_targets).add(rules.row_pref_weight);
+  f.add(rules.balance_target).add(rules.balance_weight);
+  f.add(rules.finger_pref_syms).add(rules.finger_pref_masks).add(rules.finger_pref_weight);
+  f.add(rules.keep_syms).add(rules.keep_positions).add(rules.keep_weight);
+  return f.value();
+}
+
+// -----------------------------------------------------------------
+// CHECKPOINT FILES
+// -----------------------------------------------------------------
+
+void write_checkpoint(const std::string& path, const Checkpoint& checkpoint) {
+  StateWriter w;
+  w.put(CHECKPOINT_MAGIC);
+  w.put(CHECKPOINT_VERSION);
+  w.put(CHECKPOINT_BYTE_ORDER);
+  w.put(static_cast<uint32_t>(checkpoint.method));
+  w.put(checkpoint.corpus_hash);
+  w.put(checkpoint.geometry_hash);
+  w.put(checkpoint.rules_hash);
+  w.put(checkpoint.config_hash);
+  w.put_string(checkpoint.settings);
+  w.put_string(checkpoint.state);
+  std::string bytes = w.bytes();
+  uint64_t checksum = Fingerprint().add(bytes).value();
+  bytes.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+  std::string tmp = path + ".tmp";
+  FILE* out = std::fopen(tmp.c_str(), "wb");
+  if (out == NULL) throw std::runtime_error("cannot write checkpoint '" + tmp + "'");
+  bool ok = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+  ok = std::fflush(out) == 0 && ok;
+#ifndef _WIN32
+  ok = ok && fsync(fileno(out)) == 0;
+#endif
+  ok = std::fclose(out) == 0 && ok;
+  if (!ok) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("cannot write checkpoint '" + tmp + "'");
+  }
+#ifdef _WIN32
+  // rename() does not replace an existing file on Windows
+  std::remove(path.c_str());
+#endif
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("cannot replace checkpoint '" + path + "'");
+  }
+}
+
+Checkpoint read_checkpoint(const std::string& path) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in) throw std::runtime_error("cannot open checkpoint '" + path + "'");
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  uint64_t checksum = 0;
+  if (bytes.size() < sizeof(checksum)) {
+    throw std::runtime_error("checkpoint '" + path + "' is truncated");
+  }
+  size_t body = bytes.size() - sizeof(checksum);
+  std::memcpy(&checksum, bytes.data() + body, sizeof(checksum));
+  bytes.resize(body);
+  if (bytes.size() < 4 || bytes.compare(0, 4, CHECKPOINT_MAGIC, 4) != 0) {
+    throw std::runtime_error("'" + path + "' is not a checkpoint file");
+  }
+  if (Fingerprint().add(bytes).value() != checksum) {
+    throw std::runtime_error("checkpoint '" + path + "' is truncated or corrupt");
+  }
+
+  StateReader r(bytes);
+  r.get<uint32_t>();  // magic
+  uint32_t version = r.get<uint32_t>();
+  if (r.get<uint32_t>() != CHECKPOINT_BYTE_ORDER) {
+    throw std::runtime_error("checkpoint '" + path +
+                             "' was written on a machine with a different byte order");
+  }
+  if (version != CHECKPOINT_VERSION) {
+    throw std::runtime_error("checkpoint '" + path + "' has unsupported format version " +
+                             std::to_string(version));
+  }
+  uint32_t method = r.get<uint32_t>();
+  if (method != CHECKPOINT_GENETIC && method != CHECKPOINT_ANNEAL) {
+    throw std::runtime_error("checkpoint '" + path + "' is corrupt");
+  }
+
+  Checkpoint checkpoint;
+  checkpoint.method = static_cast<CheckpointMethod>(method);
+  checkpoint.corpus_hash = r.get<uint64_t>();
+  checkpoint.geometry_hash = r.get<uint64_t>();
+  checkpoint.rules_hash = r.get<uint64_t>();
+  checkpoint.config_hash = r.get<uint64_t>();
+  checkpoint.settings = r.get_string();
+  checkpoint.state = r.get_string();
+  return checkpoint;
+}
+
+static const char* method_name(CheckpointMethod method) {
+  return method == CHECKPOINT_ANNEAL ? "anneal" : "genetic";
+}
+
+CheckpointPlan checkpoint_plan(
+    CheckpointMethod method,
+    const CorpusStats& corpus,
+    const KeyboardGeometry& kg,
+    const RuleSet& rules,
+    uint64_t config_hash,
+    const std::string& path,
+    int every,
+    SEXP settings,
+    bool resume,
+    Checkpoint& resumed
+) {
+  if (every < 0) stop("checkpoint_every must be non-negative");
+  if (path.empty() && (every > 0 || resume)) stop("checkpoint needs a file path");
+
+  CheckpointPlan plan;
+  plan.path = path;
+  plan.every = every;
+  Checkpoint& header = plan.header;
+  header.method = method;
+  header.corpus_hash = corpus_fingerprint(corpus);
+  header.geometry_hash = geometry_fingerprint(kg);
+  header.rules_hash = rules_fingerprint(rules);
+  header.config_hash = config_hash;
+  if (!Rf_isNull(settings)) {
+    if (TYPEOF(settings) != RAWSXP) stop("checkpoint settings must be a raw vector");
+    const char* raw = reinterpret_cast<const char*>(RAW(settings));
+    header.settings.assign(raw, raw + Rf_length(settings));
+  }
+  if (!resume) return plan;
+
+  resumed = read_checkpoint(path);
+  const std::string what = "checkpoint '" + path + "' was written ";
+  if (resumed.method != method) {
+    stop(what + "by method \"" + method_name(resumed.method) + "\", not \"" +
+         method_name(method) + "\"");
+  }
+  if (resumed.corpus_hash != header.corpus_hash) stop(what + "for a different corpus");
+  if (resumed.geometry_hash != header.geometry_hash) {
+    stop(what + "for a different keyboard or different effort weights");
+  }
+  if (resumed.rules_hash != header.rules_hash) {
+    stop(what + "for different rules or fixed keys");
+  }
+  if (resumed.config_hash != header.config_hash) {
+    stop(what + "with different optimizer settings");
+  }
+  return plan;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Header of a checkpoint file: the method, the settings stored by the run
+// and how far it got (generations; annealing: history blocks)
+// [[Rcpp::export]]
+List checkpoint_read(std::string path) {
+  Checkpoint checkpoint = read_checkpoint(path);
+  StateReader state(checkpoint.state);
+  int step = state.get<int32_t>();
+
+  RawVector settings(checkpoint.settings.size());
+  std::copy(checkpoint.settings.begin(), checkpoint.settings.end(), settings.begin());
+  return List::create(
+    Named("method") = method_name(checkpoint.method),
+    Named("settings") = settings,
+    Named("step") = step
+  );
+}
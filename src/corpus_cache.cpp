@@ -0,0 +1,321 @@
+// corpus_cache.cpp
+// On-disk cache format for compiled corpus statistics
+// A compiled corpus is written as one compact file ("LBKC") with every
+// section 8-byte aligned, so it can be memory-mapped and read in place.
+//
+// Layout (native byte order, checked on load):
+//   0  char[4]  magic "LBKC"
+//   4  uint32   format version
+//   8  uint32   byte order mark 0x01020304
+//  12  uint32   normalization flags
+//  16  uint64   source hash
+//  24  uint32   k, number of symbols
+//  28  uint32   number of text batches (version 2; reserved in version 1)
+//  32  uint64   number of trigrams
+//  40  double   n_chars
+//  48  double   n_alpha
+//  56  uint32   codepoints[k]            (padded to 8 bytes)
+//      double   unigram[k]
+//      double   bigram[k * k]
+//      uint32   trigram symbols[3 * nt]  (a, b, c per trigram, padded)
+//      double   trigram counts[nt]
+//      batches, 48 bytes each: uint64 source hash, double n_chars,
+//      double n_alpha, int32 head[2], int32 tail[2], int32 n, padding
+//
+// Version 1 files have no batches; they load as corpora that cannot be
+// appended to.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Rcpp;
+
+static const char CACHE_MAGIC[4] = {'L', 'B', 'K', 'C'};
+static const uint32_t CACHE_VERSION = 2;
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+// Normalization applied by the compilers; part of the cache identity
+static const uint32_t NORMALIZE_FOLD_CASE = 1;
+static const uint32_t NORMALIZE_JOIN_SAMPLES = 2;
+static const uint32_t CACHE_FLAGS = NORMALIZE_FOLD_CASE | NORMALIZE_JOIN_SAMPLES;
+
+// -----------------------------------------------------------------
+// SOURCE HASH
+// -----------------------------------------------------------------
+
+// 64-bit FNV-1a over every string, each followed by a 0xFF byte (which
+// never occurs in UTF-8) so element boundaries are part of the hash
+static uint64_t fnv1a(const std::vector<std::string>& parts) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < parts.size(); i++) {
+    const std::string& s = parts[i];
+    for (size_t j = 0; j < s.size(); j++) {
+      h ^= static_cast<unsigned char>(s[j]);
+      h *= 1099511628211ULL;
+    }
+    h ^= 0xFF;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+uint64_t strings_hash(const std::vector<std::string>& parts) {
+  return fnv1a(parts);
+}
+
+static std::string hash_hex(uint64_t h) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+  return std::string(buf);
+}
+
+static uint64_t parse_hash(const std::string& hex) {
+  if (hex.empty()) return 0;
+  if (hex.size() > 16 || hex.find_first_not_of("0123456789abcdef") != std::string::npos) {
+    stop("source_hash must be a hexadecimal string of at most 16 digits");
+  }
+  return std::strtoull(hex.c_str(), NULL, 16);
+}
+
+// -----------------------------------------------------------------
+// SERIALIZATION
+// -----------------------------------------------------------------
+
+namespace {
+
+struct CacheWriter {
+  std::string buf;
+
+  template <class T> void put(const T& value) {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <class T> void put_array(const T* values, size_t n) {
+    if (n > 0) buf.append(reinterpret_cast<const char*>(values), n * sizeof(T));
+    pad();
+  }
+
+  void pad() {
+    while (buf.size() % 8 != 0) buf += '\0';
+  }
+};
+
+// Bounds-checked reads from a mapped or buffered file
+struct CacheReader {
+  const char* data;
+  size_t size;
+  size_t pos;
+  const std::string& path;
+
+  CacheReader(const char* d, size_t n, const std::string& p)
+    : data(d), size(n), pos(0), path(p) {}
+
+  const char* take(size_t bytes) {
+    if (bytes > size - pos) stop("corpus cache '" + path + "' is truncated");
+    const char* p = data + pos;
+    pos += bytes;
+    return p;
+  }
+
+  template <class T> T get() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  template <class T> void get_array(std::vector<T>& out, size_t n) {
+    if (n > (size - pos) / sizeof(T)) stop("corpus cache '" + path + "' is truncated");
+    out.resize(n);
+    if (n > 0) std::memcpy(out.data(), take(n * sizeof(T)), n * sizeof(T));
+    while (pos % 8 != 0 && pos < size) pos++;
+  }
+};
+
+std::string serialize_corpus(const CorpusStats& cs, uint64_t source_hash) {
+  CacheWriter w;
+  w.buf.append(CACHE_MAGIC, 4);
+  w.put(CACHE_VERSION);
+  w.put(CACHE_BYTE_ORDER);
+  w.put(CACHE_FLAGS);
+  w.put(source_hash);
+  w.put(static_cast<uint32_t>(cs.size()));
+  w.put(static_cast<uint32_t>(cs.batches.size()));
+  w.put(static_cast<uint64_t>(cs.trigrams.size()));
+  w.put(cs.n_chars);
+  w.put(cs.n_alpha);
+
+  w.put_array(cs.codepoints.data(), cs.codepoints.size());
+  w.put_array(cs.unigram.data(), cs.unigram.size());
+  w.put_array(cs.bigram.data(), cs.bigram.size());
+
+  size_t nt = cs.trigrams.size();
+  std::vector<uint32_t> syms(3 * nt);
+  std::vector<double> counts(nt);
+  for (size_t i = 0; i < nt; i++) {
+    syms[3 * i] = cs.trigrams[i].a;
+    syms[3 * i + 1] = cs.trigrams[i].b;
+    syms[3 * i + 2] = cs.trigrams[i].c;
+    counts[i] = cs.trigrams[i].count;
+  }
+  w.put_array(syms.data(), syms.size());
+  w.put_array(counts.data(), counts.size());
+
+  for (size_t i = 0; i < cs.batches.size(); i++) {
+    const CorpusBatch& b = cs.batches[i];
+    w.put(b.source_hash);
+    w.put(b.n_chars);
+    w.put(b.n_alpha);
+    const int32_t edges[5] = {b.head[0], b.head[1], b.tail[0], b.tail[1], b.n};
+    w.put_array(edges, 5);
+  }
+  return w.buf;
+}
+
+CorpusStats deserialize_corpus(CacheReader& r, uint64_t& source_hash) {
+  if (std::memcmp(r.take(4), CACHE_MAGIC, 4) != 0) {
+    stop("'" + r.path + "' is not a corpus cache file");
+  }
+  uint32_t version = r.get<uint32_t>();
+  if (r.get<uint32_t>() != CACHE_BYTE_ORDER) {
+    stop("corpus cache '" + r.path + "' was written on a machine with a different byte order");
+  }
+  if (version != 1 && version != CACHE_VERSION) {
+    stop("corpus cache '" + r.path + "' has unsupported format version " +
+         std::to_string(version));
+  }
+  if (r.get<uint32_t>() != CACHE_FLAGS) {
+    stop("corpus cache '" + r.path + "' was compiled with different text normalization");
+  }
+  source_hash = r.get<uint64_t>();
+  uint32_t k = r.get<uint32_t>();
+  uint32_t n_batches = r.get<uint32_t>();
+  if (version == 1) n_batches = 0;
+  uint64_t nt = r.get<uint64_t>();
+
+  CorpusStats cs;
+  cs.n_chars = r.get<double>();
+  cs.n_alpha = r.get<double>();
+  r.get_array(cs.codepoints, k);
+  r.get_array(cs.unigram, k);
+  r.get_array(cs.bigram, static_cast<size_t>(k) * k);
+
+  std::vector<uint32_t> syms;
+  std::vector<double> counts;
+  r.get_array(syms, 3 * nt);
+  r.get_array(counts, nt);
+  cs.trigrams.resize(nt);
+  for (size_t i = 0; i < nt; i++) {
+    if (syms[3 * i] >= k || syms[3 * i + 1] >= k || syms[3 * i + 2] >= k) {
+      stop("corpus cache '" + r.path + "' is corrupt");
+    }
+    Trigram t = {static_cast<int>(syms[3 * i]), static_cast<int>(syms[3 * i + 1]),
+                 static_cast<int>(syms[3 * i + 2]), counts[i]};
+    cs.trigrams[i] = t;
+  }
+
+  std::vector<int32_t> edges;
+  for (uint32_t i = 0; i < n_batches; i++) {
+    CorpusBatch b;
+    b.source_hash = r.get<uint64_t>();
+    b.n_chars = r.get<double>();
+    b.n_alpha = r.get<double>();
+    r.get_array(edges, 5);
+    for (int j = 0; j < 4; j++) {
+      if (edges[j] < -1 || edges[j] >= static_cast<int32_t>(k)) {
+        stop("corpus cache '" + r.path + "' is corrupt");
+      }
+    }
+    b.head[0] = edges[0];
+    b.head[1] = edges[1];
+    b.tail[0] = edges[2];
+    b.tail[1] = edges[3];
+    b.n = edges[4];
+    cs.batches.push_back(b);
+  }
+
+  for (uint32_t s = 0; s < k; s++) {
+    cs.symbols.push_back(encode_utf8(cs.codepoints[s]));
+  }
+  return cs;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Hash identifying the source of a corpus (keys, text or file metadata)
+// [[Rcpp::export]]
+std::string corpus_source_hash(CharacterVector parts) {
+  return hash_hex(fnv1a(Rcpp::as<std::vector<std::string>>(parts)));
+}
+
+// Write a compiled corpus to `path`. A corpus updated in place no longer
+// matches its source, so its source hash is dropped whatever R passes:
+// attributes of the caller's copy may still carry it.
+// [[Rcpp::export]]
+void corpus_save(SEXP corpus, std::string path, std::string source_hash = "") {
+  const CorpusStats& cs = corpus_ref(corpus);
+  uint64_t hash = cs.revision == 0 ? parse_hash(source_hash) : 0;
+  std::string bytes = serialize_corpus(cs, hash);
+
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) stop("cannot write corpus cache '" + path + "'");
+  out.write(bytes.data(), bytes.size());
+  if (!out) stop("cannot write corpus cache '" + path + "'");
+}
+
+// Read a corpus cache file, memory-mapping it where the platform allows
+// [[Rcpp::export]]
+List corpus_load(std::string path) {
+  uint64_t source_hash = 0;
+  CorpusStats* cs = NULL;
+
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) stop("cannot open corpus cache '" + path + "'");
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    stop("corpus cache '" + path + "' is truncated");
+  }
+  size_t size = st.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) stop("cannot map corpus cache '" + path + "'");
+  try {
+    CacheReader reader(static_cast<const char*>(map), size, path);
+    cs = new CorpusStats(deserialize_corpus(reader, source_hash));
+  } catch (...) {
+    munmap(map, size);
+    throw;
+  }
+  munmap(map, size);
+#else
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in) stop("cannot open corpus cache '" + path + "'");
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  CacheReader reader(bytes.data(), bytes.size(), path);
+  cs = new CorpusStats(deserialize_corpus(reader, source_hash));
+#endif
+
+  return List::create(
+    Named("corpus") = XPtr<CorpusStats>(cs, true),
+    Named("source_hash") = hash_hex(source_hash)
+  );
+}
@@ -0,0 +1,1068 @@
+// corpus_stats.cpp
+// Compiled corpus statistics for keyboard layout optimization
+// Text is scanned once into unigram/bigram/trigram counts over the
+// optimized key set; layouts are then scored from the counts, so the
+// cost of one evaluation depends on the number of keys, not text length.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include "unicode_tables.h"
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// UTF-8 DECODING AND CASE FOLDING
+// -----------------------------------------------------------------
+
+void decode_utf8(const std::string& s, std::vector<uint32_t>& out) {
+  out.clear();
+  out.reserve(s.size());
+  size_t i = 0;
+  size_t n = s.size();
+  while (i < n) {
+    unsigned char c = s[i];
+    uint32_t cp;
+    size_t len;
+    if (c < 0x80) {
+      out.push_back(c);
+      i++;
+      continue;
+    } else if ((c & 0xE0) == 0xC0) {
+      cp = c & 0x1F;
+      len = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+      cp = c & 0x0F;
+      len = 3;
+    } else if ((c & 0xF8) == 0xF0) {
+      cp = c & 0x07;
+      len = 4;
+    } else {
+      out.push_back(0xFFFD);  // stray continuation or invalid lead byte
+      i++;
+      continue;
+    }
+
+    bool valid = (i + len <= n);
+    for (size_t j = 1; valid && j < len; j++) {
+      unsigned char cc = s[i + j];
+      if ((cc & 0xC0) != 0x80) {
+        valid = false;
+      } else {
+        cp = (cp << 6) | (cc & 0x3F);
+      }
+    }
+    if (!valid) {
+      out.push_back(0xFFFD);
+      i++;
+      continue;
+    }
+    out.push_back(cp);
+    i += len;
+  }
+}
+
+std::string encode_utf8(uint32_t cp) {
+  std::string s;
+  if (cp < 0x80) {
+    s += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    s += static_cast<char>(0xC0 | (cp >> 6));
+    s += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    s += static_cast<char>(0xE0 | (cp >> 12));
+    s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    s += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    s += static_cast<char>(0xF0 | (cp >> 18));
+    s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    s += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+  return s;
+}
+
+// Last range of `table` starting at or before `cp`, or NULL
+template <size_t N, size_t W>
+static const uint32_t* range_at(const uint32_t (&table)[N][W], uint32_t cp) {
+  const uint32_t (*r)[W] = std::upper_bound(
+    table, table + N, cp, [](uint32_t c, const uint32_t (&range)[W]) { return c < range[0]; }
+  );
+  return r == table ? NULL : r[-1];
+}
+
+// Unicode simple lowercase mapping, as tolower() in letter_freq()
+uint32_t fold_case(uint32_t cp) {
+  if (cp < 0x80) {
+    return (cp >= 'A' && cp <= 'Z') ? cp + 32 : cp;
+  }
+  const uint32_t* r = range_at(LOWERCASE_RANGES, cp);
+  return (r != NULL && cp <= r[1]) ? r[2] + (cp - r[0]) : cp;
+}
+
+// The Unicode Alphabetic property, the [:alpha:] class of letter_freq()
+bool is_alpha_codepoint(uint32_t cp) {
+  if (cp < 0x80) {
+    return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+  }
+  const uint32_t* r = range_at(ALPHABETIC_RANGES, cp);
+  return r != NULL && cp <= r[1];
+}
+
+// -----------------------------------------------------------------
+// N-GRAM COUNTING
+// -----------------------------------------------------------------
+
+namespace {
+
+// Streams text through a sliding window of the last two symbols.
+// Trigrams use a dense k^3 buffer up to 1 MiB per accumulator (50 symbols),
+// otherwise a hash map: a full keyboard with symbols and layers has a few
+// hundred, whose k^3 buffer would run into gigabytes per thread while text
+// only ever touches a small fraction of the triples.
+struct NgramAccumulator {
+  int k;
+  std::vector<double> unigram;
+  std::vector<double> bigram;
+  bool dense_trigrams;
+  std::vector<double> tri_dense;
+  std::unordered_map<uint64_t, double> tri_sparse;
+  int prev2;
+  int prev1;
+  double n_chars;
+  double n_alpha;
+
+  explicit NgramAccumulator(int k_)
+    : k(k_), unigram(k_, 0.0), bigram(k_ * k_, 0.0),
+      dense_trigrams(k_ <= 50), prev2(-1), prev1(-1),
+      n_chars(0.0), n_alpha(0.0) {
+    if (dense_trigrams) tri_dense.assign(static_cast<size_t>(k) * k * k, 0.0);
+  }
+
+  void add_text(const std::vector<uint32_t>& cps, const SymbolLookup& lookup) {
+    n_chars += cps.size();
+    for (size_t i = 0; i < cps.size(); i++) {
+      uint32_t cp = cps[i];
+      if (is_alpha_codepoint(cp)) n_alpha += 1.0;
+      int s = lookup(cp);
+      if (s < 0) continue;  // skipped without breaking the sequence
+
+      unigram[s] += 1.0;
+      if (prev1 >= 0) {
+        bigram[prev1 * k + s] += 1.0;
+        if (prev2 >= 0) add_trigram(prev2, prev1, s, 1.0);
+      }
+      prev2 = prev1;
+      prev1 = s;
+    }
+  }
+
+  void add_trigram(int a, int b, int c, double count) {
+    size_t idx = (static_cast<size_t>(a) * k + b) * k + c;
+    if (dense_trigrams) {
+      tri_dense[idx] += count;
+    } else {
+      tri_sparse[idx] += count;
+    }
+  }
+
+  // Add the counts of another accumulator over the same alphabet
+  void merge(const NgramAccumulator& other) {
+    for (int s = 0; s < k; s++) unigram[s] += other.unigram[s];
+    for (size_t i = 0; i < bigram.size(); i++) bigram[i] += other.bigram[i];
+    if (dense_trigrams) {
+      for (size_t i = 0; i < tri_dense.size(); i++) tri_dense[i] += other.tri_dense[i];
+    } else {
+      for (auto it = other.tri_sparse.begin(); it != other.tri_sparse.end(); ++it) {
+        tri_sparse[it->first] += it->second;
+      }
+    }
+    n_chars += other.n_chars;
+    n_alpha += other.n_alpha;
+  }
+
+  void emit_trigrams(std::vector<Trigram>& out) const {
+    out.clear();
+    size_t kk = k;
+    if (dense_trigrams) {
+      for (size_t idx = 0; idx < tri_dense.size(); idx++) {
+        if (tri_dense[idx] == 0.0) continue;
+        Trigram t = {static_cast<int>(idx / (kk * kk)), static_cast<int>((idx / kk) % kk),
+                     static_cast<int>(idx % kk), tri_dense[idx]};
+        out.push_back(t);
+      }
+    } else {
+      for (auto it = tri_sparse.begin(); it != tri_sparse.end(); ++it) {
+        size_t idx = it->first;
+        Trigram t = {static_cast<int>(idx / (kk * kk)), static_cast<int>((idx / kk) % kk),
+                     static_cast<int>(idx % kk), it->second};
+        out.push_back(t);
+      }
+      std::sort(out.begin(), out.end(), [](const Trigram& x, const Trigram& y) {
+        if (x.a != y.a) return x.a < y.a;
+        if (x.b != y.b) return x.b < y.b;
+        return x.c < y.c;
+      });
+    }
+  }
+};
+
+void note_head(CorpusBatch& batch, const std::vector<uint32_t>& cps, const SymbolLookup& lookup) {
+  for (size_t i = 0; i < cps.size() && batch.n < 2; i++) {
+    int s = lookup(cps[i]);
+    if (s >= 0) batch.head[batch.n++] = s;
+  }
+}
+
+// Count text samples, each followed by a separator, as a batch of their
+// own (as if they started the text) and record the batch's edges
+void count_batch(NgramAccumulator& acc, const std::vector<std::string>& text_samples,
+                 const SymbolLookup& lookup, CorpusBatch& batch) {
+  batch.source_hash = strings_hash(text_samples);
+  batch.head[0] = batch.head[1] = -1;
+  batch.n = 0;
+  double n_chars = acc.n_chars;
+  double n_alpha = acc.n_alpha;
+  acc.prev2 = -1;
+  acc.prev1 = -1;
+
+  std::vector<uint32_t> cps;
+  const std::vector<uint32_t> separator(1, ' ');
+  for (size_t i = 0; i < text_samples.size(); i++) {
+    decode_utf8(text_samples[i], cps);
+    note_head(batch, cps, lookup);
+    acc.add_text(cps, lookup);
+    note_head(batch, separator, lookup);
+    acc.add_text(separator, lookup);
+  }
+
+  batch.tail[0] = acc.prev2;
+  batch.tail[1] = acc.prev1;
+  batch.n_chars = acc.n_chars - n_chars;
+  batch.n_alpha = acc.n_alpha - n_alpha;
+}
+
+}  // namespace
+
+// Validate the key set and store it as the corpus alphabet
+static void set_alphabet(CorpusStats& cs, const std::vector<std::string>& keys) {
+  std::vector<uint32_t> cps;
+  for (size_t i = 0; i < keys.size(); i++) {
+    decode_utf8(keys[i], cps);
+    if (cps.size() != 1) {
+      Rcpp::stop("each key must be a single character, got '" + keys[i] + "'");
+    }
+    uint32_t cp = fold_case(cps[0]);
+    if (std::find(cs.codepoints.begin(), cs.codepoints.end(), cp) != cs.codepoints.end()) {
+      Rcpp::stop("duplicate key '" + keys[i] + "'");
+    }
+    cs.codepoints.push_back(cp);
+    cs.symbols.push_back(encode_utf8(cp));
+  }
+}
+
+static void store_counts(CorpusStats& cs, const NgramAccumulator& acc) {
+  cs.unigram = acc.unigram;
+  cs.bigram = acc.bigram;
+  acc.emit_trigrams(cs.trigrams);
+  cs.n_chars = acc.n_chars;
+  cs.n_alpha = acc.n_alpha;
+}
+
+CorpusStats compile_corpus_stats(
+    const std::vector<std::string>& text_samples,
+    const std::vector<std::string>& keys
+) {
+  CorpusStats cs;
+  set_alphabet(cs, keys);
+
+  SymbolLookup lookup(cs.codepoints);
+  NgramAccumulator acc(cs.size());
+  // Samples are joined with a separator, as layout_effort() does
+  CorpusBatch batch;
+  count_batch(acc, text_samples, lookup, batch);
+
+  store_counts(cs, acc);
+  cs.batches.push_back(batch);
+  return cs;
+}
+
+// -----------------------------------------------------------------
+// STREAMED FILE INGESTION
+// -----------------------------------------------------------------
+
+namespace {
+
+// First and last two symbols of a chunk, enough to recover the n-grams
+// that span the boundary with its neighbours
+struct ChunkEdge {
+  int head[2];
+  int tail[2];
+  int n;  // symbols in the chunk, capped at 2
+};
+
+// Count a chunk on its own, as if it were the start of the text
+void count_chunk(NgramAccumulator& acc, const std::vector<uint32_t>& cps,
+                 const SymbolLookup& lookup, ChunkEdge& edge) {
+  edge.n = 0;
+  for (size_t i = 0; i < cps.size() && edge.n < 2; i++) {
+    int s = lookup(cps[i]);
+    if (s >= 0) edge.head[edge.n++] = s;
+  }
+  acc.prev2 = -1;
+  acc.prev1 = -1;
+  acc.add_text(cps, lookup);
+  edge.tail[0] = acc.prev2;
+  edge.tail[1] = acc.prev1;
+}
+
+// Add the n-grams spanning the previous chunks' last two symbols (w2, w1)
+// and this chunk's first two, then advance the window past the chunk
+void stitch_chunk(NgramAccumulator& acc, const ChunkEdge& edge, int& w2, int& w1) {
+  if (edge.n == 0) return;
+  int h0 = edge.head[0];
+  if (w1 >= 0) {
+    acc.bigram[w1 * acc.k + h0] += 1.0;
+    if (w2 >= 0) acc.add_trigram(w2, w1, h0, 1.0);
+    if (edge.n == 2) acc.add_trigram(w1, h0, edge.head[1], 1.0);
+  }
+  if (edge.n == 2) {
+    w2 = edge.tail[0];
+    w1 = edge.tail[1];
+  } else {
+    w2 = w1;
+    w1 = h0;
+  }
+}
+
+// Take the first symbols of a batch from its chunks, in order
+void extend_head(CorpusBatch& batch, const ChunkEdge& edge) {
+  for (int i = 0; i < edge.n && batch.n < 2; i++) {
+    batch.head[batch.n++] = edge.head[i];
+  }
+}
+
+// Bytes at the end of buf that belong to an incomplete UTF-8 sequence
+size_t incomplete_utf8_tail(const std::string& buf) {
+  size_t n = buf.size();
+  for (size_t back = 1; back <= 4 && back <= n; back++) {
+    unsigned char c = buf[n - back];
+    if ((c & 0xC0) == 0x80) continue;  // continuation byte
+    size_t len = 1;
+    if ((c & 0xE0) == 0xC0) {
+      len = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+      len = 3;
+    } else if ((c & 0xF8) == 0xF0) {
+      len = 4;
+    }
+    return len > back ? back : 0;
+  }
+  return 0;
+}
+
+}  // namespace
+
+CorpusStats compile_corpus_files(
+    const std::vector<std::string>& paths,
+    const std::vector<std::string>& keys,
+    size_t chunk_bytes,
+    int n_threads
+) {
+  CorpusStats cs;
+  set_alphabet(cs, keys);
+  SymbolLookup lookup(cs.codepoints);
+  int k = cs.size();
+  int threads = resolve_threads(n_threads);
+
+  // One accumulator per thread; counts are summed at the end, so the
+  // result does not depend on the number of threads
+  std::vector<NgramAccumulator> acc(threads, NgramAccumulator(k));
+  std::vector<std::string> chunks(threads);
+  std::vector<ChunkEdge> edges(threads);
+  int w2 = -1;
+  int w1 = -1;
+  // All files form one batch; its text is not hashed
+  CorpusBatch batch = {0, 0.0, 0.0, {-1, -1}, {-1, -1}, 0};
+
+  for (size_t f = 0; f < paths.size(); f++) {
+    std::ifstream in(paths[f].c_str(), std::ios::binary);
+    if (!in) Rcpp::stop("cannot open corpus file '" + paths[f] + "'");
+
+    // Read up to one chunk per thread, count them in parallel, then stitch
+    // the boundaries in file order. A UTF-8 sequence cut by the chunk size
+    // is carried over to the next chunk.
+    std::string carry;
+    while (in) {
+      int n_chunks = 0;
+      while (n_chunks < threads && in) {
+        std::string& buf = chunks[n_chunks++];
+        buf.swap(carry);
+        carry.clear();
+        size_t used = buf.size();
+        buf.resize(used + chunk_bytes);
+        in.read(&buf[used], chunk_bytes);
+        buf.resize(used + in.gcount());
+        if (in) {
+          size_t cut = incomplete_utf8_tail(buf);
+          carry.assign(buf, buf.size() - cut, cut);
+          buf.resize(buf.size() - cut);
+        }
+      }
+
+#ifdef _OPENMP
+      #pragma omp parallel for num_threads(threads) schedule(static, 1) if (threads > 1)
+#endif
+      for (int c = 0; c < n_chunks; c++) {
+#ifdef _OPENMP
+        int t = omp_get_thread_num();
+#else
+        int t = 0;
+#endif
+        std::vector<uint32_t> cps;
+        decode_utf8(chunks[c], cps);
+        count_chunk(acc[t], cps, lookup, edges[c]);
+      }
+
+      for (int c = 0; c < n_chunks; c++) {
+        extend_head(batch, edges[c]);
+        stitch_chunk(acc[0], edges[c], w2, w1);
+      }
+      Rcpp::checkUserInterrupt();
+    }
+
+    // Files are joined with a separator, like text samples
+    ChunkEdge sep;
+    count_chunk(acc[0], std::vector<uint32_t>(1, ' '), lookup, sep);
+    extend_head(batch, sep);
+    stitch_chunk(acc[0], sep, w2, w1);
+  }
+
+  for (int t = 1; t < threads; t++) {
+    acc[0].merge(acc[t]);
+  }
+  store_counts(cs, acc[0]);
+  batch.tail[0] = w2;
+  batch.tail[1] = w1;
+  batch.n_chars = cs.n_chars;
+  batch.n_alpha = cs.n_alpha;
+  cs.batches.push_back(batch);
+  return cs;
+}
+
+CorpusStats combine_corpus_stats(
+    const std::vector<const CorpusStats*>& corpora,
+    const std::vector<double>& weights
+) {
+  if (corpora.empty()) Rcpp::stop("at least one corpus is needed");
+  if (weights.size() != corpora.size()) Rcpp::stop("weights must have one entry per corpus");
+  const CorpusStats& first = *corpora[0];
+  int k = first.size();
+
+  double total_weight = 0.0, total_chars = 0.0, total_alpha = 0.0;
+  for (size_t i = 0; i < corpora.size(); i++) {
+    const CorpusStats& c = *corpora[i];
+    if (c.codepoints != first.codepoints) {
+      Rcpp::stop("all corpora must be compiled for the same keys");
+    }
+    if (weights[i] < 0.0) Rcpp::stop("weights must be non-negative");
+    if (weights[i] > 0.0 && c.n_chars <= 0.0) Rcpp::stop("cannot weight an empty corpus");
+    total_weight += weights[i];
+    total_chars += c.n_chars;
+    total_alpha += c.n_alpha;
+  }
+  if (total_weight <= 0.0) Rcpp::stop("weights must not all be zero");
+
+  CorpusStats mix;
+  mix.symbols = first.symbols;
+  mix.codepoints = first.codepoints;
+  mix.n_chars = total_chars;
+  mix.n_alpha = total_alpha;
+  mix.unigram.assign(k, 0.0);
+  mix.bigram.assign(static_cast<size_t>(k) * k, 0.0);
+  double mix_scale = mix.base_scale();
+
+  std::vector<Trigram> trigrams;
+  for (size_t i = 0; i < corpora.size(); i++) {
+    const CorpusStats& c = *corpora[i];
+    if (weights[i] == 0.0) continue;
+    double factor = weights[i] / total_weight * total_chars / c.n_chars;
+    double unigram_factor = mix_scale > 0.0 ? factor * c.base_scale() / mix_scale : 0.0;
+    for (int s = 0; s < k; s++) mix.unigram[s] += unigram_factor * c.unigram[s];
+    for (size_t b = 0; b < mix.bigram.size(); b++) mix.bigram[b] += factor * c.bigram[b];
+    for (size_t t = 0; t < c.trigrams.size(); t++) {
+      Trigram tg = c.trigrams[t];
+      tg.count *= factor;
+      trigrams.push_back(tg);
+    }
+  }
+
+  // Keep the sparse trigram list sorted by (a, b, c) with one entry each
+  std::sort(trigrams.begin(), trigrams.end(), [](const Trigram& x, const Trigram& y) {
+    if (x.a != y.a) return x.a < y.a;
+    if (x.b != y.b) return x.b < y.b;
+    return x.c < y.c;
+  });
+  for (size_t t = 0; t < trigrams.size(); t++) {
+    if (!mix.trigrams.empty()) {
+      Trigram& last = mix.trigrams.back();
+      if (last.a == trigrams[t].a && last.b == trigrams[t].b && last.c == trigrams[t].c) {
+        last.count += trigrams[t].count;
+        continue;
+      }
+    }
+    mix.trigrams.push_back(trigrams[t]);
+  }
+  return mix;
+}
+
+// -----------------------------------------------------------------
+// INCREMENTAL UPDATES
+// -----------------------------------------------------------------
+
+namespace {
+
+bool trigram_less(const Trigram& x, const Trigram& y) {
+  if (x.a != y.a) return x.a < y.a;
+  if (x.b != y.b) return x.b < y.b;
+  return x.c < y.c;
+}
+
+// Last two symbols of the text, -1 where it has fewer
+void stream_tail(const std::vector<CorpusBatch>& batches, int& w2, int& w1) {
+  std::vector<int> last;  // newest first
+  for (size_t i = batches.size(); i-- > 0 && last.size() < 2;) {
+    const CorpusBatch& b = batches[i];
+    if (b.n >= 1) last.push_back(b.tail[1]);
+    if (b.n >= 2 && last.size() < 2) last.push_back(b.tail[0]);
+  }
+  w1 = last.size() > 0 ? last[0] : -1;
+  w2 = last.size() > 1 ? last[1] : -1;
+}
+
+// First two symbols of the text from batch `from` on
+ChunkEdge stream_head(const std::vector<CorpusBatch>& batches, size_t from) {
+  ChunkEdge edge;
+  edge.n = 0;
+  for (size_t i = from; i < batches.size() && edge.n < 2; i++) {
+    for (int j = 0; j < batches[i].n && edge.n < 2; j++) {
+      edge.head[edge.n++] = batches[i].head[j];
+    }
+  }
+  return edge;
+}
+
+CorpusDelta make_delta(const NgramAccumulator& acc, double sign) {
+  CorpusDelta d;
+  d.unigram = acc.unigram;
+  for (size_t s = 0; s < d.unigram.size(); s++) d.unigram[s] *= sign;
+  for (size_t i = 0; i < acc.bigram.size(); i++) {
+    if (acc.bigram[i] == 0.0) continue;
+    d.bigram.push_back(std::make_pair(static_cast<int>(i), sign * acc.bigram[i]));
+  }
+  acc.emit_trigrams(d.trigrams);
+  for (size_t i = 0; i < d.trigrams.size(); i++) d.trigrams[i].count *= sign;
+  d.n_chars = sign * acc.n_chars;
+  d.n_alpha = sign * acc.n_alpha;
+  return d;
+}
+
+// Add a change to the counts, dropping trigrams whose count falls to zero
+// so the result is identical to compiling the remaining text
+void apply_delta(CorpusStats& cs, const CorpusDelta& d) {
+  for (size_t s = 0; s < d.unigram.size(); s++) cs.unigram[s] += d.unigram[s];
+  for (size_t i = 0; i < d.bigram.size(); i++) cs.bigram[d.bigram[i].first] += d.bigram[i].second;
+
+  std::vector<Trigram> merged;
+  merged.reserve(cs.trigrams.size() + d.trigrams.size());
+  size_t i = 0, j = 0;
+  size_t ni = cs.trigrams.size(), nj = d.trigrams.size();
+  while (i < ni || j < nj) {
+    Trigram t;
+    if (j == nj || (i < ni && trigram_less(cs.trigrams[i], d.trigrams[j]))) {
+      t = cs.trigrams[i++];
+    } else if (i == ni || trigram_less(d.trigrams[j], cs.trigrams[i])) {
+      t = d.trigrams[j++];
+    } else {
+      t = cs.trigrams[i++];
+      t.count += d.trigrams[j++].count;
+    }
+    if (t.count != 0.0) merged.push_back(t);
+  }
+  cs.trigrams.swap(merged);
+
+  cs.n_chars += d.n_chars;
+  cs.n_alpha += d.n_alpha;
+  cs.revision++;
+}
+
+}  // namespace
+
+CorpusDelta append_corpus_text(
+    CorpusStats& corpus,
+    const std::vector<std::string>& text_samples
+) {
+  if (corpus.batches.empty()) {
+    Rcpp::stop("corpus cannot be updated: it is a mix of corpora or was saved by an older version");
+  }
+  SymbolLookup lookup(corpus.codepoints);
+  NgramAccumulator acc(corpus.size());
+  CorpusBatch batch;
+  count_batch(acc, text_samples, lookup, batch);
+
+  // N-grams across the join with the end of the current text
+  int w2, w1;
+  stream_tail(corpus.batches, w2, w1);
+  ChunkEdge edge = {{batch.head[0], batch.head[1]}, {batch.tail[0], batch.tail[1]}, batch.n};
+  stitch_chunk(acc, edge, w2, w1);
+
+  CorpusDelta delta = make_delta(acc, 1.0);
+  apply_delta(corpus, delta);
+  corpus.batches.push_back(batch);
+  return delta;
+}
+
+CorpusDelta remove_corpus_text(
+    CorpusStats& corpus,
+    const std::vector<std::string>& text_samples
+) {
+  if (corpus.batches.empty()) {
+    Rcpp::stop("corpus cannot be updated: it is a mix of corpora or was saved by an older version");
+  }
+  if (corpus.batches.size() == 1) Rcpp::stop("cannot remove the only batch of a corpus");
+  SymbolLookup lookup(corpus.codepoints);
+  NgramAccumulator acc(corpus.size());
+  CorpusBatch batch;
+  count_batch(acc, text_samples, lookup, batch);
+
+  const CorpusBatch& oldest = corpus.batches[0];
+  bool same = batch.n_chars == oldest.n_chars && batch.n_alpha == oldest.n_alpha &&
+    batch.n == oldest.n && (oldest.source_hash == 0 || batch.source_hash == oldest.source_hash);
+  for (int j = 0; j < 2 && same; j++) {
+    same = batch.head[j] == oldest.head[j] && batch.tail[j] == oldest.tail[j];
+  }
+  if (!same) Rcpp::stop("text_samples are not the oldest batch of the corpus");
+
+  // N-grams across the join with the next batch
+  int w2 = batch.tail[0];
+  int w1 = batch.tail[1];
+  stitch_chunk(acc, stream_head(corpus.batches, 1), w2, w1);
+
+  CorpusDelta delta = make_delta(acc, -1.0);
+  apply_delta(corpus, delta);
+  corpus.batches.erase(corpus.batches.begin());
+  return delta;
+}
+
+// -----------------------------------------------------------------
+// TABLE-DRIVEN EFFORT EVALUATION
+// -----------------------------------------------------------------
+
+// Same classification as effort_breakdown(): same finger (different
+// physical key), otherwise same hand, otherwise a hand alternation; layer
+// switches are counted on top of the class
+EffortComponents corpus_components(
+    const CorpusStats& corpus,
+    const Geometry& geometry,
+    const std::vector<int>& pos_of_sym
+) {
+  const Geometry& g = geometry;
+  int k = corpus.size();
+  EffortComponents c = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+  for (int s = 0; s < k; s++) {
+    int p = pos_of_sym[s];
+    if (p >= 0) c.base += corpus.unigram[s] * g.base_cost[p];
+  }
+  c.base *= corpus.base_scale();
+
+  for (int a = 0; a < k; a++) {
+    int p = pos_of_sym[a];
+    if (p < 0) continue;
+    const double* row = &corpus.bigram[a * k];
+    for (int b = 0; b < k; b++) {
+      double count = row[b];
+      int q = pos_of_sym[b];
+      if (count == 0.0 || q < 0) continue;
+      int pq = g.pair(p, q);
+      if (g.layer_cost[pq] > 0.0) {
+        c.layer_switches += count;
+        c.layer += count * g.layer_cost[pq];
+      }
+      switch (g.pair_class[pq]) {
+        case PAIR_SAME_FINGER:
+          c.same_finger_bigrams += count;
+          c.same_finger += count * g.same_finger_cost[pq];
+          break;
+        case PAIR_SAME_HAND:
+          c.same_hand_bigrams += count;
+          c.same_hand += count * g.same_hand_cost[pq];
+          c.row_change += count * g.row_change_cost[pq];
+          break;
+        default:
+          c.hand_alternations += count;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < corpus.trigrams.size(); i++) {
+    const Trigram& t = corpus.trigrams[i];
+    int p0 = pos_of_sym[t.a];
+    int p1 = pos_of_sym[t.b];
+    int p2 = pos_of_sym[t.c];
+    if (p0 < 0 || p1 < 0 || p2 < 0 || !g.same_hand(p0, p1, p2)) continue;
+    c.same_hand_trigrams += t.count;
+    c.trigram += t.count * g.finger_tri_cost[g.finger_triple(p0, p1, p2)];
+  }
+
+  return c;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+CorpusStats& corpus_ref(SEXP corpus) {
+  XPtr<CorpusStats> ptr(corpus);
+  if (ptr.get() == NULL) {
+    stop("corpus pointer is invalid (compiled corpora cannot be saved with saveRDS)");
+  }
+  return *ptr;
+}
+
+int find_symbol(const CorpusStats& corpus, const std::string& label) {
+  std::vector<uint32_t> cps;
+  decode_utf8(label, cps);
+  if (cps.size() != 1) return -1;
+  uint32_t cp = fold_case(cps[0]);
+  for (int s = 0; s < corpus.size(); s++) {
+    if (corpus.codepoints[s] == cp) return s;
+  }
+  return -1;
+}
+
+KeyboardLayout layout_from_labels(const CorpusStats& corpus, CharacterVector layout) {
+  std::vector<int> keys(layout.size());
+  for (int i = 0; i < layout.size(); i++) {
+    std::string label = Rcpp::as<std::string>(layout[i]);
+    keys[i] = find_symbol(corpus, label);
+    if (keys[i] < 0) {
+      stop("layout key '" + label + "' is not in the corpus key set");
+    }
+  }
+  return KeyboardLayout(keys);
+}
+
+CharacterVector layout_labels(const CorpusStats& corpus, const KeyboardLayout& layout) {
+  CharacterVector labels(layout.n_keys);
+  for (int i = 0; i < layout.n_keys; i++) {
+    labels[i] = corpus.symbols[layout.keys[i]];
+  }
+  return labels;
+}
+
+KeyboardGeometry& geometry_ref(SEXP geometry) {
+  XPtr<KeyboardGeometry> ptr(geometry);
+  if (ptr.get() == NULL) {
+    stop("geometry pointer is invalid (keyboard geometries cannot be saved with saveRDS)");
+  }
+  return *ptr;
+}
+
+// Map layout labels to corpus symbols: pos_of_sym[symbol] = position
+static std::vector<int> layout_positions(const CorpusStats& corpus, CharacterVector layout) {
+  std::vector<int> pos_of_sym(corpus.size(), -1);
+  for (int i = 0; i < layout.size(); i++) {
+    int s = find_symbol(corpus, Rcpp::as<std::string>(layout[i]));
+    if (s >= 0) pos_of_sym[s] = i;
+  }
+  return pos_of_sym;
+}
+
+// Compile text samples into n-gram counts over `keys`
+// [[Rcpp::export]]
+SEXP corpus_compile(CharacterVector text_samples, CharacterVector keys) {
+  std::vector<std::string> texts = Rcpp::as<std::vector<std::string>>(text_samples);
+  std::vector<std::string> k = Rcpp::as<std::vector<std::string>>(keys);
+  CorpusStats* cs = new CorpusStats(compile_corpus_stats(texts, k));
+  return XPtr<CorpusStats>(cs, true);
+}
+
+// Compile text files into n-gram counts over `keys`, streaming them in
+// chunks of `chunk_bytes`
+// [[Rcpp::export]]
+SEXP corpus_compile_files(
+    CharacterVector paths,
+    CharacterVector keys,
+    double chunk_bytes = 4194304,
+    int n_threads = 1
+) {
+  if (chunk_bytes < 1) stop("chunk_bytes must be at least 1");
+  std::vector<std::string> files = Rcpp::as<std::vector<std::string>>(paths);
+  std::vector<std::string> k = Rcpp::as<std::vector<std::string>>(keys);
+  CorpusStats* cs = new CorpusStats(
+    compile_corpus_files(files, k, static_cast<size_t>(chunk_bytes), n_threads)
+  );
+  return XPtr<CorpusStats>(cs, true);
+}
+
+// Weighted mix of compiled corpora (see combine_corpus_stats)
+// [[Rcpp::export]]
+SEXP corpus_combine(List corpora, NumericVector weights) {
+  std::vector<const CorpusStats*> parts;
+  for (int i = 0; i < corpora.size(); i++) {
+    parts.push_back(&corpus_ref(corpora[i]));
+  }
+  CorpusStats* cs = new CorpusStats(
+    combine_corpus_stats(parts, Rcpp::as<std::vector<double>>(weights))
+  );
+  return XPtr<CorpusStats>(cs, true);
+}
+
+// Copy the counts of a compiled corpus into R objects
+// [[Rcpp::export]]
+List corpus_summary(SEXP corpus) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  int k = cs.size();
+
+  CharacterVector symbols(k);
+  NumericVector unigram(k);
+  NumericMatrix bigram(k, k);
+  for (int a = 0; a < k; a++) {
+    symbols[a] = cs.symbols[a];
+    unigram[a] = cs.unigram[a];
+    for (int b = 0; b < k; b++) {
+      bigram(a, b) = cs.bigram[a * k + b];
+    }
+  }
+  unigram.attr("names") = symbols;
+  bigram.attr("dimnames") = List::create(symbols, symbols);
+
+  int nt = cs.trigrams.size();
+  CharacterVector first(nt), second(nt), third(nt);
+  NumericVector count(nt);
+  for (int i = 0; i < nt; i++) {
+    first[i] = cs.symbols[cs.trigrams[i].a];
+    second[i] = cs.symbols[cs.trigrams[i].b];
+    third[i] = cs.symbols[cs.trigrams[i].c];
+    count[i] = cs.trigrams[i].count;
+  }
+
+  return List::create(
+    Named("symbols") = symbols,
+    Named("unigrams") = unigram,
+    Named("bigrams") = bigram,
+    Named("trigrams") = DataFrame::create(
+      Named("first") = first,
+      Named("second") = second,
+      Named("third") = third,
+      Named("count") = count,
+      Named("stringsAsFactors") = false
+    ),
+    Named("n_chars") = cs.n_chars,
+    Named("n_alpha") = cs.n_alpha
+  );
+}
+
+// Build the geometry and weighted cost tables of a set of key positions
+// [[Rcpp::export]]
+SEXP geometry_build(
+    NumericVector pos_x,
+    NumericVector pos_y,
+    IntegerVector pos_row,
+    IntegerVector pos_col,
+    double w_base = 1.0,
+    double w_same_finger = 3.0,
+    double w_same_hand = 1.0,
+    double w_row_change = 0.5,
+    double w_trigram = 0.3,
+    double w_layer = 1.0,
+    IntegerVector pos_layer = IntegerVector::create()
+) {
+  int n = pos_x.size();
+  if (n == 0) stop("geometry needs at least one key position");
+  if (pos_y.size() != n || pos_row.size() != n || pos_col.size() != n) {
+    stop("key position vectors must have the same length");
+  }
+  if (pos_layer.size() != 0 && pos_layer.size() != n) {
+    stop("pos_layer must be empty or have one layer per key position");
+  }
+  Geometry g = make_geometry(
+    Rcpp::as<std::vector<double>>(pos_x),
+    Rcpp::as<std::vector<double>>(pos_y),
+    Rcpp::as<std::vector<int>>(pos_row),
+    Rcpp::as<std::vector<int>>(pos_col),
+    Rcpp::as<std::vector<int>>(pos_layer)
+  );
+  EffortWeights w = {w_base, w_same_finger, w_same_hand, w_row_change, w_trigram, w_layer};
+  return XPtr<KeyboardGeometry>(new KeyboardGeometry(g, w), true);
+}
+
+// Copy the per-position data and weighted cost tables into R objects
+// [[Rcpp::export]]
+List geometry_summary(SEXP geometry) {
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  const Geometry& g = kg.geometry;
+  const CostTables& costs = kg.costs;
+  int n = g.n;
+
+  NumericMatrix pair(n, n);
+  for (int p = 0; p < n; p++) {
+    for (int q = 0; q < n; q++) {
+      pair(p, q) = costs.bigram(p, q);
+    }
+  }
+
+  return List::create(
+    Named("n_keys") = n,
+    Named("finger") = wrap(g.finger),
+    Named("hand") = wrap(g.hand),
+    Named("layer") = wrap(g.layer),
+    Named("base_cost") = wrap(costs.base),
+    Named("pair_cost") = pair,
+    Named("finger_trigram_cost") = wrap(costs.finger_tri),
+    Named("weights") = List::create(
+      Named("base") = costs.weights.base,
+      Named("same_finger") = costs.weights.same_finger,
+      Named("same_hand") = costs.weights.same_hand,
+      Named("row_change") = costs.weights.row_change,
+      Named("trigram") = costs.weights.trigram,
+      Named("layer") = costs.weights.layer
+    )
+  );
+}
+
+// Calculate effort for a single layout from compiled corpus counts
+// [[Rcpp::export]]
+double corpus_layout_effort(SEXP corpus, CharacterVector layout, SEXP geometry) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  if (layout.size() != kg.geometry.n) {
+    stop("layout must have one key per geometry position");
+  }
+  return corpus_effort(cs, kg.costs, layout_positions(cs, layout));
+}
+
+std::vector<KeyboardLayout> layouts_from_indices(
+    const CorpusStats& corpus,
+    IntegerMatrix layouts,
+    CharacterVector keys,
+    int n_positions
+) {
+  KeyboardLayout key_syms = layout_from_labels(corpus, keys);
+  int n_layouts = layouts.nrow();
+  int n_pos = layouts.ncol();
+  if (n_pos != n_positions) stop("layouts must have one column per key position");
+  if (key_syms.n_keys != n_pos) stop("keys must have one entry per key position");
+
+  std::vector<KeyboardLayout> out(n_layouts);
+  std::vector<char> seen(n_pos);
+  for (int r = 0; r < n_layouts; r++) {
+    std::vector<int> syms(n_pos);
+    std::fill(seen.begin(), seen.end(), 0);
+    for (int p = 0; p < n_pos; p++) {
+      int idx = layouts(r, p);
+      if (idx == NA_INTEGER || idx < 1 || idx > n_pos || seen[idx - 1]) {
+        stop("row " + std::to_string(r + 1) + " of layouts is not a permutation of 1.." +
+             std::to_string(n_pos));
+      }
+      seen[idx - 1] = 1;
+      syms[p] = key_syms.keys[idx - 1];
+    }
+    out[r] = KeyboardLayout(syms);
+  }
+  return out;
+}
+
+// Score many layouts of the same keys in one call. Row r of `layouts`
+// holds, for each position, the 1-based index into `keys` of the key
+// placed there. Returns efforts plus rule penalties (the optimizers'
+// objective), or a data frame of components.
+// [[Rcpp::export]]
+SEXP corpus_effort_batch(
+    SEXP corpus,
+    IntegerMatrix layouts,
+    CharacterVector keys,
+    SEXP geometry,
+    List rules,
+    bool breakdown = false,
+    int n_threads = 1
+) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  const Geometry& g = kg.geometry;
+
+  // Validate and convert every row up front; the scoring loop below is
+  // pure C++ and runs in parallel
+  std::vector<KeyboardLayout> batch = layouts_from_indices(cs, layouts, keys, g.n);
+  int n_layouts = batch.size();
+  RuleSet rs = rules_from_list(rules, LogicalVector(g.n), cs);
+  bool penalized = rs.has_penalties();
+
+  // Totals come straight from the weighted tables; components only when
+  // they are asked for
+  std::vector<double> totals(n_layouts);
+  std::vector<double> penalties(n_layouts, 0.0);
+  std::vector<EffortComponents> parts(breakdown ? n_layouts : 0);
+  int threads = resolve_threads(n_threads);
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+  for (int r = 0; r < n_layouts; r++) {
+    std::vector<int> pos_of_sym;
+    batch[r].positions(cs.size(), pos_of_sym);
+    if (breakdown) {
+      parts[r] = corpus_components(cs, g, pos_of_sym);
+      totals[r] = parts[r].total(kg.costs.weights);
+    } else {
+      totals[r] = corpus_effort(cs, kg.costs, pos_of_sym);
+    }
+    if (penalized) penalties[r] = rule_penalty(pos_of_sym, rs, g, cs);
+  }
+
+  if (!breakdown) {
+    for (int r = 0; r < n_layouts; r++) {
+      totals[r] += penalties[r];
+    }
+    return wrap(totals);
+  }
+  NumericVector total = wrap(totals);
+
+  NumericVector base(n_layouts), sf(n_layouts), sh(n_layouts), rc(n_layouts), tri(n_layouts);
+  NumericVector layer(n_layouts);
+  NumericVector sf_n(n_layouts), sh_n(n_layouts), alt_n(n_layouts), tri_n(n_layouts);
+  NumericVector layer_n(n_layouts);
+  for (int r = 0; r < n_layouts; r++) {
+    base[r] = parts[r].base;
+    sf[r] = parts[r].same_finger;
+    sh[r] = parts[r].same_hand;
+    rc[r] = parts[r].row_change;
+    tri[r] = parts[r].trigram;
+    layer[r] = parts[r].layer;
+    sf_n[r] = parts[r].same_finger_bigrams;
+    sh_n[r] = parts[r].same_hand_bigrams;
+    alt_n[r] = parts[r].hand_alternations;
+    tri_n[r] = parts[r].same_hand_trigrams;
+    layer_n[r] = parts[r].layer_switches;
+  }
+  DataFrame out = DataFrame::create(
+    Named("base_effort") = base,
+    Named("same_finger_effort") = sf,
+    Named("same_hand_effort") = sh,
+    Named("row_change_effort") = rc,
+    Named("trigram_effort") = tri,
+    Named("layer_effort") = layer,
+    Named("total_effort") = total,
+    Named("same_finger_bigrams") = sf_n,
+    Named("same_hand_bigrams") = sh_n,
+    Named("hand_alternations") = alt_n,
+    Named("same_hand_trigrams") = tri_n,
+    Named("layer_switches") = layer_n
+  );
+  if (penalized) out.push_back(wrap(penalties), "rule_penalty");
+  return out;
+}
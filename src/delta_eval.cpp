@@ -0,0 +1,171 @@
+// delta_eval.cpp
+// Incremental evaluation of key swaps
+// Swapping positions i and j only changes the terms that involve the two
+// keys sitting there, so the effort change can be computed without
+// rescoring the whole layout.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// SWAP DELTA
+// -----------------------------------------------------------------
+
+SwapDelta::SwapDelta(const CorpusStats& corpus, const CostTables& costs)
+  : corpus_(&corpus), costs_(&costs), effort_(0.0) {
+  tri_by_sym_.resize(corpus.size());
+  for (size_t t = 0; t < corpus.trigrams.size(); t++) {
+    const Trigram& tri = corpus.trigrams[t];
+    tri_by_sym_[tri.a].push_back(tri);
+    if (tri.b != tri.a) tri_by_sym_[tri.b].push_back(tri);
+    if (tri.c != tri.a && tri.c != tri.b) tri_by_sym_[tri.c].push_back(tri);
+  }
+}
+
+void SwapDelta::reset(const KeyboardLayout& layout) {
+  layout_ = layout;
+  layout_.positions(corpus_->size(), pos_of_sym_);
+  effort_ = corpus_effort(*corpus_, *costs_, pos_of_sym_);
+}
+
+void SwapDelta::restore(const KeyboardLayout& layout, double effort) {
+  layout_ = layout;
+  layout_.positions(corpus_->size(), pos_of_sym_);
+  effort_ = effort;
+}
+
+double SwapDelta::delta(int i, int j) const {
+  if (i == j) return 0.0;
+  const CorpusStats& cs = *corpus_;
+  const CostTables& ct = *costs_;
+  const std::vector<int>& pos = pos_of_sym_;
+  int k = cs.size();
+  int n = ct.n;
+  const double* cost = ct.pair.data();
+  const double* tri_cost = ct.finger_tri.data();
+  const int* finger = ct.finger.data();
+  int u = layout_.keys[i];
+  int v = layout_.keys[j];
+
+  // Position of a symbol after the swap
+  auto moved = [&](int s) { return s == u ? j : (s == v ? i : pos[s]); };
+
+  // Base effort: only u and v change position
+  double d = cs.base_scale() * (cs.unigram[u] - cs.unigram[v]) * (ct.base[j] - ct.base[i]);
+
+  // Bigrams with u or v on either side. (u,x) and (v,x) cover every pair
+  // whose first symbol moves; (x,u) and (x,v) add the rest.
+  auto bigram_term = [&](int a, int b) {
+    double count = cs.bigram[a * k + b];
+    if (count == 0.0) return 0.0;
+    int pa = pos[a];
+    int pb = pos[b];
+    if (pa < 0 || pb < 0) return 0.0;
+    return count * (cost[moved(a) * n + moved(b)] - cost[pa * n + pb]);
+  };
+  for (int x = 0; x < k; x++) {
+    d += bigram_term(u, x) + bigram_term(v, x);
+    if (x != u && x != v) {
+      d += bigram_term(x, u) + bigram_term(x, v);
+    }
+  }
+
+  // Trigrams touching u, then those touching v but not u
+  auto trigram_term = [&](const Trigram& t) {
+    int p0 = pos[t.a];
+    int p1 = pos[t.b];
+    int p2 = pos[t.c];
+    if (p0 < 0 || p1 < 0 || p2 < 0) return 0.0;
+    int q0 = moved(t.a);
+    int q1 = moved(t.b);
+    int q2 = moved(t.c);
+    return t.count * (tri_cost[(finger[q0] * 10 + finger[q1]) * 10 + finger[q2]] -
+                      tri_cost[(finger[p0] * 10 + finger[p1]) * 10 + finger[p2]]);
+  };
+  const std::vector<Trigram>& tu = tri_by_sym_[u];
+  for (size_t m = 0; m < tu.size(); m++) {
+    d += trigram_term(tu[m]);
+  }
+  const std::vector<Trigram>& tv = tri_by_sym_[v];
+  for (size_t m = 0; m < tv.size(); m++) {
+    const Trigram& t = tv[m];
+    if (t.a == u || t.b == u || t.c == u) continue;
+    d += trigram_term(t);
+  }
+
+  return d;
+}
+
+void SwapDelta::apply(int i, int j) {
+  if (i == j) return;
+  effort_ += delta(i, j);
+  int u = layout_.keys[i];
+  int v = layout_.keys[j];
+  layout_.swap_keys(i, j);
+  pos_of_sym_[u] = j;
+  pos_of_sym_[v] = i;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Effort change for swapping layout positions i[n] and j[n] (1-based).
+// With verify = TRUE every delta is checked against a full recompute.
+// [[Rcpp::export]]
+NumericVector corpus_swap_delta(
+    SEXP corpus,
+    CharacterVector layout,
+    SEXP geometry,
+    IntegerVector i,
+    IntegerVector j,
+    bool verify = false,
+    int n_threads = 1
+) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  KeyboardLayout base = layout_from_labels(cs, layout);
+  if (base.n_keys != kg.geometry.n) stop("layout must have one key per geometry position");
+  std::vector<int> from = Rcpp::as<std::vector<int>>(i);
+  std::vector<int> to = Rcpp::as<std::vector<int>>(j);
+  if (from.size() != to.size()) stop("i and j must have the same length");
+  for (size_t n = 0; n < from.size(); n++) {
+    if (from[n] < 1 || to[n] < 1 || from[n] > base.n_keys || to[n] > base.n_keys) {
+      stop("swap positions must be between 1 and the number of keys");
+    }
+  }
+
+  SwapDelta sd(cs, kg.costs);
+  sd.reset(base);
+
+  int n_pairs = from.size();
+  std::vector<double> deltas(n_pairs);
+  int threads = resolve_threads(n_threads);
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(threads) schedule(static) if (threads > 1)
+#endif
+  for (int n = 0; n < n_pairs; n++) {
+    deltas[n] = sd.delta(from[n] - 1, to[n] - 1);
+  }
+
+  if (verify) {
+    std::vector<int> pos_of_sym;
+    double tol = 1e-9 * std::max(1.0, std::abs(sd.effort()));
+    for (int n = 0; n < n_pairs; n++) {
+      base.with_swap(from[n] - 1, to[n] - 1).positions(cs.size(), pos_of_sym);
+      double full = corpus_effort(cs, kg.costs, pos_of_sym) - sd.effort();
+      if (std::abs(full - deltas[n]) > tol) {
+        stop("swap delta mismatch for positions " + std::to_string(from[n]) + " and " +
+             std::to_string(to[n]) + ": incremental " + std::to_string(deltas[n]) +
+             ", full recompute " + std::to_string(full));
+      }
+    }
+  }
+  return wrap(deltas);
+}
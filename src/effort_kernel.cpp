@@ -0,0 +1,219 @@
+// effort_kernel.cpp
+// Vectorized scoring of a layout from compiled corpus counts
+// corpus_effort() is a gather-multiply-accumulate: every bigram count is
+// multiplied by the pair cost of its two positions and every trigram count
+// by the cost of its finger triple. The AVX2 kernel does four of them at a
+// time. The scalar kernel accumulates in the same four lanes and reduces
+// them in the same order, so both return bit-identical efforts and a run
+// gives the same layout whichever kernel the CPU selects.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <vector>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+// Windows toolchains do not align the stack for 32-byte AVX spills
+#define LBK_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+
+using namespace Rcpp;
+
+static const int LANES = 4;
+
+namespace {
+
+// Per-layout inputs of the kernels. Symbols that are not on the layout
+// sit at the zero-cost position n and finger 10 of the padded cost tables,
+// so the kernels never branch on them; positions are padded the same way
+// to a whole number of vectors.
+struct KernelInput {
+  std::vector<int> pos;     // padded position per symbol
+  std::vector<int> finger;  // padded finger per symbol
+  int k;
+  int n;
+
+  KernelInput(const CorpusStats& corpus, const CostTables& costs,
+              const std::vector<int>& pos_of_sym)
+    : k(corpus.size()), n(costs.n) {
+    pos.assign((k + LANES - 1) / LANES * LANES, n);
+    finger.assign(k, 10);
+    for (int s = 0; s < k; s++) {
+      int p = pos_of_sym[s];
+      if (p < 0) continue;
+      pos[s] = p;
+      finger[s] = costs.finger[p];
+    }
+  }
+
+  int triple(const Trigram& t) const {
+    return (finger[t.a] * 11 + finger[t.b]) * 11 + finger[t.c];
+  }
+};
+
+double base_effort(const CorpusStats& corpus, const CostTables& costs,
+                   const KernelInput& in) {
+  double base = 0.0;
+  for (int s = 0; s < in.k; s++) {
+    int p = in.pos[s];
+    if (p < in.n) base += corpus.unigram[s] * costs.base[p];
+  }
+  return base * corpus.base_scale();
+}
+
+double reduce_lanes(const double* lane) {
+  return (lane[0] + lane[1]) + (lane[2] + lane[3]);
+}
+
+// Lane l accumulates bigram columns b with b % 4 == l and trigrams i with
+// i % 4 == l, in increasing order
+double scalar_ngram_effort(const CorpusStats& corpus, const CostTables& costs,
+                           const KernelInput& in) {
+  int k = in.k;
+  double bigram[LANES] = {0.0, 0.0, 0.0, 0.0};
+  for (int a = 0; a < k; a++) {
+    int pa = in.pos[a];
+    if (pa == in.n) continue;
+    const double* row = &corpus.bigram[a * k];
+    const double* cost = &costs.pair_padded[pa * (in.n + 1)];
+    for (int b = 0; b < k; b++) {
+      bigram[b & 3] += row[b] * cost[in.pos[b]];
+    }
+  }
+
+  double trigram[LANES] = {0.0, 0.0, 0.0, 0.0};
+  const std::vector<Trigram>& tri = corpus.trigrams;
+  for (size_t i = 0; i < tri.size(); i++) {
+    trigram[i & 3] += tri[i].count * costs.finger_tri_padded[in.triple(tri[i])];
+  }
+
+  return reduce_lanes(bigram) + reduce_lanes(trigram);
+}
+
+#ifdef LBK_AVX2_KERNEL
+
+// Same lanes as the scalar kernel. Multiplies and adds are kept separate,
+// never fused, so the sums match it bit for bit. Trigram costs are loaded
+// one by one: gathering their nested indices measured slower than scalar
+// loads.
+__attribute__((target("avx2")))
+double avx2_ngram_effort(const CorpusStats& corpus, const CostTables& costs,
+                         const KernelInput& in) {
+  int k = in.k;
+  int k_vec = k / LANES * LANES;
+  double lanes[LANES];
+  double counts[LANES];
+
+  __m256d bigram = _mm256_setzero_pd();
+  for (int a = 0; a < k; a++) {
+    int pa = in.pos[a];
+    if (pa == in.n) continue;
+    const double* row = &corpus.bigram[a * k];
+    const double* cost = &costs.pair_padded[pa * (in.n + 1)];
+    for (int b = 0; b < k_vec; b += LANES) {
+      __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in.pos[b]));
+      __m256d c = _mm256_i32gather_pd(cost, pb, 8);
+      bigram = _mm256_add_pd(bigram, _mm256_mul_pd(_mm256_loadu_pd(row + b), c));
+    }
+    if (k_vec < k) {
+      for (int j = 0; j < LANES; j++) {
+        int b = k_vec + j;
+        counts[j] = b < k ? row[b] : 0.0;
+        lanes[j] = cost[in.pos[b]];
+      }
+      bigram = _mm256_add_pd(bigram, _mm256_mul_pd(_mm256_loadu_pd(counts),
+                                                   _mm256_loadu_pd(lanes)));
+    }
+  }
+
+  const std::vector<Trigram>& tri = corpus.trigrams;
+  const double* tri_cost = &costs.finger_tri_padded[0];
+  size_t n_vec = tri.size() / LANES * LANES;
+  __m256d trigram = _mm256_setzero_pd();
+  for (size_t i = 0; i < n_vec; i += LANES) {
+    __m256d c = _mm256_setr_pd(tri_cost[in.triple(tri[i])], tri_cost[in.triple(tri[i + 1])],
+                               tri_cost[in.triple(tri[i + 2])], tri_cost[in.triple(tri[i + 3])]);
+    __m256d count = _mm256_setr_pd(tri[i].count, tri[i + 1].count,
+                                   tri[i + 2].count, tri[i + 3].count);
+    trigram = _mm256_add_pd(trigram, _mm256_mul_pd(count, c));
+  }
+
+  double bigram_lanes[LANES];
+  double trigram_lanes[LANES];
+  _mm256_storeu_pd(bigram_lanes, bigram);
+  _mm256_storeu_pd(trigram_lanes, trigram);
+  for (size_t i = n_vec; i < tri.size(); i++) {
+    trigram_lanes[i & 3] += tri[i].count * tri_cost[in.triple(tri[i])];
+  }
+
+  return reduce_lanes(bigram_lanes) + reduce_lanes(trigram_lanes);
+}
+
+bool cpu_has_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool cpu_has_avx2() { return false; }
+
+#endif
+
+// Set once at load time and only changed from R, never during a run
+EffortKernel active_kernel = cpu_has_avx2() ? KERNEL_AVX2 : KERNEL_SCALAR;
+
+}  // namespace
+
+// -----------------------------------------------------------------
+// KERNEL DISPATCH
+// -----------------------------------------------------------------
+
+bool effort_kernel_supported(EffortKernel kernel) {
+  return kernel == KERNEL_SCALAR || cpu_has_avx2();
+}
+
+EffortKernel effort_kernel() {
+  return active_kernel;
+}
+
+void set_effort_kernel(EffortKernel kernel) {
+  if (!effort_kernel_supported(kernel)) stop("this CPU does not support the AVX2 kernel");
+  active_kernel = kernel;
+}
+
+// Sum of counts times per-position costs. Equivalent to calculate_effort()
+// on the same text when char_freq comes from letter_freq().
+double corpus_effort(
+    const CorpusStats& corpus,
+    const CostTables& costs,
+    const std::vector<int>& pos_of_sym
+) {
+  KernelInput in(corpus, costs, pos_of_sym);
+  double total = base_effort(corpus, costs, in);
+#ifdef LBK_AVX2_KERNEL
+  if (active_kernel == KERNEL_AVX2) return total + avx2_ngram_effort(corpus, costs, in);
+#endif
+  return total + scalar_ngram_effort(corpus, costs, in);
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Name of the kernel behind corpus_effort(); a non-empty `kernel`
+// ("auto", "avx2" or "scalar") selects it first
+// [[Rcpp::export]]
+std::string effort_kernel_select(std::string kernel = "") {
+  if (kernel == "auto") {
+    set_effort_kernel(cpu_has_avx2() ? KERNEL_AVX2 : KERNEL_SCALAR);
+  } else if (kernel == "avx2") {
+    set_effort_kernel(KERNEL_AVX2);
+  } else if (kernel == "scalar") {
+    set_effort_kernel(KERNEL_SCALAR);
+  } else if (!kernel.empty()) {
+    stop("kernel must be \"auto\", \"avx2\" or \"scalar\"");
+  }
+  return active_kernel == KERNEL_AVX2 ? "avx2" : "scalar";
+}
@@ -0,0 +1,252 @@
+// effort_tracker.cpp
+// Incremental effort of a fixed set of layouts on a growing corpus
+// Effort is linear in the n-gram counts, up to the length scaling of the
+// base term, so when a batch of text is appended to or removed from a
+// corpus the effort of every tracked layout changes by the effort of the
+// changed counts alone. Only the n-grams the batch touches are scored.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// COMPONENTS OF A CHANGE IN COUNTS
+// -----------------------------------------------------------------
+
+namespace {
+
+// Same classification as corpus_components(), over sparse counts. The
+// base term is left unscaled, since the scale depends on the whole text.
+EffortComponents delta_components(
+    const CorpusDelta& d,
+    const Geometry& g,
+    const std::vector<int>& pos_of_sym
+) {
+  int k = d.unigram.size();
+  EffortComponents c = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+  for (int s = 0; s < k; s++) {
+    int p = pos_of_sym[s];
+    if (p >= 0) c.base += d.unigram[s] * g.base_cost[p];
+  }
+
+  for (size_t i = 0; i < d.bigram.size(); i++) {
+    int p = pos_of_sym[d.bigram[i].first / k];
+    int q = pos_of_sym[d.bigram[i].first % k];
+    if (p < 0 || q < 0) continue;
+    double count = d.bigram[i].second;
+    int pq = g.pair(p, q);
+    if (g.layer_cost[pq] > 0.0) {
+      c.layer_switches += count;
+      c.layer += count * g.layer_cost[pq];
+    }
+    switch (g.pair_class[pq]) {
+      case PAIR_SAME_FINGER:
+        c.same_finger_bigrams += count;
+        c.same_finger += count * g.same_finger_cost[pq];
+        break;
+      case PAIR_SAME_HAND:
+        c.same_hand_bigrams += count;
+        c.same_hand += count * g.same_hand_cost[pq];
+        c.row_change += count * g.row_change_cost[pq];
+        break;
+      default:
+        c.hand_alternations += count;
+    }
+  }
+
+  for (size_t i = 0; i < d.trigrams.size(); i++) {
+    const Trigram& t = d.trigrams[i];
+    int p0 = pos_of_sym[t.a];
+    int p1 = pos_of_sym[t.b];
+    int p2 = pos_of_sym[t.c];
+    if (p0 < 0 || p1 < 0 || p2 < 0 || !g.same_hand(p0, p1, p2)) continue;
+    c.same_hand_trigrams += t.count;
+    c.trigram += t.count * g.finger_tri_cost[g.finger_triple(p0, p1, p2)];
+  }
+
+  return c;
+}
+
+// The whole corpus as a change from an empty one
+CorpusDelta corpus_as_delta(const CorpusStats& cs) {
+  CorpusDelta d;
+  d.unigram = cs.unigram;
+  for (size_t i = 0; i < cs.bigram.size(); i++) {
+    if (cs.bigram[i] == 0.0) continue;
+    d.bigram.push_back(std::make_pair(static_cast<int>(i), cs.bigram[i]));
+  }
+  d.trigrams = cs.trigrams;
+  d.n_chars = cs.n_chars;
+  d.n_alpha = cs.n_alpha;
+  return d;
+}
+
+void add_components(EffortComponents& to, const EffortComponents& c) {
+  to.base += c.base;
+  to.same_finger += c.same_finger;
+  to.same_hand += c.same_hand;
+  to.row_change += c.row_change;
+  to.trigram += c.trigram;
+  to.layer += c.layer;
+  to.same_finger_bigrams += c.same_finger_bigrams;
+  to.same_hand_bigrams += c.same_hand_bigrams;
+  to.hand_alternations += c.hand_alternations;
+  to.same_hand_trigrams += c.same_hand_trigrams;
+  to.layer_switches += c.layer_switches;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------
+// EFFORT TRACKER
+// -----------------------------------------------------------------
+
+// Running effort components of fixed layouts on one corpus. The tracker
+// is bound to the corpus and its revision, so scores are never reported
+// for counts they were not updated with.
+struct EffortTracker {
+  KeyboardGeometry geometry;
+  const CorpusStats* corpus;   // identity only; the R object keeps it alive
+  uint64_t revision;
+  double n_chars;
+  double n_alpha;
+  std::vector<std::vector<int> > positions;  // pos_of_sym per layout
+  std::vector<EffortComponents> parts;       // base term unscaled
+
+  EffortTracker(const KeyboardGeometry& kg, const CorpusStats& cs,
+                const std::vector<KeyboardLayout>& layouts)
+    : geometry(kg), corpus(&cs), revision(cs.revision), n_chars(0.0), n_alpha(0.0),
+      positions(layouts.size()),
+      parts(layouts.size(), EffortComponents{0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0}) {
+    for (size_t r = 0; r < layouts.size(); r++) {
+      layouts[r].positions(cs.size(), positions[r]);
+    }
+    apply(corpus_as_delta(cs));
+  }
+
+  void apply(const CorpusDelta& d) {
+    for (size_t r = 0; r < parts.size(); r++) {
+      add_components(parts[r], delta_components(d, geometry.geometry, positions[r]));
+    }
+    n_chars += d.n_chars;
+    n_alpha += d.n_alpha;
+    revision = corpus->revision;
+  }
+
+  EffortComponents components(size_t r) const {
+    EffortComponents c = parts[r];
+    c.base *= n_alpha > 0.0 ? n_chars / n_alpha : 0.0;
+    return c;
+  }
+};
+
+static EffortTracker& tracker_ref(SEXP tracker) {
+  XPtr<EffortTracker> ptr(tracker);
+  if (ptr.get() == NULL) {
+    stop("tracker pointer is invalid (effort trackers cannot be saved with saveRDS)");
+  }
+  return *ptr;
+}
+
+// Trackers to update with a change to `cs`, checked before anything changes
+static std::vector<EffortTracker*> trackers_for(const CorpusStats& cs, List trackers) {
+  std::vector<EffortTracker*> out;
+  for (int i = 0; i < trackers.size(); i++) {
+    EffortTracker& t = tracker_ref(trackers[i]);
+    if (t.corpus != &cs) stop("tracker " + std::to_string(i + 1) + " belongs to another corpus");
+    if (t.revision != cs.revision) {
+      stop("tracker " + std::to_string(i + 1) + " missed an earlier update of the corpus");
+    }
+    out.push_back(&t);
+  }
+  return out;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Append text samples to a compiled corpus in place, updating `trackers`
+// [[Rcpp::export]]
+void corpus_append(SEXP corpus, CharacterVector text_samples, List trackers) {
+  CorpusStats& cs = corpus_ref(corpus);
+  std::vector<EffortTracker*> tracked = trackers_for(cs, trackers);
+  CorpusDelta delta = append_corpus_text(cs, Rcpp::as<std::vector<std::string>>(text_samples));
+  for (size_t i = 0; i < tracked.size(); i++) tracked[i]->apply(delta);
+}
+
+// Remove the oldest batch of a compiled corpus in place, updating `trackers`
+// [[Rcpp::export]]
+void corpus_remove(SEXP corpus, CharacterVector text_samples, List trackers) {
+  CorpusStats& cs = corpus_ref(corpus);
+  std::vector<EffortTracker*> tracked = trackers_for(cs, trackers);
+  CorpusDelta delta = remove_corpus_text(cs, Rcpp::as<std::vector<std::string>>(text_samples));
+  for (size_t i = 0; i < tracked.size(); i++) tracked[i]->apply(delta);
+}
+
+// Number of text batches and characters in each, oldest first
+// [[Rcpp::export]]
+NumericVector corpus_batches(SEXP corpus) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  NumericVector n_chars(cs.batches.size());
+  for (size_t i = 0; i < cs.batches.size(); i++) n_chars[i] = cs.batches[i].n_chars;
+  return n_chars;
+}
+
+// Track the effort of layouts given as in corpus_effort_batch()
+// [[Rcpp::export]]
+SEXP tracker_create(SEXP corpus, IntegerMatrix layouts, CharacterVector keys, SEXP geometry) {
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  std::vector<KeyboardLayout> batch = layouts_from_indices(cs, layouts, keys, kg.geometry.n);
+  return XPtr<EffortTracker>(new EffortTracker(kg, cs, batch), true);
+}
+
+// Current effort of every tracked layout, or a data frame of components
+// [[Rcpp::export]]
+SEXP tracker_effort(SEXP tracker, SEXP corpus, bool breakdown = false) {
+  const EffortTracker& t = tracker_ref(tracker);
+  const CorpusStats& cs = corpus_ref(corpus);
+  if (t.corpus != &cs || t.revision != cs.revision) {
+    stop("the corpus was updated without this tracker; create a new tracker");
+  }
+
+  int n = t.parts.size();
+  NumericVector total(n), base(n), sf(n), sh(n), rc(n), tri(n), layer(n);
+  NumericVector sf_n(n), sh_n(n), alt_n(n), tri_n(n), layer_n(n);
+  for (int r = 0; r < n; r++) {
+    EffortComponents c = t.components(r);
+    total[r] = c.total(t.geometry.costs.weights);
+    base[r] = c.base;
+    sf[r] = c.same_finger;
+    sh[r] = c.same_hand;
+    rc[r] = c.row_change;
+    tri[r] = c.trigram;
+    layer[r] = c.layer;
+    sf_n[r] = c.same_finger_bigrams;
+    sh_n[r] = c.same_hand_bigrams;
+    alt_n[r] = c.hand_alternations;
+    tri_n[r] = c.same_hand_trigrams;
+    layer_n[r] = c.layer_switches;
+  }
+  if (!breakdown) return total;
+
+  return DataFrame::create(
+    Named("base_effort") = base,
+    Named("same_finger_effort") = sf,
+    Named("same_hand_effort") = sh,
+    Named("row_change_effort") = rc,
+    Named("trigram_effort") = tri,
+    Named("layer_effort") = layer,
+    Named("total_effort") = total,
+    Named("same_finger_bigrams") = sf_n,
+    Named("same_hand_bigrams") = sh_n,
+    Named("hand_alternations") = alt_n,
+    Named("same_hand_trigrams") = tri_n,
+    Named("layer_switches") = layer_n
+  );
+}
@@ -0,0 +1,146 @@
+// fitness_cache.cpp
+// Memoized layout scores for the genetic algorithm
+// Elites, unmutated copies and crossovers of near-identical parents make
+// many offspring repeat layouts already scored; the cache returns their
+// score without another pass over the corpus.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <vector>
+
+using namespace Rcpp;
+
+static const size_t CACHE_SHARDS = 16;
+
+FitnessCache::FitnessCache(size_t capacity, bool lru)
+  : capacity_(capacity), lru_(lru),
+    shards_(capacity < 64 * CACHE_SHARDS ? 1 : CACHE_SHARDS),
+    hits_(0.0), misses_(0.0), evictions_(0.0) {
+  shard_capacity_ = std::max<size_t>(1, capacity / shards_.size());
+#ifdef _OPENMP
+  for (size_t s = 0; s < shards_.size(); s++) omp_init_lock(&shards_[s].lock);
+#endif
+}
+
+FitnessCache::~FitnessCache() {
+#ifdef _OPENMP
+  for (size_t s = 0; s < shards_.size(); s++) omp_destroy_lock(&shards_[s].lock);
+#endif
+}
+
+size_t FitnessCache::size() const {
+  size_t n = 0;
+  for (size_t s = 0; s < shards_.size(); s++) n += shards_[s].entries.size();
+  return n;
+}
+
+uint64_t FitnessCache::hash(const Key& key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < key.size(); i++) {
+    h ^= key[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+bool FitnessCache::lookup(const Key& key, uint64_t h, double& score) {
+  Shard& shard = shard_of(h);
+  bool found = false;
+#ifdef _OPENMP
+  omp_set_lock(&shard.lock);
+#endif
+  std::unordered_map<uint64_t, Entry>::iterator it = shard.entries.find(h);
+  if (it != shard.entries.end() && it->second.key == key) {
+    score = it->second.score;
+    if (lru_) shard.order.splice(shard.order.begin(), shard.order, it->second.age);
+    found = true;
+  }
+#ifdef _OPENMP
+  omp_unset_lock(&shard.lock);
+#endif
+  return found;
+}
+
+// A layout whose hash collides with a cached one replaces it
+void FitnessCache::insert(const Key& key, uint64_t h, double score) {
+  Shard& shard = shard_of(h);
+  double evicted = 0.0;
+#ifdef _OPENMP
+  omp_set_lock(&shard.lock);
+#endif
+  std::unordered_map<uint64_t, Entry>::iterator it = shard.entries.find(h);
+  if (it != shard.entries.end()) {
+    it->second.key = key;
+    it->second.score = score;
+    shard.order.splice(shard.order.begin(), shard.order, it->second.age);
+  } else {
+    if (shard.entries.size() >= shard_capacity_) {
+      shard.entries.erase(shard.order.back());
+      shard.order.pop_back();
+      evicted = 1.0;
+    }
+    shard.order.push_front(h);
+    Entry entry = {key, score, shard.order.begin()};
+    shard.entries.insert(std::make_pair(h, entry));
+  }
+#ifdef _OPENMP
+  omp_unset_lock(&shard.lock);
+  #pragma omp atomic
+#endif
+  evictions_ += evicted;
+}
+
+void FitnessCache::evaluate(const Objective& objective,
+                            const std::vector<KeyboardLayout>& layouts,
+                            std::vector<double>& scores, int from, int n_threads) {
+  int n = layouts.size();
+  if (from >= n) return;
+  std::vector<Key> keys(n);
+  std::vector<uint64_t> hashes(n);
+  std::vector<int> copy_of(n, -1);   // earlier layout of the batch it repeats
+  std::vector<int> todo;             // distinct layouts to score
+  std::unordered_map<uint64_t, int> first;
+  double hits = 0.0;
+
+  for (int i = from; i < n; i++) {
+    keys[i].assign(layouts[i].keys.begin(), layouts[i].keys.end());
+    hashes[i] = hash(keys[i]);
+    if (lookup(keys[i], hashes[i], scores[i])) {
+      hits += 1.0;
+      continue;
+    }
+    std::unordered_map<uint64_t, int>::iterator it = first.find(hashes[i]);
+    if (it != first.end() && keys[it->second] == keys[i]) {
+      copy_of[i] = it->second;
+      hits += 1.0;
+      continue;
+    }
+    first[hashes[i]] = i;
+    todo.push_back(i);
+  }
+
+  int m = todo.size();
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(n_threads) schedule(static) if (n_threads > 1)
+#endif
+  for (int t = 0; t < m; t++) {
+    scores[todo[t]] = objective(layouts[todo[t]]);
+  }
+
+  for (int t = 0; t < m; t++) {
+    insert(keys[todo[t]], hashes[todo[t]], scores[todo[t]]);
+  }
+  for (int i = from; i < n; i++) {
+    if (copy_of[i] >= 0) scores[i] = scores[copy_of[i]];
+  }
+
+#ifdef _OPENMP
+  #pragma omp atomic
+#endif
+  hits_ += hits;
+#ifdef _OPENMP
+  #pragma omp atomic
+#endif
+  misses_ += m;
+}
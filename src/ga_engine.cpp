@@ -0,0 +1,1162 @@
+// ga_engine.cpp
+// Native permutation genetic algorithm for keyboard layout optimization
+// Individuals are KeyboardLayout permutations; fixed positions are never
+// touched by the operators, and hard rule constraints are enforced by
+// repairing each offspring in place.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// SEARCH OPERATORS
+// -----------------------------------------------------------------
+
+KeyboardLayout shuffle_free(const KeyboardLayout& layout, const std::vector<int>& free,
+                            std::mt19937& rng) {
+  std::vector<int> genes(free.size());
+  for (size_t i = 0; i < free.size(); i++) genes[i] = layout.keys[free[i]];
+  std::shuffle(genes.begin(), genes.end(), rng);
+
+  KeyboardLayout out = layout;
+  for (size_t i = 0; i < free.size(); i++) out.keys[free[i]] = genes[i];
+  return out;
+}
+
+void swap_mutation(KeyboardLayout& layout, const std::vector<int>& free, std::mt19937& rng) {
+  int m = free.size();
+  if (m < 2) return;
+  std::uniform_int_distribution<int> pick(0, m - 1);
+  int i = pick(rng);
+  int j = pick(rng);
+  while (j == i) j = pick(rng);
+  layout.swap_keys(free[i], free[j]);
+}
+
+// Random segment [lo, hi] of the free-position sequence
+static void random_segment(int m, std::mt19937& rng, int& lo, int& hi) {
+  std::uniform_int_distribution<int> pick(0, m - 1);
+  lo = pick(rng);
+  hi = pick(rng);
+  if (lo > hi) std::swap(lo, hi);
+}
+
+static int max_symbol(const KeyboardLayout& layout) {
+  return *std::max_element(layout.keys.begin(), layout.keys.end());
+}
+
+KeyboardLayout order_crossover(const KeyboardLayout& p1, const KeyboardLayout& p2,
+                               const std::vector<int>& free, std::mt19937& rng) {
+  KeyboardLayout child = p1;
+  int m = free.size();
+  if (m < 2) return child;
+
+  int lo, hi;
+  random_segment(m, rng, lo, hi);
+
+  // Keep p1's segment, fill the rest in p2's order starting after the segment
+  std::vector<char> used(max_symbol(p1) + 1, 0);
+  for (int i = lo; i <= hi; i++) used[p1.keys[free[i]]] = 1;
+
+  int out = (hi + 1) % m;
+  for (int step = 0; step < m; step++) {
+    int sym = p2.keys[free[(hi + 1 + step) % m]];
+    if (used[sym]) continue;
+    child.keys[free[out]] = sym;
+    used[sym] = 1;
+    out = (out + 1) % m;
+  }
+  return child;
+}
+
+KeyboardLayout pmx_crossover(const KeyboardLayout& p1, const KeyboardLayout& p2,
+                             const std::vector<int>& free, std::mt19937& rng) {
+  KeyboardLayout child = p1;
+  int m = free.size();
+  if (m < 2) return child;
+
+  int lo, hi;
+  random_segment(m, rng, lo, hi);
+
+  // Take p2's segment; each displaced key follows the mapping by swapping
+  // into the slot the incoming key came from
+  for (int i = lo; i <= hi; i++) {
+    int pos = free[i];
+    int sym = p2.keys[pos];
+    if (child.keys[pos] == sym) continue;
+    int from = child.find_key(sym);
+    child.swap_keys(pos, from);
+  }
+  return child;
+}
+
+// -----------------------------------------------------------------
+// TELEMETRY
+// -----------------------------------------------------------------
+
+double Telemetry::total_evaluations() const {
+  return std::accumulate(evaluations.begin(), evaluations.end(), initial_evaluations);
+}
+
+List telemetry_list(const Telemetry& t, double seconds, const std::string& stop_reason,
+                    const FitnessCache* cache) {
+  double total = t.total_evaluations();
+  int n = t.evaluations.size();
+  NumericVector diversity(n, NA_REAL);
+  NumericVector acceptance(n, NA_REAL);
+  for (int g = 0; g < n; g++) {
+    if (g < static_cast<int>(t.diversity.size())) diversity[g] = t.diversity[g];
+    if (g < static_cast<int>(t.acceptance.size())) acceptance[g] = t.acceptance[g];
+  }
+  NumericVector cache_stats;
+  SEXP fitness_cache = R_NilValue;
+  if (cache != NULL) {
+    cache_stats = NumericVector::create(
+      Named("hits") = cache->hits(),
+      Named("misses") = cache->misses(),
+      Named("evictions") = cache->evictions(),
+      Named("size") = static_cast<double>(cache->size()),
+      Named("capacity") = static_cast<double>(cache->capacity())
+    );
+    fitness_cache = cache_stats;
+  }
+  return List::create(
+    Named("evaluations") = total,
+    Named("seconds") = seconds,
+    Named("evaluations_per_sec") = seconds > 0.0 ? total / seconds : NA_REAL,
+    Named("phase_seconds") = NumericVector::create(
+      Named("scoring") = t.scoring_seconds,
+      Named("repair") = t.repair_seconds,
+      Named("variation") = t.variation_seconds
+    ),
+    Named("evaluations_per_generation") = wrap(t.evaluations),
+    Named("elapsed") = wrap(t.elapsed),
+    Named("diversity") = diversity,
+    Named("acceptance") = acceptance,
+    Named("stop_reason") = stop_reason,
+    Named("fitness_cache") = fitness_cache
+  );
+}
+
+bool ProgressCallback::report(const List& info) const {
+  Function fn(fn_);
+  SEXP res = fn(info);
+  return !(TYPEOF(res) == LGLSXP && Rf_length(res) == 1 && LOGICAL(res)[0] == 0);
+}
+
+List progress_info(int generation, double best, double mean, const Telemetry& t,
+                          double elapsed) {
+  double evaluations = t.total_evaluations();
+  return List::create(
+    Named("generation") = generation,
+    Named("best") = best,
+    Named("mean") = mean,
+    Named("evaluations") = evaluations,
+    Named("elapsed") = elapsed,
+    Named("evaluations_per_sec") = elapsed > 0.0 ? evaluations / elapsed : NA_REAL,
+    Named("diversity") = t.diversity.empty() ? NA_REAL : t.diversity.back()
+  );
+}
+
+// -----------------------------------------------------------------
+// RUN MONITORS
+// -----------------------------------------------------------------
+
+// Where a GA run reports after every generation. A run in the R session
+// calls the progress callback and checks for user interrupts; a
+// background job publishes a snapshot instead and never touches the R API.
+class RunMonitor {
+public:
+  virtual ~RunMonitor() {}
+  // After generation `generation` (1-based); false stops the run
+  virtual bool report(int generation, double best, double mean, const Telemetry& t,
+                      double elapsed) = 0;
+  // Best layout of the run so far, offered after every generation, or
+  // after every epoch of an island run
+  virtual void best_layout(const KeyboardLayout&, double) {}
+  // Why the run stopped when report() returned false
+  virtual std::string stop_reason() const = 0;
+  // Where a run may be interrupted from R
+  virtual void interruption_point() {}
+};
+
+class SessionMonitor : public RunMonitor {
+public:
+  explicit SessionMonitor(const ProgressCallback& progress) : progress_(progress) {}
+
+  bool report(int generation, double best, double mean, const Telemetry& t, double elapsed) {
+    return !progress_.due(generation) ||
+      progress_.report(progress_info(generation, best, mean, t, elapsed));
+  }
+  std::string stop_reason() const { return "callback"; }
+  void interruption_point() { Rcpp::checkUserInterrupt(); }
+
+private:
+  const ProgressCallback& progress_;
+};
+
+// -----------------------------------------------------------------
+// GENETIC ALGORITHM
+// -----------------------------------------------------------------
+
+struct GAConfig {
+  int population_size;
+  int generations;
+  double mutation_rate;
+  double crossover_rate;
+  int tournament_size;
+  int elite_count;
+  int patience;         // stop after this many generations without improvement
+  bool pmx;             // PMX instead of order crossover
+  int n_threads;        // threads for fitness evaluation
+};
+
+struct GAResult {
+  KeyboardLayout best;
+  double best_score;
+  std::vector<double> history_best;
+  std::vector<double> history_mean;
+  double evaluations;
+  Telemetry telemetry;
+  std::string stop_reason;  // "generations", "patience" or "callback"
+};
+
+static int tournament_select(const std::vector<double>& scores, int tournament_size,
+                             std::mt19937& rng) {
+  std::uniform_int_distribution<int> pick(0, scores.size() - 1);
+  int best = pick(rng);
+  for (int t = 1; t < tournament_size; t++) {
+    int c = pick(rng);
+    if (scores[c] < scores[best]) best = c;
+  }
+  return best;
+}
+
+// One evolving population with its own RNG stream, history and telemetry.
+// The single-population GA runs one; the island model runs several side
+// by side and moves individuals between them.
+class Population {
+public:
+  Population(const Objective& objective, const GAConfig& cfg, const std::vector<int>& free,
+             const std::mt19937& rng)
+    : obj_(objective), cfg_(cfg), free_(free), rng_(rng) {}
+
+  // The starting layout plus random rearrangements of it
+  void seed(const KeyboardLayout& initial) {
+    int n_pop = cfg_.population_size;
+    pop_.resize(n_pop);
+    scores_.resize(n_pop);
+    Stopwatch phase;
+    for (int i = 0; i < n_pop; i++) {
+      pop_[i] = (i == 0) ? initial : shuffle_free(initial, free_, rng_);
+    }
+    telemetry_.variation_seconds += phase.seconds();
+    phase.reset();
+    for (int i = 0; i < n_pop; i++) {
+      repair_layout(pop_[i], *obj_.rules, *obj_.geometry);
+    }
+    telemetry_.repair_seconds += phase.seconds();
+    phase.reset();
+    obj_.evaluate(pop_, scores_, 0, cfg_.n_threads);
+    telemetry_.scoring_seconds += phase.seconds();
+    telemetry_.initial_evaluations = n_pop;
+    next_.resize(n_pop);
+    next_scores_.resize(n_pop);
+    order_.resize(n_pop);
+  }
+
+  // Breed one generation and record its best and mean score, and the
+  // time on the run's `clock` when it was done
+  void step(const Stopwatch& clock) {
+    int n_pop = cfg_.population_size;
+    int elite = std::min(cfg_.elite_count, n_pop);
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    Stopwatch phase;
+    double repair_seconds = 0.0;
+    sort_order();
+
+    // Elitism: carry the best individuals over unchanged
+    for (int e = 0; e < elite; e++) {
+      next_[e] = pop_[order_[e]];
+      next_scores_[e] = scores_[order_[e]];
+    }
+
+    // Offspring are bred serially so the RNG stream (and the result for a
+    // given seed) does not depend on the number of threads
+    for (int i = elite; i < n_pop; i++) {
+      const KeyboardLayout& p1 = pop_[tournament_select(scores_, cfg_.tournament_size, rng_)];
+      if (unif(rng_) < cfg_.crossover_rate) {
+        const KeyboardLayout& p2 = pop_[tournament_select(scores_, cfg_.tournament_size, rng_)];
+        next_[i] = cfg_.pmx ? pmx_crossover(p1, p2, free_, rng_)
+                            : order_crossover(p1, p2, free_, rng_);
+      } else {
+        next_[i] = p1;
+      }
+      if (unif(rng_) < cfg_.mutation_rate) {
+        swap_mutation(next_[i], free_, rng_);
+      }
+      Stopwatch repair;
+      repair_layout(next_[i], *obj_.rules, *obj_.geometry);
+      repair_seconds += repair.seconds();
+    }
+    telemetry_.variation_seconds += phase.seconds() - repair_seconds;
+    telemetry_.repair_seconds += repair_seconds;
+
+    phase.reset();
+    obj_.evaluate(next_, next_scores_, elite, cfg_.n_threads);
+    telemetry_.scoring_seconds += phase.seconds();
+
+    pop_.swap(next_);
+    scores_.swap(next_scores_);
+
+    history_best_.push_back(*std::min_element(scores_.begin(), scores_.end()));
+    history_mean_.push_back(std::accumulate(scores_.begin(), scores_.end(), 0.0) / n_pop);
+    telemetry_.evaluations.push_back(n_pop - elite);
+    telemetry_.elapsed.push_back(clock.seconds());
+    telemetry_.diversity.push_back(diversity());
+  }
+
+  // Copies of the m best individuals, best first
+  void emigrants(int m, std::vector<KeyboardLayout>& layouts, std::vector<double>& scores) {
+    sort_order();
+    m = std::min(m, cfg_.population_size);
+    layouts.resize(m);
+    scores.resize(m);
+    for (int i = 0; i < m; i++) {
+      layouts[i] = pop_[order_[i]];
+      scores[i] = scores_[order_[i]];
+    }
+  }
+
+  // Replace the worst individuals with immigrants (already scored)
+  void immigrate(const std::vector<KeyboardLayout>& layouts, const std::vector<double>& scores) {
+    sort_order();
+    int m = std::min<int>(layouts.size(), cfg_.population_size);
+    for (int i = 0; i < m; i++) {
+      int slot = order_[cfg_.population_size - 1 - i];
+      pop_[slot] = layouts[i];
+      scores_[slot] = scores[i];
+    }
+  }
+
+  int best_index() const {
+    return std::min_element(scores_.begin(), scores_.end()) - scores_.begin();
+  }
+  const KeyboardLayout& best() const { return pop_[best_index()]; }
+  double best_score() const { return scores_[best_index()]; }
+
+  // Everything step() depends on, for checkpoints
+  void save(StateWriter& out) const {
+    out.put_rng(rng_);
+    out.put_layouts(pop_);
+    out.put_vector(scores_);
+    out.put_vector(history_best_);
+    out.put_vector(history_mean_);
+    out.put_telemetry(telemetry_);
+  }
+
+  // Continue from a saved population instead of seed()
+  void load(StateReader& in) {
+    in.get_rng(rng_);
+    in.get_layouts(pop_);
+    in.get_vector(scores_);
+    in.get_vector(history_best_);
+    in.get_vector(history_mean_);
+    in.get_telemetry(telemetry_);
+    int n_pop = cfg_.population_size;
+    if (static_cast<int>(pop_.size()) != n_pop || static_cast<int>(scores_.size()) != n_pop) {
+      throw std::runtime_error("checkpoint state is corrupt");
+    }
+    next_.resize(n_pop);
+    next_scores_.resize(n_pop);
+    order_.resize(n_pop);
+  }
+
+  const GAConfig& config() const { return cfg_; }
+  const std::vector<double>& history_best() const { return history_best_; }
+  const std::vector<double>& history_mean() const { return history_mean_; }
+  const Telemetry& telemetry() const { return telemetry_; }
+  double evaluations() const { return telemetry_.total_evaluations(); }
+
+private:
+  void sort_order() {
+    std::iota(order_.begin(), order_.end(), 0);
+    std::sort(order_.begin(), order_.end(), [&](int a, int b) {
+      return scores_[a] < scores_[b];
+    });
+  }
+
+  // Mean share of free positions on which an individual differs from the
+  // best one: 0 once the population has converged
+  double diversity() const {
+    if (free_.empty()) return 0.0;
+    const KeyboardLayout& best = pop_[best_index()];
+    double differing = 0.0;
+    for (size_t i = 0; i < pop_.size(); i++) {
+      for (size_t f = 0; f < free_.size(); f++) {
+        differing += pop_[i].keys[free_[f]] != best.keys[free_[f]];
+      }
+    }
+    return differing / (pop_.size() * free_.size());
+  }
+
+  const Objective& obj_;
+  GAConfig cfg_;
+  std::vector<int> free_;
+  std::mt19937 rng_;
+  std::vector<KeyboardLayout> pop_;
+  std::vector<double> scores_;
+  std::vector<KeyboardLayout> next_;
+  std::vector<double> next_scores_;
+  std::vector<int> order_;
+  std::vector<double> history_best_;
+  std::vector<double> history_mean_;
+  Telemetry telemetry_;
+};
+
+// Tracks the best score over generations for early stopping
+class Patience {
+public:
+  explicit Patience(int patience) : patience_(patience), best_(0.0), stale_(0), seen_(false) {}
+
+  // Record a generation's best; true once it is time to stop
+  bool update(double gen_best) {
+    if (!seen_ || gen_best < best_ - 1e-9 * std::abs(best_)) {
+      best_ = gen_best;
+      stale_ = 0;
+      seen_ = true;
+      return false;
+    }
+    return ++stale_ >= patience_;
+  }
+
+  void save(StateWriter& out) const {
+    out.put(best_);
+    out.put(static_cast<int32_t>(stale_));
+    out.put(static_cast<unsigned char>(seen_));
+  }
+
+  void load(StateReader& in) {
+    best_ = in.get<double>();
+    stale_ = in.get<int32_t>();
+    seen_ = in.get<unsigned char>() != 0;
+  }
+
+private:
+  int patience_;
+  double best_;
+  int stale_;
+  bool seen_;
+};
+
+// With a `resume` checkpoint, the population, its RNG stream and the
+// patience count continue from the saved generation instead of `initial`,
+// so the run ends exactly as the one that wrote the checkpoint would have.
+static GAResult run_ga(
+    const Objective& objective,
+    const KeyboardLayout& initial,
+    const GAConfig& cfg,
+    std::mt19937& rng,
+    const CheckpointPlan& checkpoints,
+    const Checkpoint* resume,
+    RunMonitor& monitor
+) {
+  Stopwatch clock;
+  std::vector<int> free = free_positions(*objective.rules, initial.n_keys);
+  Population pop(objective, cfg, free, rng);
+  Patience patience(cfg.patience);
+  int start = 0;
+  if (resume != NULL) {
+    StateReader in(resume->state);
+    start = in.get<int32_t>();
+    clock.resume_from(in.get<double>());
+    pop.load(in);
+    patience.load(in);
+  } else {
+    pop.seed(initial);
+  }
+
+  GAResult result;
+  result.stop_reason = "generations";
+  int saved = start;
+  for (int gen = start; gen < cfg.generations; gen++) {
+    pop.step(clock);
+    monitor.best_layout(pop.best(), pop.best_score());
+    if (!monitor.report(gen + 1, pop.history_best().back(), pop.history_mean().back(),
+                        pop.telemetry(), clock.seconds())) {
+      result.stop_reason = monitor.stop_reason();
+      break;
+    }
+    if (patience.update(pop.history_best().back())) {
+      result.stop_reason = "patience";
+      break;
+    }
+    if (checkpoints.due(gen + 1, saved)) {
+      StateWriter state;
+      state.put(static_cast<int32_t>(gen + 1));
+      state.put(clock.seconds());
+      pop.save(state);
+      patience.save(state);
+      checkpoints.write(state);
+      saved = gen + 1;
+    }
+    monitor.interruption_point();
+  }
+
+  result.best = pop.best();
+  result.best_score = pop.best_score();
+  result.history_best = pop.history_best();
+  result.history_mean = pop.history_mean();
+  result.evaluations = pop.evaluations();
+  result.telemetry = pop.telemetry();
+  return result;
+}
+
+// -----------------------------------------------------------------
+// ISLAND MODEL
+// -----------------------------------------------------------------
+
+enum MigrationTopology { TOPOLOGY_RING, TOPOLOGY_FULL };
+
+struct IslandConfig {
+  int migration_interval;  // generations between migrations
+  int migrants;            // individuals sent by each island
+  MigrationTopology topology;
+  std::vector<double> mutation_rates;   // one per island
+  std::vector<double> crossover_rates;  // one per island
+};
+
+struct IslandResult {
+  GAResult global;                   // best over all islands; mean over all individuals
+  std::vector<Population> islands;
+};
+
+// Islands evolve independently, one per thread, for migration_interval
+// generations at a time. Between epochs the threads have joined, so
+// emigrants are collected from every island first and then delivered:
+// the exchange needs no locks and its result does not depend on thread
+// timing. Each island draws from its own RNG stream, seeded in order
+// from `rng`, so a seed gives the same result for any number of threads.
+static IslandResult run_islands(
+    const Objective& objective,
+    const KeyboardLayout& initial,
+    const GAConfig& cfg,
+    const IslandConfig& icfg,
+    std::mt19937& rng,
+    const CheckpointPlan& checkpoints,
+    const Checkpoint* resume,
+    RunMonitor& monitor
+) {
+  Stopwatch clock;
+  std::vector<int> free = free_positions(*objective.rules, initial.n_keys);
+  int n_islands = icfg.mutation_rates.size();
+
+  IslandResult result;
+  result.islands.reserve(n_islands);
+  for (int i = 0; i < n_islands; i++) {
+    GAConfig island_cfg = cfg;
+    island_cfg.mutation_rate = icfg.mutation_rates[i];
+    island_cfg.crossover_rate = icfg.crossover_rates[i];
+    island_cfg.n_threads = 1;
+    result.islands.push_back(Population(objective, island_cfg, free, std::mt19937(rng())));
+  }
+  std::vector<Population>& islands = result.islands;
+
+  // Whole-run telemetry: per-generation counts summed and diversity
+  // averaged over islands, elapsed time of the slowest island
+  Telemetry& global = result.global.telemetry;
+  Patience patience(cfg.patience);
+  int done = 0;
+  if (resume != NULL) {
+    // Checkpoints are taken between epochs, after migration
+    StateReader in(resume->state);
+    done = in.get<int32_t>();
+    clock.resume_from(in.get<double>());
+    patience.load(in);
+    in.get_vector(result.global.history_best);
+    in.get_vector(result.global.history_mean);
+    in.get_telemetry(global);
+    for (int i = 0; i < n_islands; i++) islands[i].load(in);
+  } else {
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(cfg.n_threads) schedule(dynamic) if (cfg.n_threads > 1)
+#endif
+    for (int i = 0; i < n_islands; i++) {
+      islands[i].seed(initial);
+    }
+    for (int i = 0; i < n_islands; i++) {
+      global.initial_evaluations += islands[i].telemetry().initial_evaluations;
+    }
+  }
+
+  std::vector<std::vector<KeyboardLayout>> out_layouts(n_islands);
+  std::vector<std::vector<double>> out_scores(n_islands);
+  result.global.stop_reason = "generations";
+  bool stop = false;
+  int saved = done;
+  while (done < cfg.generations && !stop) {
+    int epoch = std::min(icfg.migration_interval, cfg.generations - done);
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(cfg.n_threads) schedule(dynamic) if (cfg.n_threads > 1)
+#endif
+    for (int i = 0; i < n_islands; i++) {
+      for (int g = 0; g < epoch; g++) islands[i].step(clock);
+    }
+    int leader = 0;
+    for (int i = 1; i < n_islands; i++) {
+      if (islands[i].best_score() < islands[leader].best_score()) leader = i;
+    }
+    monitor.best_layout(islands[leader].best(), islands[leader].best_score());
+
+    for (int g = done; g < done + epoch; g++) {
+      double gen_best = islands[0].history_best()[g];
+      double gen_mean = 0.0;
+      double evaluations = 0.0;
+      double elapsed = 0.0;
+      double diversity = 0.0;
+      for (int i = 0; i < n_islands; i++) {
+        const Telemetry& t = islands[i].telemetry();
+        gen_best = std::min(gen_best, islands[i].history_best()[g]);
+        gen_mean += islands[i].history_mean()[g] / n_islands;
+        evaluations += t.evaluations[g];
+        elapsed = std::max(elapsed, t.elapsed[g]);
+        diversity += t.diversity[g] / n_islands;
+      }
+      result.global.history_best.push_back(gen_best);
+      result.global.history_mean.push_back(gen_mean);
+      global.evaluations.push_back(evaluations);
+      global.elapsed.push_back(elapsed);
+      global.diversity.push_back(diversity);
+      if (stop) continue;
+      if (!monitor.report(g + 1, gen_best, gen_mean, global, elapsed)) {
+        result.global.stop_reason = monitor.stop_reason();
+        stop = true;
+      } else if (patience.update(gen_best)) {
+        result.global.stop_reason = "patience";
+        stop = true;
+      }
+    }
+    done += epoch;
+    if (stop || done >= cfg.generations) {
+      monitor.interruption_point();
+      continue;
+    }
+
+    // Migration: snapshot every island's best, then replace each island's
+    // worst individuals with those of its neighbour (ring) or with the
+    // best individuals of all other islands (fully connected)
+    bool migrate = n_islands > 1 && icfg.migrants > 0;
+    for (int i = 0; migrate && i < n_islands; i++) {
+      islands[i].emigrants(icfg.migrants, out_layouts[i], out_scores[i]);
+    }
+    for (int i = 0; migrate && i < n_islands; i++) {
+      if (icfg.topology == TOPOLOGY_RING) {
+        int from = (i + n_islands - 1) % n_islands;
+        islands[i].immigrate(out_layouts[from], out_scores[from]);
+        continue;
+      }
+      std::vector<std::pair<double, std::pair<int, int>>> pool;
+      for (int j = 0; j < n_islands; j++) {
+        if (j == i) continue;
+        for (size_t m = 0; m < out_scores[j].size(); m++) {
+          pool.push_back(std::make_pair(out_scores[j][m], std::make_pair(j, static_cast<int>(m))));
+        }
+      }
+      std::sort(pool.begin(), pool.end());
+      int take = std::min<int>(icfg.migrants, pool.size());
+      std::vector<KeyboardLayout> in_layouts(take);
+      std::vector<double> in_scores(take);
+      for (int m = 0; m < take; m++) {
+        in_layouts[m] = out_layouts[pool[m].second.first][pool[m].second.second];
+        in_scores[m] = pool[m].first;
+      }
+      islands[i].immigrate(in_layouts, in_scores);
+    }
+
+    // Checkpoints are taken between epochs whether or not islands migrate
+    if (checkpoints.due(done, saved)) {
+      StateWriter state;
+      state.put(static_cast<int32_t>(done));
+      state.put(clock.seconds());
+      patience.save(state);
+      state.put_vector(result.global.history_best);
+      state.put_vector(result.global.history_mean);
+      state.put_telemetry(global);
+      for (int i = 0; i < n_islands; i++) islands[i].save(state);
+      checkpoints.write(state);
+      saved = done;
+    }
+    monitor.interruption_point();
+  }
+
+  int best = 0;
+  for (int i = 0; i < n_islands; i++) {
+    const Telemetry& t = islands[i].telemetry();
+    if (islands[i].best_score() < islands[best].best_score()) best = i;
+    global.scoring_seconds += t.scoring_seconds;
+    global.repair_seconds += t.repair_seconds;
+    global.variation_seconds += t.variation_seconds;
+  }
+  result.global.evaluations = global.total_evaluations();
+  result.global.best = islands[best].best();
+  result.global.best_score = islands[best].best_score();
+  return result;
+}
+
+// -----------------------------------------------------------------
+// RUNS
+// -----------------------------------------------------------------
+
+// Settings a checkpointed population depends on. Generations, patience
+// and threads are left out: a resumed run may change them.
+static uint64_t ga_config_hash(const GAConfig& cfg, const IslandConfig& icfg, int n_islands) {
+  Fingerprint f;
+  f.add(cfg.population_size).add(cfg.mutation_rate).add(cfg.crossover_rate)
+    .add(cfg.tournament_size).add(cfg.elite_count).add(cfg.pmx).add(n_islands);
+  if (n_islands > 1) {
+    f.add(icfg.migration_interval).add(icfg.migrants).add(static_cast<int>(icfg.topology))
+      .add(icfg.mutation_rates).add(icfg.crossover_rates);
+  }
+  return f.value();
+}
+
+// A finished GA or island run, in C++ types only, so a background job
+// can produce it and the R session convert it later
+struct GAOutcome {
+  GAResult result;
+  std::vector<std::vector<double>> island_best;  // per island, per generation
+  std::vector<std::vector<double>> island_mean;
+  std::vector<double> island_score;
+};
+
+static GAOutcome run_optimizer(
+    const Objective& objective,
+    const KeyboardLayout& initial,
+    const GAConfig& cfg,
+    const IslandConfig& icfg,
+    int n_islands,
+    uint32_t seed,
+    const CheckpointPlan& checkpoints,
+    const Checkpoint* resume,
+    RunMonitor& monitor
+) {
+  std::mt19937 rng(seed);
+  GAOutcome out;
+  if (n_islands == 1) {
+    out.result = run_ga(objective, initial, cfg, rng, checkpoints, resume, monitor);
+    return out;
+  }
+
+  IslandResult res = run_islands(objective, initial, cfg, icfg, rng, checkpoints, resume,
+                                 monitor);
+  out.result = res.global;
+  for (int i = 0; i < n_islands; i++) {
+    out.island_best.push_back(res.islands[i].history_best());
+    out.island_mean.push_back(res.islands[i].history_mean());
+    out.island_score.push_back(res.islands[i].best_score());
+  }
+  return out;
+}
+
+static List outcome_list(const CorpusStats& cs, const Objective& objective,
+                         const GAOutcome& out, double seconds, const FitnessCache* cache) {
+  const GAResult& res = out.result;
+  List telemetry = telemetry_list(res.telemetry, seconds, res.stop_reason, cache);
+  if (out.island_score.empty()) {
+    return List::create(
+      Named("layout") = layout_labels(cs, res.best),
+      Named("effort") = objective.effort(res.best),
+      Named("objective") = res.best_score,
+      Named("history_best") = wrap(res.history_best),
+      Named("history_mean") = wrap(res.history_mean),
+      Named("evaluations") = res.evaluations,
+      Named("telemetry") = telemetry
+    );
+  }
+
+  int n_islands = out.island_score.size();
+  int n_gen = res.history_best.size();
+  NumericMatrix island_best(n_gen, n_islands);
+  NumericMatrix island_mean(n_gen, n_islands);
+  for (int i = 0; i < n_islands; i++) {
+    for (int g = 0; g < n_gen; g++) {
+      island_best(g, i) = out.island_best[i][g];
+      island_mean(g, i) = out.island_mean[i][g];
+    }
+  }
+
+  return List::create(
+    Named("layout") = layout_labels(cs, res.best),
+    Named("effort") = objective.effort(res.best),
+    Named("objective") = res.best_score,
+    Named("history_best") = wrap(res.history_best),
+    Named("history_mean") = wrap(res.history_mean),
+    Named("evaluations") = res.evaluations,
+    Named("island_best") = island_best,
+    Named("island_mean") = island_mean,
+    Named("island_score") = wrap(out.island_score),
+    Named("telemetry") = telemetry
+  );
+}
+
+// -----------------------------------------------------------------
+// BACKGROUND JOBS
+// -----------------------------------------------------------------
+
+enum JobStatus { JOB_RUNNING, JOB_FINISHED, JOB_CANCELLED, JOB_FAILED };
+
+static const char* job_status_name(JobStatus status) {
+  switch (status) {
+    case JOB_RUNNING: return "running";
+    case JOB_FINISHED: return "finished";
+    case JOB_CANCELLED: return "cancelled";
+    default: return "failed";
+  }
+}
+
+// A GA run on its own thread. The job scores against its own copies of
+// the counts, geometry and rules, so the R objects they came from may
+// change or be collected while it runs. The worker is its own monitor:
+// after every generation it publishes a snapshot under `mutex_` and checks
+// the cancellation flag. It never calls into R; only the R session reads
+// the snapshot and converts it.
+class GAJob : public RunMonitor {
+public:
+  GAJob(const CorpusStats& cs, const KeyboardGeometry& kg, const RuleSet& rules,
+        FitnessCache* cache, const KeyboardLayout& initial, const GAConfig& cfg,
+        const IslandConfig& icfg, int n_islands, uint32_t seed,
+        const CheckpointPlan& checkpoints, const Checkpoint* resume)
+    : geometry_(kg), rules_(rules), cache_(cache), initial_(initial), cfg_(cfg),
+      icfg_(icfg), n_islands_(n_islands), seed_(seed), checkpoints_(checkpoints),
+      resumed_(resume != NULL), resume_(resume != NULL ? *resume : Checkpoint()), cancel_(false),
+      status_(JOB_RUNNING), generation_(0), best_(initial), elapsed_(0.0),
+      evaluations_(0.0) {
+    corpus_.symbols = cs.symbols;
+    corpus_.codepoints = cs.codepoints;
+    corpus_.unigram = cs.unigram;
+    corpus_.bigram = cs.bigram;
+    corpus_.trigrams = cs.trigrams;
+    corpus_.n_chars = cs.n_chars;
+    corpus_.n_alpha = cs.n_alpha;
+    Objective objective = {&corpus_, &geometry_.geometry, &geometry_.costs, &rules_,
+                           cache_.get()};
+    objective_ = objective;
+    best_score_ = objective_(initial_);
+  }
+
+  ~GAJob() {
+    cancel();
+    if (worker_.joinable()) worker_.join();
+  }
+
+  void start() { worker_ = std::thread(&GAJob::run, this); }
+
+  // Stops the run after the generation (island epoch) in progress
+  void cancel() { cancel_ = true; }
+
+  // Called from the worker thread
+  bool report(int generation, double best, double mean, const Telemetry& t, double elapsed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_ = generation;
+    history_best_.push_back(best);
+    history_mean_.push_back(mean);
+    elapsed_ = elapsed;
+    evaluations_ = t.total_evaluations();
+    return !cancel_;
+  }
+
+  void best_layout(const KeyboardLayout& layout, double score) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (score < best_score_) {
+      best_ = layout;
+      best_score_ = score;
+    }
+  }
+
+  std::string stop_reason() const { return "cancelled"; }
+
+  // State of the run so far. The snapshot is copied under the lock and
+  // converted for R after releasing it.
+  List poll() {
+    JobStatus status;
+    int generation;
+    KeyboardLayout best;
+    double best_score, elapsed, evaluations;
+    std::vector<double> history_best, history_mean;
+    std::string error;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      status = status_;
+      generation = generation_;
+      best = best_;
+      best_score = best_score_;
+      elapsed = status_ == JOB_RUNNING ? clock_.seconds() : elapsed_;
+      evaluations = evaluations_;
+      history_best = history_best_;
+      history_mean = history_mean_;
+      error = error_;
+    }
+    return List::create(
+      Named("status") = job_status_name(status),
+      Named("generation") = generation,
+      Named("layout") = layout_labels(corpus_, best),
+      Named("effort") = objective_.effort(best),
+      Named("objective") = best_score,
+      Named("history_best") = wrap(history_best),
+      Named("history_mean") = wrap(history_mean),
+      Named("evaluations") = evaluations,
+      Named("elapsed") = elapsed,
+      Named("error") = error
+    );
+  }
+
+  // Result as returned by ga_optimize(). Waits for the run to end, in
+  // slices that let the user interrupt the wait (not the run) from R.
+  List result(bool wait) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (status_ == JOB_RUNNING) {
+        if (!wait) stop("the job is still running");
+        done_.wait_for(lock, std::chrono::milliseconds(100));
+        lock.unlock();
+        Rcpp::checkUserInterrupt();
+        lock.lock();
+      }
+      if (status_ == JOB_FAILED) stop("the optimization failed: " + error_);
+    }
+    if (worker_.joinable()) worker_.join();
+    return outcome_list(corpus_, objective_, outcome_, elapsed_, cache_.get());
+  }
+
+private:
+  void run() {
+    GAOutcome outcome;
+    std::string error;
+    bool failed = false;
+    try {
+      outcome = run_optimizer(objective_, initial_, cfg_, icfg_, n_islands_, seed_,
+                              checkpoints_, resumed_ ? &resume_ : NULL, *this);
+    } catch (std::exception& e) {
+      failed = true;
+      error = e.what();
+    } catch (...) {
+      failed = true;
+      error = "unknown error";
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      outcome_ = outcome;
+      error_ = error;
+      elapsed_ = clock_.seconds();
+      if (failed) {
+        status_ = JOB_FAILED;
+      } else {
+        status_ = outcome.result.stop_reason == "cancelled" ? JOB_CANCELLED : JOB_FINISHED;
+      }
+    }
+    done_.notify_all();
+  }
+
+  // Inputs, read-only once the worker runs
+  CorpusStats corpus_;
+  KeyboardGeometry geometry_;
+  RuleSet rules_;
+  std::unique_ptr<FitnessCache> cache_;
+  Objective objective_;
+  KeyboardLayout initial_;
+  GAConfig cfg_;
+  IslandConfig icfg_;
+  int n_islands_;
+  uint32_t seed_;
+  CheckpointPlan checkpoints_;
+  bool resumed_;
+  Checkpoint resume_;
+  Stopwatch clock_;
+
+  std::thread worker_;
+  std::atomic<bool> cancel_;
+
+  // Snapshot, guarded by mutex_
+  std::mutex mutex_;
+  std::condition_variable done_;
+  JobStatus status_;
+  int generation_;
+  KeyboardLayout best_;
+  double best_score_;
+  std::vector<double> history_best_;
+  std::vector<double> history_mean_;
+  double elapsed_;
+  double evaluations_;
+  std::string error_;
+  GAOutcome outcome_;
+};
+
+static GAJob& job_ref(SEXP job) {
+  XPtr<GAJob> ptr(job);
+  if (ptr.get() == NULL) {
+    stop("job pointer is invalid (optimization jobs cannot be saved with saveRDS)");
+  }
+  return *ptr;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Run the native permutation GA on a compiled corpus. With n_islands > 1
+// the population is split into islands with their own mutation and
+// crossover rates that exchange their best individuals every
+// migration_interval generations. `progress`, when not NULL, is called
+// every progress_every generations (see ProgressCallback). With
+// cache_capacity > 0, scores are memoized in a FitnessCache shared by all
+// islands, evicting "lru" or "fifo". With background = TRUE the run starts
+// on its own thread and a job handle is returned at once; see ga_job_poll().
+// With checkpoint_every > 0 the state is saved to `checkpoint` every that
+// many generations (island runs: at the first migration after), together
+// with `checkpoint_settings`; resume = TRUE continues from that file.
+// [[Rcpp::export]]
+SEXP ga_optimize(
+    SEXP corpus,
+    CharacterVector layout,
+    SEXP geometry,
+    LogicalVector fixed,
+    List rules,
+    int population_size = 100,
+    int generations = 500,
+    double mutation_rate = 0.1,
+    double crossover_rate = 0.8,
+    int tournament_size = 5,
+    int elite_count = 2,
+    int patience = 50,
+    std::string crossover = "order",
+    int n_islands = 1,
+    int migration_interval = 10,
+    int migrants = 2,
+    std::string topology = "ring",
+    NumericVector island_mutation_rates = NumericVector::create(),
+    NumericVector island_crossover_rates = NumericVector::create(),
+    SEXP progress = R_NilValue,
+    int progress_every = 10,
+    double cache_capacity = 0,
+    std::string cache_eviction = "lru",
+    int seed = 1,
+    int n_threads = 1,
+    bool background = false,
+    std::string checkpoint = "",
+    int checkpoint_every = 0,
+    SEXP checkpoint_settings = R_NilValue,
+    bool resume = false
+) {
+  Stopwatch clock;
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  KeyboardLayout initial = layout_from_labels(cs, layout);
+  if (initial.n_keys != kg.geometry.n) stop("layout must have one key per geometry position");
+  if (fixed.size() != initial.n_keys) {
+    stop("fixed must have one entry per layout position");
+  }
+  if (population_size < 2) stop("population_size must be at least 2");
+  if (tournament_size < 1) stop("tournament_size must be at least 1");
+  if (elite_count < 0 || elite_count >= population_size) {
+    stop("elite_count must be between 0 and population_size - 1");
+  }
+  if (crossover != "order" && crossover != "pmx") {
+    stop("crossover must be 'order' or 'pmx'");
+  }
+  if (n_islands < 1) stop("n_islands must be at least 1");
+  if (migration_interval < 1) stop("migration_interval must be at least 1");
+  if (migrants < 0 || migrants >= population_size) {
+    stop("migrants must be between 0 and population_size - 1");
+  }
+  if (topology != "ring" && topology != "full") {
+    stop("topology must be 'ring' or 'full'");
+  }
+  if (progress_every < 1) stop("progress_every must be at least 1");
+  if (cache_capacity < 0) stop("cache_capacity must be non-negative");
+  if (cache_eviction != "lru" && cache_eviction != "fifo") {
+    stop("cache_eviction must be 'lru' or 'fifo'");
+  }
+  if (cache_capacity > 0 && cs.size() > 65536) {
+    stop("the fitness cache supports at most 65536 keys");
+  }
+  if (background && !Rf_isNull(progress)) {
+    stop("background runs cannot call a progress callback; poll the job instead");
+  }
+
+  IslandConfig icfg;
+  icfg.migration_interval = migration_interval;
+  icfg.migrants = migrants;
+  icfg.topology = topology == "ring" ? TOPOLOGY_RING : TOPOLOGY_FULL;
+  if (n_islands > 1) {
+    icfg.mutation_rates = Rcpp::as<std::vector<double>>(island_mutation_rates);
+    icfg.crossover_rates = Rcpp::as<std::vector<double>>(island_crossover_rates);
+    if (static_cast<int>(icfg.mutation_rates.size()) != n_islands ||
+        static_cast<int>(icfg.crossover_rates.size()) != n_islands) {
+      stop("island rates must have one entry per island");
+    }
+  }
+
+  RuleSet rs = rules_from_list(rules, fixed, cs);
+  std::unique_ptr<FitnessCache> cache;
+  if (cache_capacity >= 1) {
+    cache.reset(new FitnessCache(static_cast<size_t>(cache_capacity), cache_eviction == "lru"));
+  }
+  GAConfig cfg = {population_size, generations, mutation_rate, crossover_rate,
+                  tournament_size, elite_count, std::max(1, patience), crossover == "pmx",
+                  resolve_threads(n_threads)};
+  Checkpoint resumed;
+  CheckpointPlan checkpoints = checkpoint_plan(
+    CHECKPOINT_GENETIC, cs, kg, rs, ga_config_hash(cfg, icfg, n_islands), checkpoint,
+    checkpoint_every, checkpoint_settings, resume, resumed);
+  const Checkpoint* from = resume ? &resumed : NULL;
+
+  if (background) {
+    XPtr<GAJob> job(new GAJob(cs, kg, rs, cache.release(), initial, cfg, icfg, n_islands,
+                              static_cast<uint32_t>(seed), checkpoints, from), true);
+    job->start();
+    return job;
+  }
+
+  Objective objective = {&cs, &kg.geometry, &kg.costs, &rs, cache.get()};
+  ProgressCallback callback(progress, progress_every);
+  SessionMonitor monitor(callback);
+  GAOutcome out = run_optimizer(objective, initial, cfg, icfg, n_islands,
+                                static_cast<uint32_t>(seed), checkpoints, from, monitor);
+  return outcome_list(cs, objective, out, clock.seconds(), cache.get());
+}
+
+// Snapshot of a background run: status ("running", "finished",
+// "cancelled" or "failed"), the best layout found so far with its effort
+// and objective, the per-generation history so far, and the error of a
+// failed run
+// [[Rcpp::export]]
+List ga_job_poll(SEXP job) {
+  return job_ref(job).poll();
+}
+
+// Ask a background run to stop after the generation in progress (island
+// runs: after the migration epoch in progress)
+// [[Rcpp::export]]
+void ga_job_cancel(SEXP job) {
+  job_ref(job).cancel();
+}
+
+// Result of a background run as returned by ga_optimize(); with wait =
+// FALSE, an error while the run is still going
+// [[Rcpp::export]]
+List ga_job_result(SEXP job, bool wait = true) {
+  return job_ref(job).result(wait);
+}
@@ -3,10 +3,11 @@
 // Effort model inspired by Carpalx (http://mkweb.bcgsc.ca/carpalx/)
 
 #include <Rcpp.h>
+#include "keyboard_model.h"
 #include <algorithm>
 #include <random>
-#include <unordered_map>
 #include <cmath>
+#include <map>
 #include <vector>
 #include <string>
 
@@ -20,16 +21,6 @@ using namespace Rcpp;
 // For standard touch typing on QWERTY-like layouts
 // Row 0 = number row, Row 1 = top letter row, Row 2 = home row, Row 3 = bottom row
 
-// Key position structure
-struct KeyPosition {
-  double x;
-  double y;
-  int row;       // 0-3 (number row to bottom row for typeable keys)
-  int column;    // position in row
-  int finger;    // 0-9 (left pinky to right pinky)
-  int hand;      // 0 = left, 1 = right
-};
-
 // Default finger assignments for standard ISO layout columns
 // This maps column position to finger (for rows 1-3: top, home, bottom letter rows)
 // NOTE: This is a fallback for when x_mid is not available
@@ -251,328 +242,307 @@ double same_hand_trigram_penalty(int finger1, int finger2, int finger3, bool is_
 }
 
 // -----------------------------------------------------------------
-// LAYOUT REPRESENTATION AND MANIPULATION
+// LAYER PENALTIES
 // -----------------------------------------------------------------
 
-// A layout is represented as a permutation of characters
-// Layout maps character -> position index
-// Position index maps to physical key location
-
-class KeyboardLayout {
-public:
-  std::vector<char> keys;           // Character at each position
-  std::vector<KeyPosition> positions; // Physical position info
-  int n_keys;
-
-  KeyboardLayout() : n_keys(0) {}
-
-  KeyboardLayout(const std::vector<char>& k, const std::vector<KeyPosition>& p)
-    : keys(k), positions(p), n_keys(k.size()) {}
-
-  // Find position index for a character
-  int find_key(char c) const {
-    for (int i = 0; i < n_keys; i++) {
-      if (keys[i] == c) return i;
-    }
-    return -1;  // Not found
-  }
-
-  // Swap two keys in the layout
-  void swap_keys(int i, int j) {
-    std::swap(keys[i], keys[j]);
-  }
-
-  // Get a copy with swapped keys
-  KeyboardLayout with_swap(int i, int j) const {
-    KeyboardLayout copy = *this;
-    copy.swap_keys(i, j);
-    return copy;
+// Modifier press needed to reach a layer from another one; consecutive
+// keys on the same layer hold the modifier down and pay it once
+double layer_penalty(int layer) {
+  switch(layer) {
+    case 0: return 0.0;   // Base layer - no modifier
+    case 1: return 1.0;   // Shift - pinky of the other hand
+    case 2: return 1.5;   // AltGr - right thumb, awkward chords
+    default: return 2.0;  // Dead keys and custom layers
   }
-};
+}
 
 // -----------------------------------------------------------------
-// EFFORT CALCULATION
+// POSITION-LEVEL COST TABLES
 // -----------------------------------------------------------------
 
-// Calculate total typing effort for a text sample given a layout
-// Internal function - not exported (std::vector<char> not supported by Rcpp)
-double calculate_effort(
-    const std::vector<char>& layout_keys,
+// Derive fingers, hands, base effort and every pair and finger-triple
+// penalty once per set of key positions
+Geometry make_geometry(
     const std::vector<double>& pos_x,
     const std::vector<double>& pos_y,
     const std::vector<int>& pos_row,
     const std::vector<int>& pos_col,
-    const std::string& text,
-    const std::vector<double>& char_freq,
-    const std::vector<char>& char_list,
-    double w_base = 1.0,
-    double w_same_finger = 3.0,
-    double w_same_hand = 1.0,
-    double w_row_change = 0.5,
-    double w_trigram = 0.3
+    const std::vector<int>& pos_layer
 ) {
-  int n = layout_keys.size();
-
-  // Build character -> position mapping
-  std::unordered_map<char, int> char_to_pos;
-  for (int i = 0; i < n; i++) {
-    char_to_pos[layout_keys[i]] = i;
-    // Also add uppercase version
-    if (layout_keys[i] >= 'a' && layout_keys[i] <= 'z') {
-      char_to_pos[layout_keys[i] - 32] = i;  // uppercase maps to same position
+  Geometry g;
+  g.n = pos_x.size();
+  g.x = pos_x;
+  g.y = pos_y;
+  g.row = pos_row;
+  g.col = pos_col;
+  g.layer = pos_layer.empty() ? std::vector<int>(g.n, 0) : pos_layer;
+  g.key.resize(g.n);
+  g.finger.resize(g.n);
+  g.hand.resize(g.n);
+  g.base_cost.resize(g.n);
+  g.pair_class.assign(g.n * g.n, PAIR_ALTERNATION);
+  g.same_finger_cost.assign(g.n * g.n, 0.0);
+  g.same_hand_cost.assign(g.n * g.n, 0.0);
+  g.row_change_cost.assign(g.n * g.n, 0.0);
+  g.layer_cost.assign(g.n * g.n, 0.0);
+  g.finger_tri_cost.assign(1000, 0.0);
+
+  // Trigram penalty depends only on the three fingers
+  for (int f0 = 0; f0 < 10; f0++) {
+    for (int f1 = 0; f1 < 10; f1++) {
+      for (int f2 = 0; f2 < 10; f2++) {
+        int h = get_hand_for_finger(f0);
+        if (get_hand_for_finger(f1) != h || get_hand_for_finger(f2) != h) continue;
+        g.finger_tri_cost[(f0 * 10 + f1) * 10 + f2] =
+          same_hand_trigram_penalty(f0, f1, f2, h == 0);
+      }
     }
   }
+  if (g.n == 0) return g;
 
-  // Calculate finger assignments based on x position (works for any layout!)
-  // Find min/max x to determine keyboard bounds
   double min_x = *std::min_element(pos_x.begin(), pos_x.end());
   double max_x = *std::max_element(pos_x.begin(), pos_x.end());
-
-  std::vector<int> fingers(n);
-  std::vector<int> hands(n);
-  for (int i = 0; i < n; i++) {
-    // Use x position for layout-independent finger assignment
-    fingers[i] = get_finger_for_x_position(pos_x[i], min_x, max_x);
-    hands[i] = get_hand_for_finger(fingers[i]);
+  for (int i = 0; i < g.n; i++) {
+    g.finger[i] = get_finger_for_x_position(pos_x[i], min_x, max_x);
+    g.hand[i] = get_hand_for_finger(g.finger[i]);
+    g.base_cost[i] = base_key_effort_x(pos_row[i], pos_x[i], g.finger[i], min_x, max_x);
   }
 
-  double total_effort = 0.0;
-  
-  // Get text length for scaling base effort properly
-  // (char_freq are proportions 0-1, but bigrams count per-character)
-  double text_len = static_cast<double>(text.length());
+  std::map<std::pair<int, int>, int> keys;
+  for (int i = 0; i < g.n; i++) {
+    std::pair<int, int> rc(pos_row[i], pos_col[i]);
+    if (!keys.count(rc)) {
+      int id = keys.size();
+      keys[rc] = id;
+    }
+    g.key[i] = keys[rc];
+  }
 
-  // Base effort (weighted by character frequency)
-  // Scale by text length so base effort is comparable to bigram effort
-  for (size_t i = 0; i < char_list.size(); i++) {
-    char c = char_list[i];
-    auto it = char_to_pos.find(c);
-    if (it == char_to_pos.end()) {
-      // Try lowercase
-      if (c >= 'A' && c <= 'Z') {
-        it = char_to_pos.find(c + 32);
+  // Same branch structure as the bigram step of calculate_effort(). Two
+  // layers of one key are typed like a repeated key.
+  for (int p = 0; p < g.n; p++) {
+    for (int q = 0; q < g.n; q++) {
+      int pq = g.pair(p, q);
+      if (g.layer[q] != g.layer[p]) g.layer_cost[pq] = layer_penalty(g.layer[q]);
+      if (g.finger[p] == g.finger[q] && g.key[p] != g.key[q]) {
+        g.pair_class[pq] = PAIR_SAME_FINGER;
+        g.same_finger_cost[pq] = same_finger_penalty(g.row[p], g.row[q], g.col[p], g.col[q]);
+      } else if (g.hand[p] == g.hand[q]) {
+        g.pair_class[pq] = PAIR_SAME_HAND;
+        g.same_hand_cost[pq] = same_hand_penalty(g.row[p], g.row[q], g.col[p], g.col[q],
+                                                 g.finger[p], g.finger[q]);
+        g.row_change_cost[pq] = row_change_penalty(g.row[p], g.row[q]);
       }
     }
-    if (it != char_to_pos.end()) {
-      int pos = it->second;
-      // Use x-position-based effort (layout-independent!)
-      double base = base_key_effort_x(pos_row[pos], pos_x[pos], fingers[pos], min_x, max_x);
-      // Multiply by text_len to scale properly
-      total_effort += w_base * base * char_freq[i] * text_len;
-    }
   }
+  return g;
+}
 
-  // Bigram and trigram effort (process text for consecutive pairs and triples)
-  int prev_prev_pos = -1;
-  int prev_pos = -1;
-  for (size_t i = 0; i < text.length(); i++) {
-    char c = std::tolower(text[i]);
-    auto it = char_to_pos.find(c);
-    if (it == char_to_pos.end()) continue;
+CostTables::CostTables(const Geometry& g, const EffortWeights& w)
+  : n(g.n), weights(w), finger(g.finger) {
+  base.resize(n);
+  for (int p = 0; p < n; p++) {
+    base[p] = w.base * g.base_cost[p];
+  }
 
-    int curr_pos = it->second;
+  pair.resize(n * n);
+  for (int pq = 0; pq < n * n; pq++) {
+    pair[pq] = w.same_finger * g.same_finger_cost[pq] +
+               w.same_hand * g.same_hand_cost[pq] +
+               w.row_change * g.row_change_cost[pq] +
+               w.layer * g.layer_cost[pq];
+  }
 
-    // Process bigrams
-    if (prev_pos >= 0) {
-      int finger1 = fingers[prev_pos];
-      int finger2 = fingers[curr_pos];
-      int hand1 = hands[prev_pos];
-      int hand2 = hands[curr_pos];
-
-      // Same finger penalty
-      if (finger1 == finger2 && prev_pos != curr_pos) {
-        total_effort += w_same_finger * same_finger_penalty(
-          pos_row[prev_pos], pos_row[curr_pos],
-          pos_col[prev_pos], pos_col[curr_pos]
-        );
-      }
-      // Same hand penalty
-      else if (hand1 == hand2) {
-        total_effort += w_same_hand * same_hand_penalty(
-          pos_row[prev_pos], pos_row[curr_pos],
-          pos_col[prev_pos], pos_col[curr_pos],
-          finger1, finger2
-        );
-        total_effort += w_row_change * row_change_penalty(
-          pos_row[prev_pos], pos_row[curr_pos]
-        );
-      }
-      // Hand alternation (preferred - no penalty)
-    }
+  finger_tri.resize(g.finger_tri_cost.size());
+  for (size_t f = 0; f < finger_tri.size(); f++) {
+    finger_tri[f] = w.trigram * g.finger_tri_cost[f];
+  }
 
-    // Process trigrams (three consecutive keys on same hand)
-    if (prev_prev_pos >= 0 && prev_pos >= 0) {
-      int finger0 = fingers[prev_prev_pos];
-      int finger1 = fingers[prev_pos];
-      int finger2 = fingers[curr_pos];
-      int hand0 = hands[prev_prev_pos];
-      int hand1 = hands[prev_pos];
-      int hand2 = hands[curr_pos];
-
-      // Only penalize if all three keys are on the same hand
-      if (hand0 == hand1 && hand1 == hand2) {
-        bool is_left = (hand0 == 0);
-        total_effort += w_trigram * same_hand_trigram_penalty(
-          finger0, finger1, finger2, is_left
-        );
+  pair_padded.assign(n * (n + 1), 0.0);
+  for (int p = 0; p < n; p++) {
+    std::copy(&pair[p * n], &pair[p * n] + n, &pair_padded[p * (n + 1)]);
+  }
+  finger_tri_padded.assign(11 * 11 * 11, 0.0);
+  for (int f0 = 0; f0 < 10; f0++) {
+    for (int f1 = 0; f1 < 10; f1++) {
+      for (int f2 = 0; f2 < 10; f2++) {
+        finger_tri_padded[(f0 * 11 + f1) * 11 + f2] = finger_tri[(f0 * 10 + f1) * 10 + f2];
       }
     }
-
-    prev_prev_pos = prev_pos;
-    prev_pos = curr_pos;
   }
-
-  return total_effort;
 }
 
 // -----------------------------------------------------------------
-// RULE PENALTY CALCULATIONS
+// EFFORT CALCULATION
 // -----------------------------------------------------------------
 
-// Calculate penalties from soft preference rules
-double calculate_rule_penalties(
-    const std::vector<char>& layout,
-    const std::vector<int>& pos_row,
-    const std::vector<int>& pos_col,
-    const std::vector<double>& char_freq,
-    const std::vector<char>& char_list,
-    // Hand preference rule - now uses character keys, not indices
-    const std::vector<char>& hand_pref_keys,
-    const std::vector<int>& hand_pref_targets,
-    double hand_pref_weight,
-    // Row preference rule - now uses character keys, not indices
-    const std::vector<char>& row_pref_keys,
-    const std::vector<int>& row_pref_targets,
-    double row_pref_weight,
-    // Balance hands rule
-    double balance_target,
-    double balance_weight
-) {
-  double penalty = 0.0;
-  int n = layout.size();
+namespace {
 
-  // Build character -> position mapping for the current layout
-  std::unordered_map<char, int> char_to_pos;
-  for (int i = 0; i < n; i++) {
-    char_to_pos[layout[i]] = i;
-    // If lowercase, add uppercase
-    if (layout[i] >= 'a' && layout[i] <= 'z') {
-      char_to_pos[layout[i] - 32] = i;
-    }
-    // If uppercase, add lowercase
-    else if (layout[i] >= 'A' && layout[i] <= 'Z') {
-      char_to_pos[layout[i] + 32] = i;
+// Layout keys as a dense symbol alphabet: the case-folded codepoint of
+// each key, and the position each symbol sits at
+struct LayoutSymbols {
+  std::vector<uint32_t> codepoints;
+  std::vector<int> pos_of_sym;
+};
+
+// Text decoded once into symbol IDs. Characters that are not on the
+// layout are dropped here, which is how the effort model skips them
+// without breaking the sequence.
+struct EncodedText {
+  std::vector<int> symbols;
+  double n_chars;  // text length in characters, including skipped ones
+};
+
+LayoutSymbols layout_symbols(CharacterVector layout) {
+  LayoutSymbols ls;
+  std::vector<uint32_t> cps;
+  for (int i = 0; i < layout.size(); i++) {
+    decode_utf8(Rcpp::as<std::string>(layout[i]), cps);
+    if (cps.empty()) continue;
+    uint32_t cp = fold_case(cps[0]);
+    // A key listed twice is scored at its last position
+    std::vector<uint32_t>::iterator it =
+      std::find(ls.codepoints.begin(), ls.codepoints.end(), cp);
+    if (it != ls.codepoints.end()) {
+      ls.pos_of_sym[it - ls.codepoints.begin()] = i;
+    } else {
+      ls.codepoints.push_back(cp);
+      ls.pos_of_sym.push_back(i);
     }
   }
+  return ls;
+}
 
-  // Calculate hand for each position (based on column)
-  // Columns 0-4 = left hand, 5+ = right hand
-  auto get_hand = [&](int pos) -> int {
-    int col = pos_col[pos];
-    if (col <= 4) return 0;  // left
-    if (col >= 5) return 1;  // right
-    return 0;
-  };
-
-  // Hand preference penalties - look up each key character directly
-  if (hand_pref_weight > 0.0 && !hand_pref_keys.empty()) {
-    for (size_t i = 0; i < hand_pref_keys.size(); i++) {
-      char key = std::tolower(hand_pref_keys[i]);
-      auto it = char_to_pos.find(key);
-      if (it != char_to_pos.end()) {
-        int actual_hand = get_hand(it->second);
-        int target_hand = hand_pref_targets[i];
-        if (actual_hand != target_hand) {
-          penalty += hand_pref_weight;
-        }
-      }
+// Samples are joined with a trailing space each, as the effort model has
+// always done
+EncodedText encode_text(CharacterVector text_samples, const SymbolLookup& lookup) {
+  EncodedText et;
+  et.n_chars = 0.0;
+  std::vector<uint32_t> cps;
+  for (int i = 0; i < text_samples.size(); i++) {
+    decode_utf8(Rcpp::as<std::string>(text_samples[i]), cps);
+    cps.push_back(' ');
+    et.n_chars += cps.size();
+    for (size_t j = 0; j < cps.size(); j++) {
+      int s = lookup(cps[j]);
+      if (s >= 0) et.symbols.push_back(s);
     }
   }
+  return et;
+}
 
-  // Row preference penalties - look up each key character directly
-  if (row_pref_weight > 0.0 && !row_pref_keys.empty()) {
-    for (size_t i = 0; i < row_pref_keys.size(); i++) {
-      char key = std::tolower(row_pref_keys[i]);
-      auto it = char_to_pos.find(key);
-      if (it != char_to_pos.end()) {
-        int actual_row = pos_row[it->second];
-        int target_row = row_pref_targets[i];
-        if (actual_row != target_row) {
-          // Penalty proportional to row distance
-          penalty += row_pref_weight * std::abs(actual_row - target_row);
-        }
-      }
-    }
+// Relative frequency of each symbol, from letter_freq() output
+std::vector<double> symbol_frequencies(
+    CharacterVector char_list,
+    const std::vector<double>& char_freq,
+    const SymbolLookup& lookup,
+    int n_symbols
+) {
+  std::vector<double> freq(n_symbols, 0.0);
+  std::vector<uint32_t> cps;
+  for (int i = 0; i < char_list.size(); i++) {
+    decode_utf8(Rcpp::as<std::string>(char_list[i]), cps);
+    if (cps.empty()) continue;
+    int s = lookup(cps[0]);
+    if (s >= 0) freq[s] += char_freq[i];
   }
+  return freq;
+}
+
+}  // namespace
+
+// Effort components for a text, walking the symbol stream once. Every
+// symbol in the stream is on the layout, and every penalty comes from the
+// geometry tables, so the loop is a few array lookups per character.
+// Internal function - not exported
+EffortComponents calculate_effort(
+    const Geometry& g,
+    const std::vector<int>& pos_of_sym,
+    const std::vector<int>& text,
+    double text_len,
+    const std::vector<double>& sym_freq
+) {
+  EffortComponents c = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
 
-  // Hand balance penalty
-  if (balance_weight > 0.0) {
-    double left_load = 0.0;
-    double total_load = 0.0;
-
-    for (size_t i = 0; i < char_list.size(); i++) {
-      char c = std::tolower(char_list[i]);
-      auto it = char_to_pos.find(c);
-      if (it != char_to_pos.end()) {
-        int hand = get_hand(it->second);
-        double freq = char_freq[i];
-        total_load += freq;
-        if (hand == 0) {
-          left_load += freq;
-        }
+  // Base effort (weighted by character frequency)
+  // Scale by text length so base effort is comparable to bigram effort
+  for (size_t s = 0; s < sym_freq.size(); s++) {
+    c.base += g.base_cost[pos_of_sym[s]] * sym_freq[s] * text_len;
+  }
+
+  // Bigram and trigram effort (process text for consecutive pairs and triples)
+  int prev_prev_pos = -1;
+  int prev_pos = -1;
+  for (size_t i = 0; i < text.size(); i++) {
+    int curr_pos = pos_of_sym[text[i]];
+
+    // Process bigrams
+    if (prev_pos >= 0) {
+      int pq = g.pair(prev_pos, curr_pos);
+      if (g.layer_cost[pq] > 0.0) {
+        c.layer_switches += 1.0;
+        c.layer += g.layer_cost[pq];
+      }
+      switch (g.pair_class[pq]) {
+        case PAIR_SAME_FINGER:
+          c.same_finger_bigrams += 1.0;
+          c.same_finger += g.same_finger_cost[pq];
+          break;
+        case PAIR_SAME_HAND:
+          c.same_hand_bigrams += 1.0;
+          c.same_hand += g.same_hand_cost[pq];
+          c.row_change += g.row_change_cost[pq];
+          break;
+        default:
+          // Hand alternation (preferred - no penalty)
+          c.hand_alternations += 1.0;
       }
     }
 
-    if (total_load > 0.0) {
-      double actual_balance = left_load / total_load;
-      double imbalance = std::abs(actual_balance - balance_target);
-      // Quadratic penalty for imbalance
-      penalty += balance_weight * imbalance * imbalance * 100.0;
+    // Process trigrams (three consecutive keys on same hand)
+    if (prev_prev_pos >= 0 && g.same_hand(prev_prev_pos, prev_pos, curr_pos)) {
+      c.same_hand_trigrams += 1.0;
+      c.trigram += g.finger_tri_cost[g.finger_triple(prev_prev_pos, prev_pos, curr_pos)];
     }
+
+    prev_prev_pos = prev_pos;
+    prev_pos = curr_pos;
   }
 
-  return penalty;
+  return c;
 }
 
-// Calculate effort including rule penalties
-double calculate_effort_with_rules(
-    const std::vector<char>& layout_keys,
-    const std::vector<double>& pos_x,
-    const std::vector<double>& pos_y,
-    const std::vector<int>& pos_row,
-    const std::vector<int>& pos_col,
-    const std::string& text,
-    const std::vector<double>& char_freq,
-    const std::vector<char>& char_list,
-    double w_base,
-    double w_same_finger,
-    double w_same_hand,
-    double w_row_change,
-    double w_trigram,
-    // Rule parameters - now use character vectors for keys
-    const std::vector<char>& hand_pref_keys,
-    const std::vector<int>& hand_pref_targets,
-    double hand_pref_weight,
-    const std::vector<char>& row_pref_keys,
-    const std::vector<int>& row_pref_targets,
-    double row_pref_weight,
-    double balance_target,
-    double balance_weight
+// Decode a layout and its text and score them
+static EffortComponents layout_components(
+    CharacterVector layout,
+    NumericVector pos_x,
+    NumericVector pos_y,
+    IntegerVector pos_row,
+    IntegerVector pos_col,
+    IntegerVector pos_layer,
+    CharacterVector text_samples,
+    NumericVector char_freq,
+    CharacterVector char_list
 ) {
-  double base_effort = calculate_effort(
-    layout_keys, pos_x, pos_y, pos_row, pos_col,
-    text, char_freq, char_list,
-    w_base, w_same_finger, w_same_hand, w_row_change, w_trigram
+  if (pos_layer.size() != 0 && pos_layer.size() != pos_x.size()) {
+    stop("pos_layer must be empty or have one entry per key position");
+  }
+  Geometry g = make_geometry(
+    Rcpp::as<std::vector<double>>(pos_x),
+    Rcpp::as<std::vector<double>>(pos_y),
+    Rcpp::as<std::vector<int>>(pos_row),
+    Rcpp::as<std::vector<int>>(pos_col),
+    Rcpp::as<std::vector<int>>(pos_layer)
   );
+  if (layout.size() != g.n) stop("layout and key positions must have the same length");
 
-  double rule_penalty = calculate_rule_penalties(
-    layout_keys, pos_row, pos_col, char_freq, char_list,
-    hand_pref_keys, hand_pref_targets, hand_pref_weight,
-    row_pref_keys, row_pref_targets, row_pref_weight,
-    balance_target, balance_weight
+  LayoutSymbols ls = layout_symbols(layout);
+  SymbolLookup lookup(ls.codepoints);
+  EncodedText text = encode_text(text_samples, lookup);
+  std::vector<double> freq = symbol_frequencies(
+    char_list, Rcpp::as<std::vector<double>>(char_freq), lookup, ls.codepoints.size()
   );
-
-  return base_effort + rule_penalty;
+  return calculate_effort(g, ls.pos_of_sym, text.symbols, text.n_chars, freq);
 }
 
 // -----------------------------------------------------------------
@@ -594,40 +564,17 @@ double layout_effort(
     double w_same_finger = 3.0,
     double w_same_hand = 1.0,
     double w_row_change = 0.5,
-    double w_trigram = 0.3
+    double w_trigram = 0.3,
+    double w_layer = 1.0,
+    IntegerVector pos_layer = IntegerVector::create()
 ) {
-  int n = layout.size();
-  std::vector<char> layout_keys(n);
-  for (int i = 0; i < n; i++) {
-    std::string s = Rcpp::as<std::string>(layout[i]);
-    layout_keys[i] = s.empty() ? ' ' : s[0];
-  }
-
-  std::vector<double> px = Rcpp::as<std::vector<double>>(pos_x);
-  std::vector<double> py = Rcpp::as<std::vector<double>>(pos_y);
-  std::vector<int> pr = Rcpp::as<std::vector<int>>(pos_row);
-  std::vector<int> pc = Rcpp::as<std::vector<int>>(pos_col);
-
-  std::string combined_text;
-  for (int i = 0; i < text_samples.size(); i++) {
-    combined_text += Rcpp::as<std::string>(text_samples[i]) + " ";
-  }
-
-  std::vector<double> cf = Rcpp::as<std::vector<double>>(char_freq);
-  std::vector<char> cl(char_list.size());
-  for (int i = 0; i < char_list.size(); i++) {
-    std::string s = Rcpp::as<std::string>(char_list[i]);
-    cl[i] = s.empty() ? ' ' : s[0];
-  }
-
-  return calculate_effort(
-    layout_keys, px, py, pr, pc,
-    combined_text, cf, cl,
-    w_base, w_same_finger, w_same_hand, w_row_change, w_trigram
-  );
+  EffortComponents c = layout_components(layout, pos_x, pos_y, pos_row, pos_col, pos_layer,
+                                         text_samples, char_freq, char_list);
+  EffortWeights w = {w_base, w_same_finger, w_same_hand, w_row_change, w_trigram, w_layer};
+  return c.total(w);
 }
 
-// Get detailed effort breakdown
+// Get detailed effort breakdown; total_effort is weighted as in layout_effort()
 // [[Rcpp::export]]
 List effort_breakdown(
     CharacterVector layout,
@@ -637,140 +584,32 @@ List effort_breakdown(
     IntegerVector pos_col,
     CharacterVector text_samples,
     NumericVector char_freq,
-    CharacterVector char_list
+    CharacterVector char_list,
+    double w_base = 1.0,
+    double w_same_finger = 3.0,
+    double w_same_hand = 1.0,
+    double w_row_change = 0.5,
+    double w_trigram = 0.3,
+    double w_layer = 1.0,
+    IntegerVector pos_layer = IntegerVector::create()
 ) {
-  int n = layout.size();
-  std::vector<char> layout_keys(n);
-  for (int i = 0; i < n; i++) {
-    std::string s = Rcpp::as<std::string>(layout[i]);
-    layout_keys[i] = s.empty() ? ' ' : s[0];
-  }
-
-  std::vector<double> px = Rcpp::as<std::vector<double>>(pos_x);
-  std::vector<double> py = Rcpp::as<std::vector<double>>(pos_y);
-  std::vector<int> pr = Rcpp::as<std::vector<int>>(pos_row);
-  std::vector<int> pc = Rcpp::as<std::vector<int>>(pos_col);
-
-  std::string combined_text;
-  for (int i = 0; i < text_samples.size(); i++) {
-    combined_text += Rcpp::as<std::string>(text_samples[i]) + " ";
-  }
-
-  std::vector<double> cf = Rcpp::as<std::vector<double>>(char_freq);
-  std::vector<char> cl(char_list.size());
-  for (int i = 0; i < char_list.size(); i++) {
-    std::string s = Rcpp::as<std::string>(char_list[i]);
-    cl[i] = s.empty() ? ' ' : s[0];
-  }
-
-  // Build char -> position mapping
-  std::unordered_map<char, int> char_to_pos;
-  for (int i = 0; i < n; i++) {
-    char_to_pos[layout_keys[i]] = i;
-    if (layout_keys[i] >= 'a' && layout_keys[i] <= 'z') {
-      char_to_pos[layout_keys[i] - 32] = i;
-    }
-  }
-
-  // Calculate fingers based on x position (layout-independent)
-  double min_x = *std::min_element(px.begin(), px.end());
-  double max_x = *std::max_element(px.begin(), px.end());
-
-  std::vector<int> fingers(n), hands(n);
-  for (int i = 0; i < n; i++) {
-    fingers[i] = get_finger_for_x_position(px[i], min_x, max_x);
-    hands[i] = get_hand_for_finger(fingers[i]);
-  }
-
-  double base_effort = 0.0;
-  double same_finger_effort = 0.0;
-  double same_hand_effort = 0.0;
-  double row_change_effort = 0.0;
-  double trigram_effort = 0.0;
-  int same_finger_count = 0;
-  int same_hand_count = 0;
-  int hand_alternation_count = 0;
-  int trigram_count = 0;
-
-  // Get text length for proper scaling (must match calculate_effort)
-  double text_len = static_cast<double>(combined_text.length());
-
-  // Base effort
-  for (size_t i = 0; i < cl.size(); i++) {
-    char c = cl[i];
-    auto it = char_to_pos.find(c);
-    if (it == char_to_pos.end() && c >= 'A' && c <= 'Z') {
-      it = char_to_pos.find(c + 32);
-    }
-    if (it != char_to_pos.end()) {
-      int pos = it->second;
-      // CRITICAL: Must scale by text_len to match calculate_effort()
-      // Use x-position-based effort (layout-independent!)
-      base_effort += base_key_effort_x(pr[pos], px[pos], fingers[pos], min_x, max_x) * cf[i] * text_len;
-    }
-  }
-
-  // Bigram and trigram analysis
-  int prev_prev_pos = -1;
-  int prev_pos = -1;
-  for (size_t i = 0; i < combined_text.length(); i++) {
-    char c = std::tolower(combined_text[i]);
-    auto it = char_to_pos.find(c);
-    if (it == char_to_pos.end()) continue;
-
-    int curr_pos = it->second;
-
-    // Bigram analysis
-    if (prev_pos >= 0) {
-      if (fingers[prev_pos] == fingers[curr_pos] && prev_pos != curr_pos) {
-        same_finger_count++;
-        same_finger_effort += same_finger_penalty(
-          pr[prev_pos], pr[curr_pos], pc[prev_pos], pc[curr_pos]
-        );
-      } else if (hands[prev_pos] == hands[curr_pos]) {
-        same_hand_count++;
-        same_hand_effort += same_hand_penalty(
-          pr[prev_pos], pr[curr_pos], pc[prev_pos], pc[curr_pos],
-          fingers[prev_pos], fingers[curr_pos]
-        );
-        row_change_effort += row_change_penalty(pr[prev_pos], pr[curr_pos]);
-      } else {
-        hand_alternation_count++;
-      }
-    }
-
-    // Trigram analysis
-    if (prev_prev_pos >= 0 && prev_pos >= 0) {
-      int hand0 = hands[prev_prev_pos];
-      int hand1 = hands[prev_pos];
-      int hand2 = hands[curr_pos];
-
-      if (hand0 == hand1 && hand1 == hand2) {
-        trigram_count++;
-        bool is_left = (hand0 == 0);
-        trigram_effort += same_hand_trigram_penalty(
-          fingers[prev_prev_pos], fingers[prev_pos], fingers[curr_pos], is_left
-        );
-      }
-    }
-
-    prev_prev_pos = prev_pos;
-    prev_pos = curr_pos;
-  }
+  EffortComponents c = layout_components(layout, pos_x, pos_y, pos_row, pos_col, pos_layer,
+                                         text_samples, char_freq, char_list);
+  EffortWeights w = {w_base, w_same_finger, w_same_hand, w_row_change, w_trigram, w_layer};
 
   return List::create(
-    Named("base_effort") = base_effort,
-    Named("same_finger_effort") = same_finger_effort,
-    Named("same_hand_effort") = same_hand_effort,
-    Named("row_change_effort") = row_change_effort,
-    Named("trigram_effort") = trigram_effort,
-    Named("total_effort") = base_effort + 3.0 * same_finger_effort +
-                            same_hand_effort + 0.5 * row_change_effort +
-                            0.3 * trigram_effort,
-    Named("same_finger_bigrams") = same_finger_count,
-    Named("same_hand_bigrams") = same_hand_count,
-    Named("hand_alternations") = hand_alternation_count,
-    Named("same_hand_trigrams") = trigram_count
+    Named("base_effort") = c.base,
+    Named("same_finger_effort") = c.same_finger,
+    Named("same_hand_effort") = c.same_hand,
+    Named("row_change_effort") = c.row_change,
+    Named("trigram_effort") = c.trigram,
+    Named("layer_effort") = c.layer,
+    Named("total_effort") = c.total(w),
+    Named("same_finger_bigrams") = static_cast<int>(c.same_finger_bigrams),
+    Named("same_hand_bigrams") = static_cast<int>(c.same_hand_bigrams),
+    Named("hand_alternations") = static_cast<int>(c.hand_alternations),
+    Named("same_hand_trigrams") = static_cast<int>(c.same_hand_trigrams),
+    Named("layer_switches") = static_cast<int>(c.layer_switches)
   );
 }
 
@@ -0,0 +1,817 @@
+// keyboard_model.h
+// Shared declarations for the effort model, compiled corpus statistics
+// and the table-driven evaluator.
+
+#ifndef LBKEYBOARD_KEYBOARD_MODEL_H
+#define LBKEYBOARD_KEYBOARD_MODEL_H
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// -----------------------------------------------------------------
+// EFFORT MODEL (defined in genetic_keyboard.cpp)
+// -----------------------------------------------------------------
+
+int get_finger_for_x_position(double x_mid, double min_x, double max_x);
+int get_hand_for_finger(int finger);
+double base_key_effort_x(int row, double x_mid, int finger, double min_x, double max_x);
+double same_finger_penalty(int row1, int row2, int col1, int col2);
+double same_hand_penalty(int row1, int row2, int col1, int col2, int finger1, int finger2);
+double row_change_penalty(int row1, int row2);
+double same_hand_trigram_penalty(int finger1, int finger2, int finger3, bool is_left);
+double layer_penalty(int layer);
+
+struct EffortWeights {
+  double base;
+  double same_finger;
+  double same_hand;
+  double row_change;
+  double trigram;
+  double layer;
+};
+
+// How a bigram is typed, as counted by effort_breakdown()
+enum PairClass {
+  PAIR_ALTERNATION = 0,
+  PAIR_SAME_FINGER = 1,
+  PAIR_SAME_HAND = 2
+};
+
+// Per-position data derived once from the key coordinates, with the
+// unweighted penalty of every position pair and finger triple, so the
+// effort model never has to re-derive fingers or distances while scoring
+struct Geometry {
+  int n;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<int> row;
+  std::vector<int> col;
+  std::vector<int> layer;                // 0 = base, 1 = shift, 2 = AltGr, ...
+  std::vector<int> key;                  // physical key; layers of a key share it
+  std::vector<int> finger;
+  std::vector<int> hand;
+  std::vector<double> base_cost;         // unweighted base effort per position
+
+  // n * n, row-major (first, second)
+  std::vector<unsigned char> pair_class;
+  std::vector<double> same_finger_cost;
+  std::vector<double> same_hand_cost;
+  std::vector<double> row_change_cost;
+  std::vector<double> layer_cost;        // modifier press to reach q's layer
+
+  // 10 * 10 * 10 same-hand trigram penalty per finger triple
+  std::vector<double> finger_tri_cost;
+
+  int pair(int p, int q) const { return p * n + q; }
+
+  int finger_triple(int p0, int p1, int p2) const {
+    return (finger[p0] * 10 + finger[p1]) * 10 + finger[p2];
+  }
+
+  bool same_hand(int p0, int p1, int p2) const {
+    return hand[p0] == hand[p1] && hand[p1] == hand[p2];
+  }
+};
+
+// Positions with the same row and column are layers of one physical key;
+// an empty pos_layer puts every position on the base layer
+Geometry make_geometry(
+    const std::vector<double>& pos_x,
+    const std::vector<double>& pos_y,
+    const std::vector<int>& pos_row,
+    const std::vector<int>& pos_col,
+    const std::vector<int>& pos_layer = std::vector<int>()
+);
+
+// Geometry costs multiplied by one set of effort weights: scoring a
+// layout is then nothing but table lookups
+struct CostTables {
+  int n;
+  EffortWeights weights;
+  std::vector<int> finger;
+  std::vector<double> base;        // n, weighted base cost per position
+  std::vector<double> pair;        // n * n, weighted cost of q right after p
+  std::vector<double> finger_tri;  // 1000, weighted trigram cost per finger triple
+
+  // Copies for the effort kernels, where a symbol that is not on the
+  // layout sits at position n on finger 10, both of which cost nothing
+  std::vector<double> pair_padded;        // n * (n + 1)
+  std::vector<double> finger_tri_padded;  // 11 * 11 * 11
+
+  CostTables() : n(0), weights() {}
+  CostTables(const Geometry& g, const EffortWeights& w);
+
+  double bigram(int p, int q) const { return pair[p * n + q]; }
+
+  double trigram(int p0, int p1, int p2) const {
+    return finger_tri[(finger[p0] * 10 + finger[p1]) * 10 + finger[p2]];
+  }
+};
+
+// A keyboard's geometry together with its weighted cost tables. Built
+// once per keyboard (keyboard_geometry() in R) and shared read-only by
+// every evaluator and optimizer.
+struct KeyboardGeometry {
+  Geometry geometry;
+  CostTables costs;
+
+  KeyboardGeometry(const Geometry& g, const EffortWeights& w)
+    : geometry(g), costs(g, w) {}
+};
+
+// -----------------------------------------------------------------
+// UTF-8 HANDLING (defined in corpus_stats.cpp)
+// -----------------------------------------------------------------
+
+// Decode UTF-8 into codepoints; invalid bytes become U+FFFD
+void decode_utf8(const std::string& s, std::vector<uint32_t>& out);
+uint32_t fold_case(uint32_t cp);
+bool is_alpha_codepoint(uint32_t cp);
+std::string encode_utf8(uint32_t cp);
+
+// Dense codepoint -> symbol lookup (case-folded), -1 for unknown
+struct SymbolLookup {
+  std::vector<int> table;
+
+  explicit SymbolLookup(const std::vector<uint32_t>& codepoints) {
+    uint32_t max_cp = 0;
+    for (size_t i = 0; i < codepoints.size(); i++) {
+      max_cp = std::max(max_cp, codepoints[i]);
+    }
+    table.assign(max_cp + 1, -1);
+    for (size_t i = 0; i < codepoints.size(); i++) {
+      table[codepoints[i]] = i;
+    }
+  }
+
+  int operator()(uint32_t cp) const {
+    cp = fold_case(cp);
+    return cp < table.size() ? table[cp] : -1;
+  }
+};
+
+// -----------------------------------------------------------------
+// COMPILED CORPUS STATISTICS (defined in corpus_stats.cpp)
+// -----------------------------------------------------------------
+
+struct Trigram {
+  int a;
+  int b;
+  int c;
+  double count;
+};
+
+// One batch of text in a corpus, in stream order. Its first and last two
+// symbols are enough to update the n-grams across the joins with its
+// neighbours when a batch is appended or removed.
+struct CorpusBatch {
+  uint64_t source_hash;  // of the text samples, 0 if unknown (files)
+  double n_chars;
+  double n_alpha;
+  int head[2];
+  int tail[2];           // tail[0] is -1 when the batch has one symbol
+  int n;                 // symbols in the batch, capped at 2
+};
+
+// N-gram counts over a fixed symbol alphabet (the optimized key set).
+// Text is case-folded and characters outside the alphabet are skipped
+// without breaking the sequence, exactly as calculate_effort() does.
+struct CorpusStats {
+  std::vector<std::string> symbols;   // UTF-8 label of each symbol
+  std::vector<uint32_t> codepoints;   // codepoint of each symbol
+  std::vector<double> unigram;        // k
+  std::vector<double> bigram;         // k * k, row-major (first, second)
+  std::vector<Trigram> trigrams;      // sparse, sorted by (a, b, c)
+  double n_chars;                     // text length incl. sample separators
+  double n_alpha;                     // alphabetic characters in the text
+  std::vector<CorpusBatch> batches;   // text batches, empty for mixes
+  uint64_t revision;                  // bumped by every in-place update
+
+  CorpusStats() : n_chars(0.0), n_alpha(0.0), revision(0) {}
+
+  int size() const { return static_cast<int>(symbols.size()); }
+
+  // Factor turning unigram counts into the legacy `freq * text_len` scale
+  double base_scale() const { return n_alpha > 0.0 ? n_chars / n_alpha : 0.0; }
+};
+
+CorpusStats compile_corpus_stats(
+    const std::vector<std::string>& text_samples,
+    const std::vector<std::string>& keys
+);
+
+// Same counts as compile_corpus_stats() with one sample per file. Files
+// are streamed in chunks of chunk_bytes and the chunks are counted in
+// parallel, so memory use does not grow with the file size.
+CorpusStats compile_corpus_files(
+    const std::vector<std::string>& paths,
+    const std::vector<std::string>& keys,
+    size_t chunk_bytes,
+    int n_threads
+);
+
+// Weighted mix of corpora compiled for the same keys. Each corpus is first
+// normalized to the same length, so weights are shares of the text rather
+// than multipliers of its raw size, and the mix is sized like all corpora
+// together: effort on it is sum_i weights[i] / sum(weights) * effort_i *
+// N / n_chars_i, with N the total length. Unigrams are rescaled so the
+// mix's base_scale() reproduces every corpus's own base term.
+CorpusStats combine_corpus_stats(
+    const std::vector<const CorpusStats*>& corpora,
+    const std::vector<double>& weights
+);
+
+// Change to the counts of a corpus from appending or removing one batch.
+// Bigrams and trigrams are sparse, so the n-grams a batch touches can be
+// re-scored without visiting the whole corpus.
+struct CorpusDelta {
+  std::vector<double> unigram;                  // k
+  std::vector<std::pair<int, double> > bigram;  // (first * k + second, count)
+  std::vector<Trigram> trigrams;                // sorted by (a, b, c)
+  double n_chars;
+  double n_alpha;
+};
+
+// Append text samples to a corpus as a new batch, counting the n-grams
+// across the join with the previous text. The counts are updated in place
+// and the change is returned. Equivalent to compiling all the text at once.
+CorpusDelta append_corpus_text(
+    CorpusStats& corpus,
+    const std::vector<std::string>& text_samples
+);
+
+// Remove the oldest batch, given its text again, with the n-grams across
+// its join with the next batch. The text must be the one that was
+// appended, which is checked against the batch's hash and edges.
+CorpusDelta remove_corpus_text(
+    CorpusStats& corpus,
+    const std::vector<std::string>& text_samples
+);
+
+// 64-bit FNV-1a hash of strings, as used for corpus cache identities
+// (defined in corpus_cache.cpp)
+uint64_t strings_hash(const std::vector<std::string>& parts);
+
+// Symbol index of a one-character label, -1 if it is not in the corpus
+int find_symbol(const CorpusStats& corpus, const std::string& label);
+
+// Total effort for a layout given as symbol -> position (-1 = not placed)
+// (defined in effort_kernel.cpp)
+double corpus_effort(
+    const CorpusStats& corpus,
+    const CostTables& costs,
+    const std::vector<int>& pos_of_sym
+);
+
+// Kernels behind corpus_effort(). AVX2 is used when the CPU supports it;
+// both kernels sum in the same order and return bit-identical efforts
+// unless the compiler is told to fuse multiply-adds.
+enum EffortKernel { KERNEL_SCALAR, KERNEL_AVX2 };
+
+bool effort_kernel_supported(EffortKernel kernel);
+EffortKernel effort_kernel();
+void set_effort_kernel(EffortKernel kernel);
+
+// Unweighted effort components and n-gram class counts for one layout,
+// as reported by effort_breakdown()
+struct EffortComponents {
+  double base;                 // already scaled like the legacy base term
+  double same_finger;
+  double same_hand;
+  double row_change;
+  double trigram;
+  double layer;
+  double same_finger_bigrams;
+  double same_hand_bigrams;
+  double hand_alternations;
+  double same_hand_trigrams;
+  double layer_switches;
+
+  // Weighted total; equals corpus_effort() for the same layout
+  double total(const EffortWeights& w) const {
+    return w.base * base + w.same_finger * same_finger + w.same_hand * same_hand +
+           w.row_change * row_change + w.trigram * trigram + w.layer * layer;
+  }
+};
+
+EffortComponents corpus_components(
+    const CorpusStats& corpus,
+    const Geometry& geometry,
+    const std::vector<int>& pos_of_sym
+);
+
+// -----------------------------------------------------------------
+// LAYOUT REPRESENTATION AND MANIPULATION
+// -----------------------------------------------------------------
+
+// A layout is a permutation of corpus symbols over key positions
+class KeyboardLayout {
+public:
+  std::vector<int> keys;  // Symbol at each position
+  int n_keys;
+
+  KeyboardLayout() : n_keys(0) {}
+
+  explicit KeyboardLayout(const std::vector<int>& k)
+    : keys(k), n_keys(k.size()) {}
+
+  // Find position index for a symbol
+  int find_key(int symbol) const {
+    for (int i = 0; i < n_keys; i++) {
+      if (keys[i] == symbol) return i;
+    }
+    return -1;  // Not found
+  }
+
+  // Swap two keys in the layout
+  void swap_keys(int i, int j) {
+    std::swap(keys[i], keys[j]);
+  }
+
+  // Get a copy with swapped keys
+  KeyboardLayout with_swap(int i, int j) const {
+    KeyboardLayout copy = *this;
+    copy.swap_keys(i, j);
+    return copy;
+  }
+
+  // Inverse mapping: position of each symbol (-1 if not placed)
+  void positions(int n_symbols, std::vector<int>& pos_of_sym) const {
+    pos_of_sym.assign(n_symbols, -1);
+    for (int i = 0; i < n_keys; i++) {
+      if (keys[i] >= 0) pos_of_sym[keys[i]] = i;
+    }
+  }
+};
+
+// -----------------------------------------------------------------
+// INCREMENTAL SWAP EVALUATION (defined in delta_eval.cpp)
+// -----------------------------------------------------------------
+
+// Tracks a layout and its effort, and scores the swap of two positions
+// from only the n-gram terms that involve the two keys being moved:
+// O(k) bigram terms plus the trigrams touching either key, instead of
+// the full O(k^2 + trigrams) recompute.
+class SwapDelta {
+public:
+  SwapDelta(const CorpusStats& corpus, const CostTables& costs);
+
+  // Start tracking a layout (full evaluation)
+  void reset(const KeyboardLayout& layout);
+
+  // Continue tracking a layout with the effort accumulated so far, so a
+  // resumed run sees the same rounding as the one that was saved
+  void restore(const KeyboardLayout& layout, double effort);
+
+  // Exact effort change if positions i and j were swapped
+  double delta(int i, int j) const;
+
+  // Swap positions i and j and update the tracked effort
+  void apply(int i, int j);
+
+  double effort() const { return effort_; }
+  const KeyboardLayout& layout() const { return layout_; }
+  const std::vector<int>& pos_of_sym() const { return pos_of_sym_; }
+
+private:
+  const CorpusStats* corpus_;
+  const CostTables* costs_;
+  std::vector<std::vector<Trigram>> tri_by_sym_;  // trigrams touching each symbol
+  KeyboardLayout layout_;
+  std::vector<int> pos_of_sym_;
+  double effort_;
+};
+
+// -----------------------------------------------------------------
+// LAYOUT RULES (defined in layout_rules.cpp)
+// -----------------------------------------------------------------
+
+// Compiled rules in symbol/position terms. Hands follow the rule
+// convention of columns 0-4 = left, 5+ = right.
+struct RuleSet {
+  std::vector<char> fixed;             // per position: key may not move
+  std::vector<int> hand_pref_syms;
+  std::vector<int> hand_pref_targets;  // 0 = left, 1 = right
+  double hand_pref_weight;
+  std::vector<int> row_pref_syms;
+  std::vector<int> row_pref_targets;
+  double row_pref_weight;
+  double balance_target;
+  double balance_weight;
+  std::vector<int> finger_pref_syms;
+  std::vector<int> finger_pref_masks;  // bit f set = finger f allowed
+  double finger_pref_weight;
+  std::vector<int> keep_syms;
+  std::vector<int> keep_positions;     // reference position of each key
+  double keep_weight;
+
+  RuleSet()
+    : hand_pref_weight(0.0), row_pref_weight(0.0),
+      balance_target(0.5), balance_weight(0.0),
+      finger_pref_weight(0.0), keep_weight(0.0) {}
+
+  bool is_fixed(int pos) const { return !fixed.empty() && fixed[pos]; }
+
+  // Whether rule_penalty() can be non-zero
+  bool has_penalties() const {
+    return !hand_pref_syms.empty() || !row_pref_syms.empty() || balance_weight > 0.0 ||
+           !finger_pref_syms.empty() || !keep_syms.empty();
+  }
+};
+
+// Positions the optimizers are allowed to permute
+std::vector<int> free_positions(const RuleSet& rules, int n_positions);
+
+// Hard-constraint repair: move keys of high-weight hand, row and finger
+// preferences onto their target region, and high-weight keep_like keys
+// back to their reference position, without touching fixed positions
+void repair_layout(KeyboardLayout& layout, const RuleSet& rules, const Geometry& g);
+
+// Soft-constraint penalty for a layout
+double rule_penalty(
+    const std::vector<int>& pos_of_sym,
+    const RuleSet& rules,
+    const Geometry& g,
+    const CorpusStats& corpus
+);
+
+class FitnessCache;
+
+// Everything needed to score a layout; shared (read-only) by all optimizers
+struct Objective {
+  const CorpusStats* corpus;
+  const Geometry* geometry;
+  const CostTables* costs;
+  const RuleSet* rules;
+  FitnessCache* cache;  // optional; used by evaluate() only
+
+  double effort(const KeyboardLayout& layout) const;
+  double penalty(const KeyboardLayout& layout) const;
+  // Effort plus rule penalties: the quantity the optimizers minimize
+  double operator()(const KeyboardLayout& layout) const;
+
+  // Score layouts[from..] into scores[from..] across n_threads threads,
+  // through the cache when there is one.
+  // Pure C++: safe to call with OpenMP, no R API use inside.
+  void evaluate(const std::vector<KeyboardLayout>& layouts, std::vector<double>& scores,
+                int from, int n_threads) const;
+};
+
+// Number of OpenMP threads to use; n_threads <= 0 means all available
+inline int resolve_threads(int n_threads) {
+#ifdef _OPENMP
+  if (n_threads <= 0) return omp_get_max_threads();
+  return n_threads;
+#else
+  return 1;
+#endif
+}
+
+// -----------------------------------------------------------------
+// FITNESS CACHE (defined in fitness_cache.cpp)
+// -----------------------------------------------------------------
+
+// Bounded map from layouts to their objective value. Late in a GA run most
+// offspring are copies or recombinations of the same few parents; with a
+// cache they cost a hash lookup instead of a pass over the corpus. Keys
+// are the layout's symbols packed into 16 bits each, hashed with FNV-1a.
+// Entries are spread over shards with their own lock, so islands scored
+// on different threads can share one cache. A full shard evicts its least
+// recently used entry, or its oldest one when `lru` is false.
+class FitnessCache {
+public:
+  FitnessCache(size_t capacity, bool lru);
+  ~FitnessCache();
+
+  // Score layouts[from..] into scores[from..] like Objective::evaluate(),
+  // computing only layouts that are not cached, each distinct one once.
+  // Lookups and inserts happen in layout order, so for one population the
+  // statistics do not depend on the number of threads.
+  void evaluate(const Objective& objective, const std::vector<KeyboardLayout>& layouts,
+                std::vector<double>& scores, int from, int n_threads);
+
+  double hits() const { return hits_; }
+  double misses() const { return misses_; }
+  double evictions() const { return evictions_; }
+  size_t capacity() const { return capacity_; }
+  size_t size() const;
+
+private:
+  typedef std::vector<uint16_t> Key;
+  struct Entry {
+    Key key;
+    double score;
+    std::list<uint64_t>::iterator age;  // position in the shard's order
+  };
+  struct Shard {
+    std::unordered_map<uint64_t, Entry> entries;
+    std::list<uint64_t> order;  // most recently used (or inserted) first
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+  };
+
+  FitnessCache(const FitnessCache&);
+  FitnessCache& operator=(const FitnessCache&);
+
+  static uint64_t hash(const Key& key);
+  Shard& shard_of(uint64_t h) { return shards_[(h >> 32) % shards_.size()]; }
+  bool lookup(const Key& key, uint64_t h, double& score);
+  void insert(const Key& key, uint64_t h, double score);
+
+  size_t capacity_;
+  size_t shard_capacity_;
+  bool lru_;
+  std::vector<Shard> shards_;
+  double hits_;
+  double misses_;
+  double evictions_;
+};
+
+// -----------------------------------------------------------------
+// TELEMETRY (defined in ga_engine.cpp)
+// -----------------------------------------------------------------
+
+// Seconds elapsed since construction or the last reset, on a monotonic clock
+class Stopwatch {
+public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+  void reset() { start_ = std::chrono::steady_clock::now(); }
+  // Continue a run that had already taken `seconds` (resumed checkpoints)
+  void resume_from(double seconds) {
+    start_ = std::chrono::steady_clock::now() -
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(seconds));
+  }
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Counters and timings of an optimizer run, one entry per generation (GA)
+// or per history block of moves (annealing). Phase times are summed over
+// the islands that did the work, so with islands they can exceed the
+// elapsed wall time.
+struct Telemetry {
+  std::vector<double> evaluations;  // evaluations during the generation
+  std::vector<double> elapsed;      // seconds since the start of the run
+  std::vector<double> diversity;    // GA: mean share of keys placed unlike the best
+  std::vector<double> acceptance;   // annealing: share of accepted moves
+  double initial_evaluations;       // evaluations before the first generation
+  double scoring_seconds;
+  double repair_seconds;
+  double variation_seconds;         // selection, crossover and mutation
+
+  Telemetry()
+    : initial_evaluations(0.0), scoring_seconds(0.0), repair_seconds(0.0),
+      variation_seconds(0.0) {}
+
+  double total_evaluations() const;
+};
+
+// Telemetry as returned to R, for a run that took `seconds` in total and
+// ended for `stop_reason`, with the statistics of its fitness cache if any
+Rcpp::List telemetry_list(const Telemetry& telemetry, double seconds,
+                          const std::string& stop_reason,
+                          const FitnessCache* cache = NULL);
+
+// What the progress callback sees after a generation
+Rcpp::List progress_info(int generation, double best, double mean, const Telemetry& telemetry,
+                         double elapsed);
+
+// Optional R function called from the main thread every `every`
+// generations with a list describing the run so far. A callback that
+// returns FALSE stops the run; a NULL callback costs nothing.
+class ProgressCallback {
+public:
+  ProgressCallback(SEXP fn, int every) : fn_(fn), every_(std::max(1, every)) {}
+  bool due(int generation) const { return !Rf_isNull(fn_) && generation % every_ == 0; }
+  // Calls the function; false if it asked to stop
+  bool report(const Rcpp::List& info) const;
+
+private:
+  SEXP fn_;
+  int every_;
+};
+
+// -----------------------------------------------------------------
+// CHECKPOINTS (defined in checkpoint.cpp)
+// -----------------------------------------------------------------
+
+// Optimizer state as a flat byte string in native byte order. Values are
+// read back in the order they were written. Checkpoints may be written
+// and read on background threads, so errors are std::runtime_error, never
+// calls into R.
+class StateWriter {
+public:
+  template <class T> void put(const T& value) {
+    bytes_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+  template <class T> void put_vector(const std::vector<T>& values) {
+    put(static_cast<uint64_t>(values.size()));
+    if (!values.empty()) {
+      bytes_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+  }
+  void put_string(const std::string& s);
+  void put_rng(const std::mt19937& rng);
+  void put_layout(const KeyboardLayout& layout);
+  void put_layouts(const std::vector<KeyboardLayout>& layouts);
+  void put_telemetry(const Telemetry& t);
+
+  const std::string& bytes() const { return bytes_; }
+
+private:
+  std::string bytes_;
+};
+
+class StateReader {
+public:
+  explicit StateReader(const std::string& bytes) : bytes_(bytes), pos_(0) {}
+
+  template <class T> T get() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+  template <class T> void get_vector(std::vector<T>& out) {
+    uint64_t n = get<uint64_t>();
+    if (n > (bytes_.size() - pos_) / sizeof(T)) corrupt();
+    out.resize(n);
+    if (n > 0) std::memcpy(out.data(), take(n * sizeof(T)), n * sizeof(T));
+  }
+  std::string get_string();
+  void get_rng(std::mt19937& rng);
+  KeyboardLayout get_layout();
+  void get_layouts(std::vector<KeyboardLayout>& layouts);
+  void get_telemetry(Telemetry& t);
+
+private:
+  const char* take(size_t n) {
+    if (n > bytes_.size() - pos_) corrupt();
+    const char* p = bytes_.data() + pos_;
+    pos_ += n;
+    return p;
+  }
+  void corrupt() const { throw std::runtime_error("checkpoint state is corrupt"); }
+
+  const std::string& bytes_;
+  size_t pos_;
+};
+
+// 64-bit FNV-1a over the bytes of the values added. Identifies the inputs
+// a checkpoint was written for; structs are added field by field, never
+// with their padding.
+class Fingerprint {
+public:
+  Fingerprint() : h_(14695981039346656037ULL) {}
+
+  template <class T> Fingerprint& add(const T& value) {
+    return add_bytes(&value, sizeof(T));
+  }
+  template <class T> Fingerprint& add(const std::vector<T>& values) {
+    add(static_cast<uint64_t>(values.size()));
+    return values.empty() ? *this : add_bytes(values.data(), values.size() * sizeof(T));
+  }
+  Fingerprint& add(const std::string& s) {
+    add(static_cast<uint64_t>(s.size()));
+    return add_bytes(s.data(), s.size());
+  }
+
+  uint64_t value() const { return h_; }
+
+private:
+  Fingerprint& add_bytes(const void* data, size_t n) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; i++) {
+      h_ ^= p[i];
+      h_ *= 1099511628211ULL;
+    }
+    return *this;
+  }
+
+  uint64_t h_;
+};
+
+uint64_t corpus_fingerprint(const CorpusStats& cs);
+uint64_t geometry_fingerprint(const KeyboardGeometry& kg);
+uint64_t rules_fingerprint(const RuleSet& rules);
+
+enum CheckpointMethod { CHECKPOINT_GENETIC = 1, CHECKPOINT_ANNEAL = 2 };
+
+// One checkpoint file: what wrote it and for which inputs, the caller's
+// settings (opaque bytes, the R arguments of the run) and the state
+struct Checkpoint {
+  CheckpointMethod method;
+  uint64_t corpus_hash;
+  uint64_t geometry_hash;
+  uint64_t rules_hash;
+  uint64_t config_hash;  // optimizer settings the state depends on
+  std::string settings;
+  std::string state;
+};
+
+// Written to `path`.tmp, flushed to disk and renamed over `path`, so a
+// crash leaves either the previous checkpoint or the new one
+void write_checkpoint(const std::string& path, const Checkpoint& checkpoint);
+Checkpoint read_checkpoint(const std::string& path);
+
+// Where and how often a run saves its state; `header` is the checkpoint
+// without state, filled in before the run starts
+struct CheckpointPlan {
+  std::string path;  // empty: no checkpoints
+  int every;         // generations (annealing: history blocks) between writes
+  Checkpoint header;
+
+  CheckpointPlan() : every(0) {}
+  // Whether a run at `step` that last saved at step `saved` saves again
+  bool due(int step, int saved) const {
+    return !path.empty() && every > 0 && step - saved >= every;
+  }
+  void write(const StateWriter& state) const {
+    Checkpoint checkpoint = header;
+    checkpoint.state = state.bytes();
+    write_checkpoint(path, checkpoint);
+  }
+};
+
+// -----------------------------------------------------------------
+// SEARCH OPERATORS (defined in ga_engine.cpp)
+// All operators only move keys between free positions.
+// -----------------------------------------------------------------
+
+// Random permutation of the keys on free positions
+KeyboardLayout shuffle_free(const KeyboardLayout& layout, const std::vector<int>& free,
+                            std::mt19937& rng);
+
+// Swap two distinct free positions
+void swap_mutation(KeyboardLayout& layout, const std::vector<int>& free, std::mt19937& rng);
+
+// Order crossover (OX) on the sequence of free positions
+KeyboardLayout order_crossover(const KeyboardLayout& p1, const KeyboardLayout& p2,
+                               const std::vector<int>& free, std::mt19937& rng);
+
+// Partially mapped crossover (PMX) on the sequence of free positions
+KeyboardLayout pmx_crossover(const KeyboardLayout& p1, const KeyboardLayout& p2,
+                             const std::vector<int>& free, std::mt19937& rng);
+
+// -----------------------------------------------------------------
+// R INTERFACE HELPERS
+// -----------------------------------------------------------------
+
+CorpusStats& corpus_ref(SEXP corpus);
+KeyboardGeometry& geometry_ref(SEXP geometry);
+
+// Map a CharacterVector layout onto corpus symbols (error on unknown keys)
+KeyboardLayout layout_from_labels(const CorpusStats& corpus, Rcpp::CharacterVector layout);
+Rcpp::CharacterVector layout_labels(const CorpusStats& corpus, const KeyboardLayout& layout);
+
+// Rows of 1-based indices into `keys`, one column per key position, as
+// passed by layout_effort_batch(); error unless every row is a permutation
+std::vector<KeyboardLayout> layouts_from_indices(
+    const CorpusStats& corpus,
+    Rcpp::IntegerMatrix layouts,
+    Rcpp::CharacterVector keys,
+    int n_positions
+);
+
+RuleSet rules_from_list(
+    Rcpp::List compiled_rules,
+    Rcpp::LogicalVector fixed,
+    const CorpusStats& corpus
+);
+
+// Checkpoint plan for a run on these inputs. `settings` is a raw vector
+// stored with every checkpoint, or NULL; `resume` reads `path` back into
+// `resumed`, with an error unless it was written for the same inputs.
+CheckpointPlan checkpoint_plan(
+    CheckpointMethod method,
+    const CorpusStats& corpus,
+    const KeyboardGeometry& kg,
+    const RuleSet& rules,
+    uint64_t config_hash,
+    const std::string& path,
+    int every,
+    SEXP settings,
+    bool resume,
+    Checkpoint& resumed
+);
+
+#endif
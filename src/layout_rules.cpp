@@ -0,0 +1,274 @@
+// layout_rules.cpp
+// Native layout rules: fixed positions, hard-constraint repair and
+// soft-constraint penalties, plus the shared optimization objective.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// FIXED POSITIONS AND REPAIR
+// -----------------------------------------------------------------
+
+std::vector<int> free_positions(const RuleSet& rules, int n_positions) {
+  std::vector<int> free;
+  for (int i = 0; i < n_positions; i++) {
+    if (!rules.is_fixed(i)) free.push_back(i);
+  }
+  return free;
+}
+
+// Rules use the column convention: 0-4 = left hand, 5+ = right hand
+static int rule_hand(const Geometry& g, int pos) {
+  return g.col[pos] < 5 ? 0 : 1;
+}
+
+static bool contains(const std::vector<int>& v, int x) {
+  return std::find(v.begin(), v.end(), x) != v.end();
+}
+
+// Keys a repair step may not displace to make room for another key
+static bool has_placement_rule(const RuleSet& rules, int sym) {
+  return contains(rules.hand_pref_syms, sym) || contains(rules.row_pref_syms, sym) ||
+         contains(rules.finger_pref_syms, sym) || contains(rules.keep_syms, sym);
+}
+
+void repair_layout(KeyboardLayout& layout, const RuleSet& rules, const Geometry& g) {
+  // High-weight hand preferences act as hard constraints (weight >= 2.0)
+  if (rules.hand_pref_weight >= 2.0) {
+    for (size_t i = 0; i < rules.hand_pref_syms.size(); i++) {
+      int pos = layout.find_key(rules.hand_pref_syms[i]);
+      if (pos < 0 || rules.is_fixed(pos)) continue;
+      int target = rules.hand_pref_targets[i];
+      if (rule_hand(g, pos) == target) continue;
+
+      // Swap with the first movable key on the target hand that has no
+      // hand preference of its own
+      for (int t = 0; t < layout.n_keys; t++) {
+        if (rule_hand(g, t) != target || rules.is_fixed(t)) continue;
+        if (contains(rules.hand_pref_syms, layout.keys[t])) continue;
+        layout.swap_keys(pos, t);
+        break;
+      }
+    }
+  }
+
+  // High-weight row preferences act as hard constraints (weight >= 1.5)
+  if (rules.row_pref_weight >= 1.5) {
+    for (size_t i = 0; i < rules.row_pref_syms.size(); i++) {
+      int pos = layout.find_key(rules.row_pref_syms[i]);
+      if (pos < 0 || rules.is_fixed(pos)) continue;
+      int target = rules.row_pref_targets[i];
+      if (g.row[pos] == target) continue;
+
+      // Don't displace keys that carry a row or hand preference
+      for (int t = 0; t < layout.n_keys; t++) {
+        if (g.row[t] != target || rules.is_fixed(t)) continue;
+        int other = layout.keys[t];
+        if (contains(rules.row_pref_syms, other) || contains(rules.hand_pref_syms, other)) {
+          continue;
+        }
+        layout.swap_keys(pos, t);
+        break;
+      }
+    }
+  }
+
+  // High-weight finger preferences act as hard constraints (weight >= 2.0)
+  if (rules.finger_pref_weight >= 2.0) {
+    for (size_t i = 0; i < rules.finger_pref_syms.size(); i++) {
+      int pos = layout.find_key(rules.finger_pref_syms[i]);
+      if (pos < 0 || rules.is_fixed(pos)) continue;
+      int mask = rules.finger_pref_masks[i];
+      if (mask & (1 << g.finger[pos])) continue;
+
+      for (int t = 0; t < layout.n_keys; t++) {
+        if (!(mask & (1 << g.finger[t])) || rules.is_fixed(t)) continue;
+        if (has_placement_rule(rules, layout.keys[t])) continue;
+        layout.swap_keys(pos, t);
+        break;
+      }
+    }
+  }
+
+  // High-weight keep_like rules put keys back on their reference position
+  // (weight >= 2.0)
+  if (rules.keep_weight >= 2.0) {
+    for (size_t i = 0; i < rules.keep_syms.size(); i++) {
+      int pos = layout.find_key(rules.keep_syms[i]);
+      int target = rules.keep_positions[i];
+      if (pos < 0 || pos == target || rules.is_fixed(pos) || rules.is_fixed(target)) continue;
+      layout.swap_keys(pos, target);
+    }
+  }
+}
+
+// -----------------------------------------------------------------
+// SOFT-CONSTRAINT PENALTIES
+// -----------------------------------------------------------------
+
+double rule_penalty(
+    const std::vector<int>& pos_of_sym,
+    const RuleSet& rules,
+    const Geometry& g,
+    const CorpusStats& corpus
+) {
+  double penalty = 0.0;
+
+  // Hand preference: large per-violation penalty so that rules the repair
+  // step could not satisfy still dominate the effort term
+  for (size_t i = 0; i < rules.hand_pref_syms.size(); i++) {
+    int pos = pos_of_sym[rules.hand_pref_syms[i]];
+    if (pos >= 0 && rule_hand(g, pos) != rules.hand_pref_targets[i]) {
+      penalty += rules.hand_pref_weight * 100000.0;
+    }
+  }
+
+  // Row preference
+  for (size_t i = 0; i < rules.row_pref_syms.size(); i++) {
+    int pos = pos_of_sym[rules.row_pref_syms[i]];
+    if (pos >= 0 && g.row[pos] != rules.row_pref_targets[i]) {
+      penalty += rules.row_pref_weight * 1000.0;
+    }
+  }
+
+  // Finger preference
+  for (size_t i = 0; i < rules.finger_pref_syms.size(); i++) {
+    int pos = pos_of_sym[rules.finger_pref_syms[i]];
+    if (pos >= 0 && !(rules.finger_pref_masks[i] & (1 << g.finger[pos]))) {
+      penalty += rules.finger_pref_weight * 1000.0;
+    }
+  }
+
+  // Keys away from their keep_like reference position
+  for (size_t i = 0; i < rules.keep_syms.size(); i++) {
+    int pos = pos_of_sym[rules.keep_syms[i]];
+    if (pos >= 0 && pos != rules.keep_positions[i]) {
+      penalty += rules.keep_weight * 1000.0;
+    }
+  }
+
+  // Hand balance: share of keystrokes typed by the left hand
+  if (rules.balance_weight > 0.0) {
+    double left_load = 0.0;
+    double total_load = 0.0;
+    for (int s = 0; s < corpus.size(); s++) {
+      int pos = pos_of_sym[s];
+      if (pos < 0) continue;
+      total_load += corpus.unigram[s];
+      if (rule_hand(g, pos) == 0) left_load += corpus.unigram[s];
+    }
+    if (total_load > 0.0) {
+      double balance_error = std::abs(left_load / total_load - rules.balance_target);
+      penalty += balance_error * rules.balance_weight * 500.0;
+    }
+  }
+
+  return penalty;
+}
+
+// -----------------------------------------------------------------
+// OPTIMIZATION OBJECTIVE
+// -----------------------------------------------------------------
+
+double Objective::effort(const KeyboardLayout& layout) const {
+  std::vector<int> pos_of_sym;
+  layout.positions(corpus->size(), pos_of_sym);
+  return corpus_effort(*corpus, *costs, pos_of_sym);
+}
+
+double Objective::penalty(const KeyboardLayout& layout) const {
+  std::vector<int> pos_of_sym;
+  layout.positions(corpus->size(), pos_of_sym);
+  return rule_penalty(pos_of_sym, *rules, *geometry, *corpus);
+}
+
+double Objective::operator()(const KeyboardLayout& layout) const {
+  std::vector<int> pos_of_sym;
+  layout.positions(corpus->size(), pos_of_sym);
+  return corpus_effort(*corpus, *costs, pos_of_sym) +
+         rule_penalty(pos_of_sym, *rules, *geometry, *corpus);
+}
+
+void Objective::evaluate(const std::vector<KeyboardLayout>& layouts, std::vector<double>& scores,
+                         int from, int n_threads) const {
+  if (cache != NULL) {
+    cache->evaluate(*this, layouts, scores, from, n_threads);
+    return;
+  }
+  int n = layouts.size();
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(n_threads) schedule(static) if (n_threads > 1)
+#endif
+  for (int i = from; i < n; i++) {
+    scores[i] = (*this)(layouts[i]);
+  }
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Resolve rule keys to corpus symbols; keys not in the corpus are dropped
+static void rule_symbols(
+    const CorpusStats& corpus,
+    CharacterVector keys,
+    IntegerVector targets,
+    std::vector<int>& syms,
+    std::vector<int>& out_targets
+) {
+  for (int i = 0; i < keys.size(); i++) {
+    int s = find_symbol(corpus, Rcpp::as<std::string>(keys[i]));
+    if (s < 0) continue;
+    syms.push_back(s);
+    out_targets.push_back(targets[i]);
+  }
+}
+
+// Convert the list produced by compile_rules() into a RuleSet
+RuleSet rules_from_list(List compiled_rules, LogicalVector fixed, const CorpusStats& corpus) {
+  RuleSet rules;
+  rules.fixed.resize(fixed.size());
+  for (int i = 0; i < fixed.size(); i++) {
+    rules.fixed[i] = fixed[i] == TRUE;
+  }
+  if (compiled_rules.size() == 0) return rules;
+
+  rule_symbols(corpus,
+               as<CharacterVector>(compiled_rules["hand_pref_keys"]),
+               as<IntegerVector>(compiled_rules["hand_pref_targets"]),
+               rules.hand_pref_syms, rules.hand_pref_targets);
+  rules.hand_pref_weight = as<double>(compiled_rules["hand_pref_weight"]);
+
+  rule_symbols(corpus,
+               as<CharacterVector>(compiled_rules["row_pref_keys"]),
+               as<IntegerVector>(compiled_rules["row_pref_targets"]),
+               rules.row_pref_syms, rules.row_pref_targets);
+  rules.row_pref_weight = as<double>(compiled_rules["row_pref_weight"]);
+
+  rules.balance_target = as<double>(compiled_rules["balance_target"]);
+  rules.balance_weight = as<double>(compiled_rules["balance_weight"]);
+
+  rule_symbols(corpus,
+               as<CharacterVector>(compiled_rules["finger_pref_keys"]),
+               as<IntegerVector>(compiled_rules["finger_pref_masks"]),
+               rules.finger_pref_syms, rules.finger_pref_masks);
+  rules.finger_pref_weight = as<double>(compiled_rules["finger_pref_weight"]);
+
+  rule_symbols(corpus,
+               as<CharacterVector>(compiled_rules["keep_like_keys"]),
+               as<IntegerVector>(compiled_rules["keep_like_positions"]),
+               rules.keep_syms, rules.keep_positions);
+  for (size_t i = 0; i < rules.keep_positions.size(); i++) {
+    if (rules.keep_positions[i] < 0 || rules.keep_positions[i] >= fixed.size()) {
+      stop("keep_like positions must be within the layout");
+    }
+  }
+  rules.keep_weight = as<double>(compiled_rules["keep_like_weight"]);
+  return rules;
+}
@@ -0,0 +1,93 @@
+// letter_freq.cpp
+// Single-pass character and n-gram counting for letter_freq()
+// Text is decoded from UTF-8 and lowercased once; unigram, bigram and
+// trigram counts are all collected in the same pass.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <unordered_map>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// Codepoints are at most 21 bits, so an n-gram of up to three packs into
+// one 64-bit key
+static const int CP_BITS = 21;
+
+static std::string ngram_label(uint64_t key, int n) {
+  std::string label;
+  for (int i = n - 1; i >= 0; i--) {
+    label += encode_utf8(static_cast<uint32_t>((key >> (i * CP_BITS)) & 0x1FFFFF));
+  }
+  return label;
+}
+
+// Count characters (n = 1) and runs of n consecutive counted characters.
+// With only_alpha, letters are counted; otherwise every character except
+// the space. Uncounted characters end a run.
+// [[Rcpp::export]]
+List count_ngrams(CharacterVector text, bool only_alpha, IntegerVector n) {
+  std::vector<int> sizes = Rcpp::as<std::vector<int>>(n);
+  int max_n = 1;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    if (sizes[i] < 1 || sizes[i] > 3) stop("n-gram sizes must be between 1 and 3");
+    max_n = std::max(max_n, sizes[i]);
+  }
+
+  // Unigrams of the Basic Multilingual Plane use a dense table
+  std::vector<double> dense(0x10000, 0.0);
+  std::vector<std::unordered_map<uint64_t, double> > counts(max_n + 1);
+  std::vector<char> wanted(max_n + 1, 0);
+  for (size_t i = 0; i < sizes.size(); i++) wanted[sizes[i]] = 1;
+
+  std::vector<uint32_t> cps;
+  for (int t = 0; t < text.size(); t++) {
+    decode_utf8(Rcpp::as<std::string>(text[t]), cps);
+
+    uint64_t window = 0;  // last counted codepoints, newest in the low bits
+    int run = 0;          // length of the current run of counted characters
+    for (size_t i = 0; i < cps.size(); i++) {
+      uint32_t cp = fold_case(cps[i]);
+      bool counted = only_alpha ? is_alpha_codepoint(cp) : cp != ' ';
+      if (!counted) {
+        run = 0;
+        continue;
+      }
+
+      window = (window << CP_BITS) | cp;
+      run++;
+      if (wanted[1]) {
+        if (cp < dense.size()) {
+          dense[cp] += 1.0;
+        } else {
+          counts[1][cp] += 1.0;
+        }
+      }
+      for (int m = 2; m <= max_n && m <= run; m++) {
+        if (!wanted[m]) continue;
+        uint64_t mask = (static_cast<uint64_t>(1) << (m * CP_BITS)) - 1;
+        counts[m][window & mask] += 1.0;
+      }
+    }
+  }
+
+  for (uint32_t cp = 0; cp < dense.size(); cp++) {
+    if (dense[cp] > 0.0) counts[1][cp] = dense[cp];
+  }
+
+  List out(sizes.size());
+  for (size_t i = 0; i < sizes.size(); i++) {
+    int m = sizes[i];
+    const std::unordered_map<uint64_t, double>& table = counts[m];
+    CharacterVector labels(table.size());
+    NumericVector totals(table.size());
+    int j = 0;
+    for (auto it = table.begin(); it != table.end(); ++it, j++) {
+      labels[j] = ngram_label(it->first, m);
+      totals[j] = it->second;
+    }
+    out[i] = List::create(Named("characters") = labels, Named("total") = totals);
+  }
+  return out;
+}
@@ -0,0 +1,501 @@
+// pareto.cpp
+// NSGA-II multi-objective search over effort components
+// Instead of one weighted effort, every layout is scored on several
+// components at once (e.g. same-finger effort against hand balance) and
+// the population evolves towards the set of layouts no other layout
+// beats on all of them. Rule penalties act as constraint violations:
+// of two layouts, the one with the lower penalty dominates.
+
+#include <Rcpp.h>
+#include "keyboard_model.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <string>
+
+using namespace Rcpp;
+
+// -----------------------------------------------------------------
+// OBJECTIVES
+// -----------------------------------------------------------------
+
+enum ParetoObjective {
+  PARETO_EFFORT,
+  PARETO_BASE,
+  PARETO_SAME_FINGER,
+  PARETO_SAME_HAND,
+  PARETO_ROW_CHANGE,
+  PARETO_TRIGRAM,
+  PARETO_LAYER,
+  PARETO_HAND_BALANCE
+};
+
+static const char* const PARETO_NAMES[] = {
+  "effort", "base", "same_finger", "same_hand", "row_change", "trigram", "layer",
+  "hand_balance"
+};
+static const int N_PARETO_NAMES = 8;
+
+static ParetoObjective parse_objective(const std::string& name) {
+  for (int i = 0; i < N_PARETO_NAMES; i++) {
+    if (name == PARETO_NAMES[i]) return static_cast<ParetoObjective>(i);
+  }
+  stop("unknown objective '" + name + "'");
+}
+
+// Scores of one layout: the selected objectives, all minimized, plus the
+// weighted effort and rule penalty it is reported with
+struct ParetoScore {
+  std::vector<double> f;
+  double effort;
+  double penalty;
+};
+
+// Distance of the left hand's share of keystrokes from one half
+static double hand_imbalance(const CorpusStats& cs, const Geometry& g,
+                             const std::vector<int>& pos_of_sym) {
+  double left = 0.0, total = 0.0;
+  for (int s = 0; s < cs.size(); s++) {
+    int p = pos_of_sym[s];
+    if (p < 0) continue;
+    total += cs.unigram[s];
+    if (g.hand[p] == 0) left += cs.unigram[s];
+  }
+  return total > 0.0 ? std::abs(left / total - 0.5) : 0.0;
+}
+
+// Scores every layout of a population; pure C++, so safe with OpenMP
+class ParetoEvaluator {
+public:
+  ParetoEvaluator(const Objective& objective, const std::vector<ParetoObjective>& objectives)
+    : obj_(objective), objectives_(objectives) {}
+
+  void evaluate(const std::vector<KeyboardLayout>& layouts, std::vector<ParetoScore>& scores,
+                int from, int n_threads) const {
+    int n = layouts.size();
+    const CorpusStats& cs = *obj_.corpus;
+    const Geometry& g = *obj_.geometry;
+    const EffortWeights& w = obj_.costs->weights;
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(n_threads) if (n_threads > 1)
+#endif
+    {
+      std::vector<int> pos_of_sym;
+#ifdef _OPENMP
+      #pragma omp for schedule(static)
+#endif
+      for (int i = from; i < n; i++) {
+        layouts[i].positions(cs.size(), pos_of_sym);
+        EffortComponents c = corpus_components(cs, g, pos_of_sym);
+        ParetoScore& s = scores[i];
+        s.effort = c.total(w);
+        s.penalty = obj_.rules->has_penalties()
+          ? rule_penalty(pos_of_sym, *obj_.rules, g, cs) : 0.0;
+        s.f.resize(objectives_.size());
+        for (size_t o = 0; o < objectives_.size(); o++) {
+          switch (objectives_[o]) {
+            case PARETO_EFFORT: s.f[o] = s.effort; break;
+            case PARETO_BASE: s.f[o] = c.base; break;
+            case PARETO_SAME_FINGER: s.f[o] = c.same_finger; break;
+            case PARETO_SAME_HAND: s.f[o] = c.same_hand; break;
+            case PARETO_ROW_CHANGE: s.f[o] = c.row_change; break;
+            case PARETO_TRIGRAM: s.f[o] = c.trigram; break;
+            case PARETO_LAYER: s.f[o] = c.layer; break;
+            case PARETO_HAND_BALANCE: s.f[o] = hand_imbalance(cs, g, pos_of_sym); break;
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const Objective& obj_;
+  std::vector<ParetoObjective> objectives_;
+};
+
+// -----------------------------------------------------------------
+// NON-DOMINATED SORTING
+// -----------------------------------------------------------------
+
+// Constrained domination: a lower rule penalty wins, equal penalties
+// compare on the objectives
+static bool dominates(const ParetoScore& a, const ParetoScore& b) {
+  if (a.penalty != b.penalty) return a.penalty < b.penalty;
+  bool better = false;
+  for (size_t o = 0; o < a.f.size(); o++) {
+    if (a.f[o] > b.f[o]) return false;
+    if (a.f[o] < b.f[o]) better = true;
+  }
+  return better;
+}
+
+// Front index (0 = non-dominated) of every score, by efficient
+// non-dominated sorting with sequential search (ENS-SS): after a
+// lexicographic sort only earlier solutions can dominate later ones, and
+// each solution joins the first front none of whose members dominates
+// it. Far fewer comparisons than the O(M N^2) fast non-dominated sort.
+static int non_dominated_sort(const std::vector<ParetoScore>& scores, std::vector<int>& rank) {
+  int n = scores.size();
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    const ParetoScore& x = scores[a];
+    const ParetoScore& y = scores[b];
+    if (x.penalty != y.penalty) return x.penalty < y.penalty;
+    return x.f < y.f;
+  });
+
+  rank.assign(n, 0);
+  std::vector<std::vector<int>> fronts;
+  for (int i = 0; i < n; i++) {
+    int s = order[i];
+    size_t k = 0;
+    for (; k < fronts.size(); k++) {
+      // Later members are the likeliest dominators: check them first
+      bool dominated = false;
+      for (int j = fronts[k].size() - 1; j >= 0 && !dominated; j--) {
+        dominated = dominates(scores[fronts[k][j]], scores[s]);
+      }
+      if (!dominated) break;
+    }
+    if (k == fronts.size()) fronts.push_back(std::vector<int>());
+    fronts[k].push_back(s);
+    rank[s] = k;
+  }
+  return fronts.size();
+}
+
+// Crowding distance of every member of one front: the normalized size of
+// the box spanned by its neighbours, infinite at the extremes
+static void crowding_distance(const std::vector<ParetoScore>& scores,
+                              const std::vector<int>& front, std::vector<double>& crowding) {
+  const double inf = std::numeric_limits<double>::infinity();
+  int m = front.size();
+  for (int i = 0; i < m; i++) crowding[front[i]] = 0.0;
+  if (m == 0) return;
+  int n_obj = scores[front[0]].f.size();
+  std::vector<int> sorted(front);
+  for (int o = 0; o < n_obj; o++) {
+    std::sort(sorted.begin(), sorted.end(), [&](int a, int b) {
+      return scores[a].f[o] < scores[b].f[o];
+    });
+    double lo = scores[sorted.front()].f[o];
+    double hi = scores[sorted.back()].f[o];
+    crowding[sorted.front()] = inf;
+    crowding[sorted.back()] = inf;
+    if (hi <= lo) continue;
+    for (int i = 1; i < m - 1; i++) {
+      crowding[sorted[i]] += (scores[sorted[i + 1]].f[o] - scores[sorted[i - 1]].f[o]) / (hi - lo);
+    }
+  }
+}
+
+// -----------------------------------------------------------------
+// NSGA-II
+// -----------------------------------------------------------------
+
+struct ParetoConfig {
+  int population_size;
+  int generations;
+  double mutation_rate;
+  double crossover_rate;
+  bool pmx;       // PMX instead of order crossover
+  int n_threads;  // threads for evaluation
+};
+
+struct ParetoResult {
+  std::vector<KeyboardLayout> front;  // distinct non-dominated layouts
+  std::vector<ParetoScore> scores;
+  std::vector<double> front_size;     // first-front size per generation
+  std::vector<std::vector<double>> front_min;  // per objective, per generation
+  Telemetry telemetry;
+  std::string stop_reason;            // "generations" or "callback"
+};
+
+class NSGA2 {
+public:
+  NSGA2(const ParetoEvaluator& evaluator, const Objective& objective, const ParetoConfig& cfg,
+        const std::vector<int>& free, std::mt19937& rng)
+    : eval_(evaluator), obj_(objective), cfg_(cfg), free_(free), rng_(rng) {}
+
+  void seed(const KeyboardLayout& initial) {
+    int n = cfg_.population_size;
+    pop_.resize(n);
+    scores_.resize(n);
+    Stopwatch phase;
+    for (int i = 0; i < n; i++) {
+      pop_[i] = (i == 0) ? initial : shuffle_free(initial, free_, rng_);
+    }
+    telemetry_.variation_seconds += phase.seconds();
+    phase.reset();
+    for (int i = 0; i < n; i++) repair_layout(pop_[i], *obj_.rules, *obj_.geometry);
+    telemetry_.repair_seconds += phase.seconds();
+    phase.reset();
+    eval_.evaluate(pop_, scores_, 0, cfg_.n_threads);
+    telemetry_.scoring_seconds += phase.seconds();
+    telemetry_.initial_evaluations = n;
+    rank_population();
+  }
+
+  // Breed n offspring, then keep the best n of parents and offspring by
+  // front and crowding
+  void step(const Stopwatch& clock) {
+    int n = cfg_.population_size;
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    Stopwatch phase;
+    double repair_seconds = 0.0;
+
+    std::vector<KeyboardLayout> merged(pop_);
+    std::vector<ParetoScore> merged_scores(scores_);
+    merged.resize(2 * n);
+    merged_scores.resize(2 * n);
+    for (int i = n; i < 2 * n; i++) {
+      const KeyboardLayout& p1 = pop_[tournament()];
+      if (unif(rng_) < cfg_.crossover_rate) {
+        const KeyboardLayout& p2 = pop_[tournament()];
+        merged[i] = cfg_.pmx ? pmx_crossover(p1, p2, free_, rng_)
+                             : order_crossover(p1, p2, free_, rng_);
+      } else {
+        merged[i] = p1;
+      }
+      if (unif(rng_) < cfg_.mutation_rate) swap_mutation(merged[i], free_, rng_);
+      Stopwatch repair;
+      repair_layout(merged[i], *obj_.rules, *obj_.geometry);
+      repair_seconds += repair.seconds();
+    }
+    telemetry_.variation_seconds += phase.seconds() - repair_seconds;
+    telemetry_.repair_seconds += repair_seconds;
+
+    phase.reset();
+    eval_.evaluate(merged, merged_scores, n, cfg_.n_threads);
+    telemetry_.scoring_seconds += phase.seconds();
+
+    // Environmental selection: whole fronts while they fit, then the
+    // least crowded members of the front that does not
+    phase.reset();
+    std::vector<int> rank;
+    int n_fronts = non_dominated_sort(merged_scores, rank);
+    std::vector<std::vector<int>> fronts(n_fronts);
+    for (int i = 0; i < 2 * n; i++) fronts[rank[i]].push_back(i);
+    std::vector<double> crowding(2 * n, 0.0);
+    std::vector<int> keep;
+    for (int k = 0; k < n_fronts && static_cast<int>(keep.size()) < n; k++) {
+      crowding_distance(merged_scores, fronts[k], crowding);
+      if (static_cast<int>(keep.size() + fronts[k].size()) > n) {
+        std::stable_sort(fronts[k].begin(), fronts[k].end(), [&](int a, int b) {
+          return crowding[a] > crowding[b];
+        });
+        fronts[k].resize(n - keep.size());
+      }
+      keep.insert(keep.end(), fronts[k].begin(), fronts[k].end());
+    }
+    for (int i = 0; i < n; i++) {
+      pop_[i] = merged[keep[i]];
+      scores_[i] = merged_scores[keep[i]];
+      rank_[i] = rank[keep[i]];
+      crowding_[i] = crowding[keep[i]];
+    }
+    telemetry_.variation_seconds += phase.seconds();
+
+    telemetry_.evaluations.push_back(n);
+    telemetry_.elapsed.push_back(clock.seconds());
+    record_front();
+  }
+
+  // Distinct layouts of the first front, in population order
+  void front(std::vector<KeyboardLayout>& layouts, std::vector<ParetoScore>& scores) const {
+    layouts.clear();
+    scores.clear();
+    for (size_t i = 0; i < pop_.size(); i++) {
+      if (rank_[i] != 0) continue;
+      bool seen = false;
+      for (size_t j = 0; j < layouts.size() && !seen; j++) seen = layouts[j].keys == pop_[i].keys;
+      if (seen) continue;
+      layouts.push_back(pop_[i]);
+      scores.push_back(scores_[i]);
+    }
+  }
+
+  double best_effort() const {
+    double best = scores_[0].effort;
+    for (size_t i = 1; i < scores_.size(); i++) best = std::min(best, scores_[i].effort);
+    return best;
+  }
+
+  double mean_effort() const {
+    double sum = 0.0;
+    for (size_t i = 0; i < scores_.size(); i++) sum += scores_[i].effort;
+    return sum / scores_.size();
+  }
+
+  const std::vector<double>& front_size() const { return front_size_; }
+  const std::vector<std::vector<double>>& front_min() const { return front_min_; }
+  const Telemetry& telemetry() const { return telemetry_; }
+
+private:
+  // Ranks and crowding of the current population
+  void rank_population() {
+    int n = pop_.size();
+    int n_fronts = non_dominated_sort(scores_, rank_);
+    std::vector<std::vector<int>> fronts(n_fronts);
+    for (int i = 0; i < n; i++) fronts[rank_[i]].push_back(i);
+    crowding_.assign(n, 0.0);
+    for (int k = 0; k < n_fronts; k++) crowding_distance(scores_, fronts[k], crowding_);
+  }
+
+  // Binary tournament on (front, crowding)
+  int tournament() {
+    std::uniform_int_distribution<int> pick(0, pop_.size() - 1);
+    int a = pick(rng_);
+    int b = pick(rng_);
+    if (rank_[a] != rank_[b]) return rank_[a] < rank_[b] ? a : b;
+    return crowding_[a] >= crowding_[b] ? a : b;
+  }
+
+  void record_front() {
+    int n_obj = scores_[0].f.size();
+    if (front_min_.empty()) front_min_.resize(n_obj);
+    double size = 0.0;
+    std::vector<double> lo(n_obj, std::numeric_limits<double>::infinity());
+    for (size_t i = 0; i < pop_.size(); i++) {
+      if (rank_[i] != 0) continue;
+      size += 1.0;
+      for (int o = 0; o < n_obj; o++) lo[o] = std::min(lo[o], scores_[i].f[o]);
+    }
+    front_size_.push_back(size);
+    for (int o = 0; o < n_obj; o++) front_min_[o].push_back(lo[o]);
+  }
+
+  const ParetoEvaluator& eval_;
+  const Objective& obj_;
+  ParetoConfig cfg_;
+  std::vector<int> free_;
+  std::mt19937& rng_;
+  std::vector<KeyboardLayout> pop_;
+  std::vector<ParetoScore> scores_;
+  std::vector<int> rank_;
+  std::vector<double> crowding_;
+  std::vector<double> front_size_;
+  std::vector<std::vector<double>> front_min_;
+  Telemetry telemetry_;
+};
+
+static ParetoResult run_nsga2(
+    const Objective& objective,
+    const std::vector<ParetoObjective>& objectives,
+    const KeyboardLayout& initial,
+    const ParetoConfig& cfg,
+    std::mt19937& rng,
+    const ProgressCallback& progress
+) {
+  Stopwatch clock;
+  std::vector<int> free = free_positions(*objective.rules, initial.n_keys);
+  ParetoEvaluator evaluator(objective, objectives);
+  NSGA2 nsga(evaluator, objective, cfg, free, rng);
+  nsga.seed(initial);
+
+  ParetoResult result;
+  result.stop_reason = "generations";
+  for (int gen = 0; gen < cfg.generations; gen++) {
+    nsga.step(clock);
+    if (progress.due(gen + 1) &&
+        !progress.report(progress_info(gen + 1, nsga.best_effort(), nsga.mean_effort(),
+                                       nsga.telemetry(), clock.seconds()))) {
+      result.stop_reason = "callback";
+      break;
+    }
+    Rcpp::checkUserInterrupt();
+  }
+
+  nsga.front(result.front, result.scores);
+  result.front_size = nsga.front_size();
+  result.front_min = nsga.front_min();
+  result.telemetry = nsga.telemetry();
+  return result;
+}
+
+// -----------------------------------------------------------------
+// R INTERFACE
+// -----------------------------------------------------------------
+
+// Pareto front of layouts over the named objectives (see PARETO_NAMES)
+// [[Rcpp::export]]
+List pareto_optimize(
+    SEXP corpus,
+    CharacterVector layout,
+    SEXP geometry,
+    LogicalVector fixed,
+    List rules,
+    CharacterVector objectives,
+    int population_size = 100,
+    int generations = 200,
+    double mutation_rate = 0.2,
+    double crossover_rate = 0.8,
+    std::string crossover = "order",
+    SEXP progress = R_NilValue,
+    int progress_every = 10,
+    int seed = 1,
+    int n_threads = 1
+) {
+  Stopwatch clock;
+  const CorpusStats& cs = corpus_ref(corpus);
+  const KeyboardGeometry& kg = geometry_ref(geometry);
+  KeyboardLayout initial = layout_from_labels(cs, layout);
+  if (initial.n_keys != kg.geometry.n) stop("layout must have one key per geometry position");
+  if (fixed.size() != initial.n_keys) {
+    stop("fixed must have one entry per layout position");
+  }
+  if (objectives.size() < 2) stop("at least two objectives are needed");
+  if (population_size < 4) stop("population_size must be at least 4");
+  if (crossover != "order" && crossover != "pmx") {
+    stop("crossover must be 'order' or 'pmx'");
+  }
+  if (progress_every < 1) stop("progress_every must be at least 1");
+
+  std::vector<ParetoObjective> objs;
+  for (int o = 0; o < objectives.size(); o++) {
+    objs.push_back(parse_objective(Rcpp::as<std::string>(objectives[o])));
+  }
+
+  RuleSet rs = rules_from_list(rules, fixed, cs);
+  Objective objective = {&cs, &kg.geometry, &kg.costs, &rs, NULL};
+  ProgressCallback callback(progress, progress_every);
+  ParetoConfig cfg = {population_size, generations, mutation_rate, crossover_rate,
+                      crossover == "pmx", resolve_threads(n_threads)};
+  std::mt19937 rng(static_cast<uint32_t>(seed));
+
+  ParetoResult res = run_nsga2(objective, objs, initial, cfg, rng, callback);
+
+  int n_front = res.front.size();
+  int n_obj = objs.size();
+  CharacterMatrix layouts(n_front, initial.n_keys);
+  NumericMatrix values(n_front, n_obj);
+  NumericVector effort(n_front);
+  NumericVector penalty(n_front);
+  for (int i = 0; i < n_front; i++) {
+    CharacterVector labels = layout_labels(cs, res.front[i]);
+    for (int p = 0; p < initial.n_keys; p++) layouts(i, p) = labels[p];
+    for (int o = 0; o < n_obj; o++) values(i, o) = res.scores[i].f[o];
+    effort[i] = res.scores[i].effort;
+    penalty[i] = res.scores[i].penalty;
+  }
+
+  int n_gen = res.front_size.size();
+  NumericMatrix front_min(n_gen, n_obj);
+  for (int o = 0; o < n_obj; o++) {
+    for (int g = 0; g < n_gen; g++) front_min(g, o) = res.front_min[o][g];
+  }
+
+  return List::create(
+    Named("layouts") = layouts,
+    Named("objectives") = values,
+    Named("effort") = effort,
+    Named("penalty") = penalty,
+    Named("front_size") = wrap(res.front_size),
+    Named("front_min") = front_min,
+    Named("telemetry") = telemetry_list(res.telemetry, clock.seconds(), res.stop_reason)
+  );
+}
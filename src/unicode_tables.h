@@ -0,0 +1,422 @@
+// unicode_tables.h
+// Generated by data-raw/unicode_tables.pl from Unicode 14.0.0; do not edit.
+// Included by corpus_stats.cpp only.
+
+#ifndef LBKEYBOARD_UNICODE_TABLES_H
+#define LBKEYBOARD_UNICODE_TABLES_H
+
+#include <cstdint>
+
+// Alphabetic codepoints, as {first, last} ranges
+static const uint32_t ALPHABETIC_RANGES[][2] = {
+  {0x0041, 0x005A}, {0x0061, 0x007A}, {0x00AA, 0x00AA}, {0x00B5, 0x00B5},
+  {0x00BA, 0x00BA}, {0x00C0, 0x00D6}, {0x00D8, 0x00F6}, {0x00F8, 0x02C1},
+  {0x02C6, 0x02D1}, {0x02E0, 0x02E4}, {0x02EC, 0x02EC}, {0x02EE, 0x02EE},
+  {0x0345, 0x0345}, {0x0370, 0x0374}, {0x0376, 0x0377}, {0x037A, 0x037D},
+  {0x037F, 0x037F}, {0x0386, 0x0386}, {0x0388, 0x038A}, {0x038C, 0x038C},
+  {0x038E, 0x03A1}, {0x03A3, 0x03F5}, {0x03F7, 0x0481}, {0x048A, 0x052F},
+  {0x0531, 0x0556}, {0x0559, 0x0559}, {0x0560, 0x0588}, {0x05B0, 0x05BD},
+  {0x05BF, 0x05BF}, {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7},
+  {0x05D0, 0x05EA}, {0x05EF, 0x05F2}, {0x0610, 0x061A}, {0x0620, 0x0657},
+  {0x0659, 0x065F}, {0x066E, 0x06D3}, {0x06D5, 0x06DC}, {0x06E1, 0x06E8},
+  {0x06ED, 0x06EF}, {0x06FA, 0x06FC}, {0x06FF, 0x06FF}, {0x0710, 0x073F},
+  {0x074D, 0x07B1}, {0x07CA, 0x07EA}, {0x07F4, 0x07F5}, {0x07FA, 0x07FA},
+  {0x0800, 0x0817}, {0x081A, 0x082C}, {0x0840, 0x0858}, {0x0860, 0x086A},
+  {0x0870, 0x0887}, {0x0889, 0x088E}, {0x08A0, 0x08C9}, {0x08D4, 0x08DF},
+  {0x08E3, 0x08E9}, {0x08F0, 0x093B}, {0x093D, 0x094C}, {0x094E, 0x0950},
+  {0x0955, 0x0963}, {0x0971, 0x0983}, {0x0985, 0x098C}, {0x098F, 0x0990},
+  {0x0993, 0x09A8}, {0x09AA, 0x09B0}, {0x09B2, 0x09B2}, {0x09B6, 0x09B9},
+  {0x09BD, 0x09C4}, {0x09C7, 0x09C8}, {0x09CB, 0x09CC}, {0x09CE, 0x09CE},
+  {0x09D7, 0x09D7}, {0x09DC, 0x09DD}, {0x09DF, 0x09E3}, {0x09F0, 0x09F1},
+  {0x09FC, 0x09FC}, {0x0A01, 0x0A03}, {0x0A05, 0x0A0A}, {0x0A0F, 0x0A10},
+  {0x0A13, 0x0A28}, {0x0A2A, 0x0A30}, {0x0A32, 0x0A33}, {0x0A35, 0x0A36},
+  {0x0A38, 0x0A39}, {0x0A3E, 0x0A42}, {0x0A47, 0x0A48}, {0x0A4B, 0x0A4C},
+  {0x0A51, 0x0A51}, {0x0A59, 0x0A5C}, {0x0A5E, 0x0A5E}, {0x0A70, 0x0A75},
+  {0x0A81, 0x0A83}, {0x0A85, 0x0A8D}, {0x0A8F, 0x0A91}, {0x0A93, 0x0AA8},
+  {0x0AAA, 0x0AB0}, {0x0AB2, 0x0AB3}, {0x0AB5, 0x0AB9}, {0x0ABD, 0x0AC5},
+  {0x0AC7, 0x0AC9}, {0x0ACB, 0x0ACC}, {0x0AD0, 0x0AD0}, {0x0AE0, 0x0AE3},
+  {0x0AF9, 0x0AFC}, {0x0B01, 0x0B03}, {0x0B05, 0x0B0C}, {0x0B0F, 0x0B10},
+  {0x0B13, 0x0B28}, {0x0B2A, 0x0B30}, {0x0B32, 0x0B33}, {0x0B35, 0x0B39},
+  {0x0B3D, 0x0B44}, {0x0B47, 0x0B48}, {0x0B4B, 0x0B4C}, {0x0B56, 0x0B57},
+  {0x0B5C, 0x0B5D}, {0x0B5F, 0x0B63}, {0x0B71, 0x0B71}, {0x0B82, 0x0B83},
+  {0x0B85, 0x0B8A}, {0x0B8E, 0x0B90}, {0x0B92, 0x0B95}, {0x0B99, 0x0B9A},
+  {0x0B9C, 0x0B9C}, {0x0B9E, 0x0B9F}, {0x0BA3, 0x0BA4}, {0x0BA8, 0x0BAA},
+  {0x0BAE, 0x0BB9}, {0x0BBE, 0x0BC2}, {0x0BC6, 0x0BC8}, {0x0BCA, 0x0BCC},
+  {0x0BD0, 0x0BD0}, {0x0BD7, 0x0BD7}, {0x0C00, 0x0C03}, {0x0C05, 0x0C0C},
+  {0x0C0E, 0x0C10}, {0x0C12, 0x0C28}, {0x0C2A, 0x0C39}, {0x0C3D, 0x0C44},
+  {0x0C46, 0x0C48}, {0x0C4A, 0x0C4C}, {0x0C55, 0x0C56}, {0x0C58, 0x0C5A},
+  {0x0C5D, 0x0C5D}, {0x0C60, 0x0C63}, {0x0C80, 0x0C83}, {0x0C85, 0x0C8C},
+  {0x0C8E, 0x0C90}, {0x0C92, 0x0CA8}, {0x0CAA, 0x0CB3}, {0x0CB5, 0x0CB9},
+  {0x0CBD, 0x0CC4}, {0x0CC6, 0x0CC8}, {0x0CCA, 0x0CCC}, {0x0CD5, 0x0CD6},
+  {0x0CDD, 0x0CDE}, {0x0CE0, 0x0CE3}, {0x0CF1, 0x0CF2}, {0x0D00, 0x0D0C},
+  {0x0D0E, 0x0D10}, {0x0D12, 0x0D3A}, {0x0D3D, 0x0D44}, {0x0D46, 0x0D48},
+  {0x0D4A, 0x0D4C}, {0x0D4E, 0x0D4E}, {0x0D54, 0x0D57}, {0x0D5F, 0x0D63},
+  {0x0D7A, 0x0D7F}, {0x0D81, 0x0D83}, {0x0D85, 0x0D96}, {0x0D9A, 0x0DB1},
+  {0x0DB3, 0x0DBB}, {0x0DBD, 0x0DBD}, {0x0DC0, 0x0DC6}, {0x0DCF, 0x0DD4},
+  {0x0DD6, 0x0DD6}, {0x0DD8, 0x0DDF}, {0x0DF2, 0x0DF3}, {0x0E01, 0x0E3A},
+  {0x0E40, 0x0E46}, {0x0E4D, 0x0E4D}, {0x0E81, 0x0E82}, {0x0E84, 0x0E84},
+  {0x0E86, 0x0E8A}, {0x0E8C, 0x0EA3}, {0x0EA5, 0x0EA5}, {0x0EA7, 0x0EB9},
+  {0x0EBB, 0x0EBD}, {0x0EC0, 0x0EC4}, {0x0EC6, 0x0EC6}, {0x0ECD, 0x0ECD},
+  {0x0EDC, 0x0EDF}, {0x0F00, 0x0F00}, {0x0F40, 0x0F47}, {0x0F49, 0x0F6C},
+  {0x0F71, 0x0F81}, {0x0F88, 0x0F97}, {0x0F99, 0x0FBC}, {0x1000, 0x1036},
+  {0x1038, 0x1038}, {0x103B, 0x103F}, {0x1050, 0x108F}, {0x109A, 0x109D},
+  {0x10A0, 0x10C5}, {0x10C7, 0x10C7}, {0x10CD, 0x10CD}, {0x10D0, 0x10FA},
+  {0x10FC, 0x1248}, {0x124A, 0x124D}, {0x1250, 0x1256}, {0x1258, 0x1258},
+  {0x125A, 0x125D}, {0x1260, 0x1288}, {0x128A, 0x128D}, {0x1290, 0x12B0},
+  {0x12B2, 0x12B5}, {0x12B8, 0x12BE}, {0x12C0, 0x12C0}, {0x12C2, 0x12C5},
+  {0x12C8, 0x12D6}, {0x12D8, 0x1310}, {0x1312, 0x1315}, {0x1318, 0x135A},
+  {0x1380, 0x138F}, {0x13A0, 0x13F5}, {0x13F8, 0x13FD}, {0x1401, 0x166C},
+  {0x166F, 0x167F}, {0x1681, 0x169A}, {0x16A0, 0x16EA}, {0x16EE, 0x16F8},
+  {0x1700, 0x1713}, {0x171F, 0x1733}, {0x1740, 0x1753}, {0x1760, 0x176C},
+  {0x176E, 0x1770}, {0x1772, 0x1773}, {0x1780, 0x17B3}, {0x17B6, 0x17C8},
+  {0x17D7, 0x17D7}, {0x17DC, 0x17DC}, {0x1820, 0x1878}, {0x1880, 0x18AA},
+  {0x18B0, 0x18F5}, {0x1900, 0x191E}, {0x1920, 0x192B}, {0x1930, 0x1938},
+  {0x1950, 0x196D}, {0x1970, 0x1974}, {0x1980, 0x19AB}, {0x19B0, 0x19C9},
+  {0x1A00, 0x1A1B}, {0x1A20, 0x1A5E}, {0x1A61, 0x1A74}, {0x1AA7, 0x1AA7},
+  {0x1ABF, 0x1AC0}, {0x1ACC, 0x1ACE}, {0x1B00, 0x1B33}, {0x1B35, 0x1B43},
+  {0x1B45, 0x1B4C}, {0x1B80, 0x1BA9}, {0x1BAC, 0x1BAF}, {0x1BBA, 0x1BE5},
+  {0x1BE7, 0x1BF1}, {0x1C00, 0x1C36}, {0x1C4D, 0x1C4F}, {0x1C5A, 0x1C7D},
+  {0x1C80, 0x1C88}, {0x1C90, 0x1CBA}, {0x1CBD, 0x1CBF}, {0x1CE9, 0x1CEC},
+  {0x1CEE, 0x1CF3}, {0x1CF5, 0x1CF6}, {0x1CFA, 0x1CFA}, {0x1D00, 0x1DBF},
+  {0x1DE7, 0x1DF4}, {0x1E00, 0x1F15}, {0x1F18, 0x1F1D}, {0x1F20, 0x1F45},
+  {0x1F48, 0x1F4D}, {0x1F50, 0x1F57}, {0x1F59, 0x1F59}, {0x1F5B, 0x1F5B},
+  {0x1F5D, 0x1F5D}, {0x1F5F, 0x1F7D}, {0x1F80, 0x1FB4}, {0x1FB6, 0x1FBC},
+  {0x1FBE, 0x1FBE}, {0x1FC2, 0x1FC4}, {0x1FC6, 0x1FCC}, {0x1FD0, 0x1FD3},
+  {0x1FD6, 0x1FDB}, {0x1FE0, 0x1FEC}, {0x1FF2, 0x1FF4}, {0x1FF6, 0x1FFC},
+  {0x2071, 0x2071}, {0x207F, 0x207F}, {0x2090, 0x209C}, {0x2102, 0x2102},
+  {0x2107, 0x2107}, {0x210A, 0x2113}, {0x2115, 0x2115}, {0x2119, 0x211D},
+  {0x2124, 0x2124}, {0x2126, 0x2126}, {0x2128, 0x2128}, {0x212A, 0x212D},
+  {0x212F, 0x2139}, {0x213C, 0x213F}, {0x2145, 0x2149}, {0x214E, 0x214E},
+  {0x2160, 0x2188}, {0x24B6, 0x24E9}, {0x2C00, 0x2CE4}, {0x2CEB, 0x2CEE},
+  {0x2CF2, 0x2CF3}, {0x2D00, 0x2D25}, {0x2D27, 0x2D27}, {0x2D2D, 0x2D2D},
+  {0x2D30, 0x2D67}, {0x2D6F, 0x2D6F}, {0x2D80, 0x2D96}, {0x2DA0, 0x2DA6},
+  {0x2DA8, 0x2DAE}, {0x2DB0, 0x2DB6}, {0x2DB8, 0x2DBE}, {0x2DC0, 0x2DC6},
+  {0x2DC8, 0x2DCE}, {0x2DD0, 0x2DD6}, {0x2DD8, 0x2DDE}, {0x2DE0, 0x2DFF},
+  {0x2E2F, 0x2E2F}, {0x3005, 0x3007}, {0x3021, 0x3029}, {0x3031, 0x3035},
+  {0x3038, 0x303C}, {0x3041, 0x3096}, {0x309D, 0x309F}, {0x30A1, 0x30FA},
+  {0x30FC, 0x30FF}, {0x3105, 0x312F}, {0x3131, 0x318E}, {0x31A0, 0x31BF},
+  {0x31F0, 0x31FF}, {0x3400, 0x4DBF}, {0x4E00, 0xA48C}, {0xA4D0, 0xA4FD},
+  {0xA500, 0xA60C}, {0xA610, 0xA61F}, {0xA62A, 0xA62B}, {0xA640, 0xA66E},
+  {0xA674, 0xA67B}, {0xA67F, 0xA6EF}, {0xA717, 0xA71F}, {0xA722, 0xA788},
+  {0xA78B, 0xA7CA}, {0xA7D0, 0xA7D1}, {0xA7D3, 0xA7D3}, {0xA7D5, 0xA7D9},
+  {0xA7F2, 0xA805}, {0xA807, 0xA827}, {0xA840, 0xA873}, {0xA880, 0xA8C3},
+  {0xA8C5, 0xA8C5}, {0xA8F2, 0xA8F7}, {0xA8FB, 0xA8FB}, {0xA8FD, 0xA8FF},
+  {0xA90A, 0xA92A}, {0xA930, 0xA952}, {0xA960, 0xA97C}, {0xA980, 0xA9B2},
+  {0xA9B4, 0xA9BF}, {0xA9CF, 0xA9CF}, {0xA9E0, 0xA9EF}, {0xA9FA, 0xA9FE},
+  {0xAA00, 0xAA36}, {0xAA40, 0xAA4D}, {0xAA60, 0xAA76}, {0xAA7A, 0xAABE},
+  {0xAAC0, 0xAAC0}, {0xAAC2, 0xAAC2}, {0xAADB, 0xAADD}, {0xAAE0, 0xAAEF},
+  {0xAAF2, 0xAAF5}, {0xAB01, 0xAB06}, {0xAB09, 0xAB0E}, {0xAB11, 0xAB16},
+  {0xAB20, 0xAB26}, {0xAB28, 0xAB2E}, {0xAB30, 0xAB5A}, {0xAB5C, 0xAB69},
+  {0xAB70, 0xABEA}, {0xAC00, 0xD7A3}, {0xD7B0, 0xD7C6}, {0xD7CB, 0xD7FB},
+  {0xF900, 0xFA6D}, {0xFA70, 0xFAD9}, {0xFB00, 0xFB06}, {0xFB13, 0xFB17},
+  {0xFB1D, 0xFB28}, {0xFB2A, 0xFB36}, {0xFB38, 0xFB3C}, {0xFB3E, 0xFB3E},
+  {0xFB40, 0xFB41}, {0xFB43, 0xFB44}, {0xFB46, 0xFBB1}, {0xFBD3, 0xFD3D},
+  {0xFD50, 0xFD8F}, {0xFD92, 0xFDC7}, {0xFDF0, 0xFDFB}, {0xFE70, 0xFE74},
+  {0xFE76, 0xFEFC}, {0xFF21, 0xFF3A}, {0xFF41, 0xFF5A}, {0xFF66, 0xFFBE},
+  {0xFFC2, 0xFFC7}, {0xFFCA, 0xFFCF}, {0xFFD2, 0xFFD7}, {0xFFDA, 0xFFDC},
+  {0x10000, 0x1000B}, {0x1000D, 0x10026}, {0x10028, 0x1003A}, {0x1003C, 0x1003D},
+  {0x1003F, 0x1004D}, {0x10050, 0x1005D}, {0x10080, 0x100FA}, {0x10140, 0x10174},
+  {0x10280, 0x1029C}, {0x102A0, 0x102D0}, {0x10300, 0x1031F}, {0x1032D, 0x1034A},
+  {0x10350, 0x1037A}, {0x10380, 0x1039D}, {0x103A0, 0x103C3}, {0x103C8, 0x103CF},
+  {0x103D1, 0x103D5}, {0x10400, 0x1049D}, {0x104B0, 0x104D3}, {0x104D8, 0x104FB},
+  {0x10500, 0x10527}, {0x10530, 0x10563}, {0x10570, 0x1057A}, {0x1057C, 0x1058A},
+  {0x1058C, 0x10592}, {0x10594, 0x10595}, {0x10597, 0x105A1}, {0x105A3, 0x105B1},
+  {0x105B3, 0x105B9}, {0x105BB, 0x105BC}, {0x10600, 0x10736}, {0x10740, 0x10755},
+  {0x10760, 0x10767}, {0x10780, 0x10785}, {0x10787, 0x107B0}, {0x107B2, 0x107BA},
+  {0x10800, 0x10805}, {0x10808, 0x10808}, {0x1080A, 0x10835}, {0x10837, 0x10838},
+  {0x1083C, 0x1083C}, {0x1083F, 0x10855}, {0x10860, 0x10876}, {0x10880, 0x1089E},
+  {0x108E0, 0x108F2}, {0x108F4, 0x108F5}, {0x10900, 0x10915}, {0x10920, 0x10939},
+  {0x10980, 0x109B7}, {0x109BE, 0x109BF}, {0x10A00, 0x10A03}, {0x10A05, 0x10A06},
+  {0x10A0C, 0x10A13}, {0x10A15, 0x10A17}, {0x10A19, 0x10A35}, {0x10A60, 0x10A7C},
+  {0x10A80, 0x10A9C}, {0x10AC0, 0x10AC7}, {0x10AC9, 0x10AE4}, {0x10B00, 0x10B35},
+  {0x10B40, 0x10B55}, {0x10B60, 0x10B72}, {0x10B80, 0x10B91}, {0x10C00, 0x10C48},
+  {0x10C80, 0x10CB2}, {0x10CC0, 0x10CF2}, {0x10D00, 0x10D27}, {0x10E80, 0x10EA9},
+  {0x10EAB, 0x10EAC}, {0x10EB0, 0x10EB1}, {0x10F00, 0x10F1C}, {0x10F27, 0x10F27},
+  {0x10F30, 0x10F45}, {0x10F70, 0x10F81}, {0x10FB0, 0x10FC4}, {0x10FE0, 0x10FF6},
+  {0x11000, 0x11045}, {0x11071, 0x11075}, {0x11082, 0x110B8}, {0x110C2, 0x110C2},
+  {0x110D0, 0x110E8}, {0x11100, 0x11132}, {0x11144, 0x11147}, {0x11150, 0x11172},
+  {0x11176, 0x11176}, {0x11180, 0x111BF}, {0x111C1, 0x111C4}, {0x111CE, 0x111CF},
+  {0x111DA, 0x111DA}, {0x111DC, 0x111DC}, {0x11200, 0x11211}, {0x11213, 0x11234},
+  {0x11237, 0x11237}, {0x1123E, 0x1123E}, {0x11280, 0x11286}, {0x11288, 0x11288},
+  {0x1128A, 0x1128D}, {0x1128F, 0x1129D}, {0x1129F, 0x112A8}, {0x112B0, 0x112E8},
+  {0x11300, 0x11303}, {0x11305, 0x1130C}, {0x1130F, 0x11310}, {0x11313, 0x11328},
+  {0x1132A, 0x11330}, {0x11332, 0x11333}, {0x11335, 0x11339}, {0x1133D, 0x11344},
+  {0x11347, 0x11348}, {0x1134B, 0x1134C}, {0x11350, 0x11350}, {0x11357, 0x11357},
+  {0x1135D, 0x11363}, {0x11400, 0x11441}, {0x11443, 0x11445}, {0x11447, 0x1144A},
+  {0x1145F, 0x11461}, {0x11480, 0x114C1}, {0x114C4, 0x114C5}, {0x114C7, 0x114C7},
+  {0x11580, 0x115B5}, {0x115B8, 0x115BE}, {0x115D8, 0x115DD}, {0x11600, 0x1163E},
+  {0x11640, 0x11640}, {0x11644, 0x11644}, {0x11680, 0x116B5}, {0x116B8, 0x116B8},
+  {0x11700, 0x1171A}, {0x1171D, 0x1172A}, {0x11740, 0x11746}, {0x11800, 0x11838},
+  {0x118A0, 0x118DF}, {0x118FF, 0x11906}, {0x11909, 0x11909}, {0x1190C, 0x11913},
+  {0x11915, 0x11916}, {0x11918, 0x11935}, {0x11937, 0x11938}, {0x1193B, 0x1193C},
+  {0x1193F, 0x11942}, {0x119A0, 0x119A7}, {0x119AA, 0x119D7}, {0x119DA, 0x119DF},
+  {0x119E1, 0x119E1}, {0x119E3, 0x119E4}, {0x11A00, 0x11A32}, {0x11A35, 0x11A3E},
+  {0x11A50, 0x11A97}, {0x11A9D, 0x11A9D}, {0x11AB0, 0x11AF8}, {0x11C00, 0x11C08},
+  {0x11C0A, 0x11C36}, {0x11C38, 0x11C3E}, {0x11C40, 0x11C40}, {0x11C72, 0x11C8F},
+  {0x11C92, 0x11CA7}, {0x11CA9, 0x11CB6}, {0x11D00, 0x11D06}, {0x11D08, 0x11D09},
+  {0x11D0B, 0x11D36}, {0x11D3A, 0x11D3A}, {0x11D3C, 0x11D3D}, {0x11D3F, 0x11D41},
+  {0x11D43, 0x11D43}, {0x11D46, 0x11D47}, {0x11D60, 0x11D65}, {0x11D67, 0x11D68},
+  {0x11D6A, 0x11D8E}, {0x11D90, 0x11D91}, {0x11D93, 0x11D96}, {0x11D98, 0x11D98},
+  {0x11EE0, 0x11EF6}, {0x11FB0, 0x11FB0}, {0x12000, 0x12399}, {0x12400, 0x1246E},
+  {0x12480, 0x12543}, {0x12F90, 0x12FF0}, {0x13000, 0x1342E}, {0x14400, 0x14646},
+  {0x16800, 0x16A38}, {0x16A40, 0x16A5E}, {0x16A70, 0x16ABE}, {0x16AD0, 0x16AED},
+  {0x16B00, 0x16B2F}, {0x16B40, 0x16B43}, {0x16B63, 0x16B77}, {0x16B7D, 0x16B8F},
+  {0x16E40, 0x16E7F}, {0x16F00, 0x16F4A}, {0x16F4F, 0x16F87}, {0x16F8F, 0x16F9F},
+  {0x16FE0, 0x16FE1}, {0x16FE3, 0x16FE3}, {0x16FF0, 0x16FF1}, {0x17000, 0x187F7},
+  {0x18800, 0x18CD5}, {0x18D00, 0x18D08}, {0x1AFF0, 0x1AFF3}, {0x1AFF5, 0x1AFFB},
+  {0x1AFFD, 0x1AFFE}, {0x1B000, 0x1B122}, {0x1B150, 0x1B152}, {0x1B164, 0x1B167},
+  {0x1B170, 0x1B2FB}, {0x1BC00, 0x1BC6A}, {0x1BC70, 0x1BC7C}, {0x1BC80, 0x1BC88},
+  {0x1BC90, 0x1BC99}, {0x1BC9E, 0x1BC9E}, {0x1D400, 0x1D454}, {0x1D456, 0x1D49C},
+  {0x1D49E, 0x1D49F}, {0x1D4A2, 0x1D4A2}, {0x1D4A5, 0x1D4A6}, {0x1D4A9, 0x1D4AC},
+  {0x1D4AE, 0x1D4B9}, {0x1D4BB, 0x1D4BB}, {0x1D4BD, 0x1D4C3}, {0x1D4C5, 0x1D505},
+  {0x1D507, 0x1D50A}, {0x1D50D, 0x1D514}, {0x1D516, 0x1D51C}, {0x1D51E, 0x1D539},
+  {0x1D53B, 0x1D53E}, {0x1D540, 0x1D544}, {0x1D546, 0x1D546}, {0x1D54A, 0x1D550},
+  {0x1D552, 0x1D6A5}, {0x1D6A8, 0x1D6C0}, {0x1D6C2, 0x1D6DA}, {0x1D6DC, 0x1D6FA},
+  {0x1D6FC, 0x1D714}, {0x1D716, 0x1D734}, {0x1D736, 0x1D74E}, {0x1D750, 0x1D76E},
+  {0x1D770, 0x1D788}, {0x1D78A, 0x1D7A8}, {0x1D7AA, 0x1D7C2}, {0x1D7C4, 0x1D7CB},
+  {0x1DF00, 0x1DF1E}, {0x1E000, 0x1E006}, {0x1E008, 0x1E018}, {0x1E01B, 0x1E021},
+  {0x1E023, 0x1E024}, {0x1E026, 0x1E02A}, {0x1E100, 0x1E12C}, {0x1E137, 0x1E13D},
+  {0x1E14E, 0x1E14E}, {0x1E290, 0x1E2AD}, {0x1E2C0, 0x1E2EB}, {0x1E7E0, 0x1E7E6},
+  {0x1E7E8, 0x1E7EB}, {0x1E7ED, 0x1E7EE}, {0x1E7F0, 0x1E7FE}, {0x1E800, 0x1E8C4},
+  {0x1E900, 0x1E943}, {0x1E947, 0x1E947}, {0x1E94B, 0x1E94B}, {0x1EE00, 0x1EE03},
+  {0x1EE05, 0x1EE1F}, {0x1EE21, 0x1EE22}, {0x1EE24, 0x1EE24}, {0x1EE27, 0x1EE27},
+  {0x1EE29, 0x1EE32}, {0x1EE34, 0x1EE37}, {0x1EE39, 0x1EE39}, {0x1EE3B, 0x1EE3B},
+  {0x1EE42, 0x1EE42}, {0x1EE47, 0x1EE47}, {0x1EE49, 0x1EE49}, {0x1EE4B, 0x1EE4B},
+  {0x1EE4D, 0x1EE4F}, {0x1EE51, 0x1EE52}, {0x1EE54, 0x1EE54}, {0x1EE57, 0x1EE57},
+  {0x1EE59, 0x1EE59}, {0x1EE5B, 0x1EE5B}, {0x1EE5D, 0x1EE5D}, {0x1EE5F, 0x1EE5F},
+  {0x1EE61, 0x1EE62}, {0x1EE64, 0x1EE64}, {0x1EE67, 0x1EE6A}, {0x1EE6C, 0x1EE72},
+  {0x1EE74, 0x1EE77}, {0x1EE79, 0x1EE7C}, {0x1EE7E, 0x1EE7E}, {0x1EE80, 0x1EE89},
+  {0x1EE8B, 0x1EE9B}, {0x1EEA1, 0x1EEA3}, {0x1EEA5, 0x1EEA9}, {0x1EEAB, 0x1EEBB},
+  {0x1F130, 0x1F149}, {0x1F150, 0x1F169}, {0x1F170, 0x1F189}, {0x20000, 0x2A6DF},
+  {0x2A700, 0x2B738}, {0x2B740, 0x2B81D}, {0x2B820, 0x2CEA1}, {0x2CEB0, 0x2EBE0},
+  {0x2F800, 0x2FA1D}, {0x30000, 0x3134A}
+};
+
+// Simple lowercase mapping, as {first, last, lowercase of first} ranges
+static const uint32_t LOWERCASE_RANGES[][3] = {
+  {0x0041, 0x005A, 0x0061}, {0x00C0, 0x00D6, 0x00E0}, {0x00D8, 0x00DE, 0x00F8},
+  {0x0100, 0x0100, 0x0101}, {0x0102, 0x0102, 0x0103}, {0x0104, 0x0104, 0x0105},
+  {0x0106, 0x0106, 0x0107}, {0x0108, 0x0108, 0x0109}, {0x010A, 0x010A, 0x010B},
+  {0x010C, 0x010C, 0x010D}, {0x010E, 0x010E, 0x010F}, {0x0110, 0x0110, 0x0111},
+  {0x0112, 0x0112, 0x0113}, {0x0114, 0x0114, 0x0115}, {0x0116, 0x0116, 0x0117},
+  {0x0118, 0x0118, 0x0119}, {0x011A, 0x011A, 0x011B}, {0x011C, 0x011C, 0x011D},
+  {0x011E, 0x011E, 0x011F}, {0x0120, 0x0120, 0x0121}, {0x0122, 0x0122, 0x0123},
+  {0x0124, 0x0124, 0x0125}, {0x0126, 0x0126, 0x0127}, {0x0128, 0x0128, 0x0129},
+  {0x012A, 0x012A, 0x012B}, {0x012C, 0x012C, 0x012D}, {0x012E, 0x012E, 0x012F},
+  {0x0130, 0x0130, 0x0069}, {0x0132, 0x0132, 0x0133}, {0x0134, 0x0134, 0x0135},
+  {0x0136, 0x0136, 0x0137}, {0x0139, 0x0139, 0x013A}, {0x013B, 0x013B, 0x013C},
+  {0x013D, 0x013D, 0x013E}, {0x013F, 0x013F, 0x0140}, {0x0141, 0x0141, 0x0142},
+  {0x0143, 0x0143, 0x0144}, {0x0145, 0x0145, 0x0146}, {0x0147, 0x0147, 0x0148},
+  {0x014A, 0x014A, 0x014B}, {0x014C, 0x014C, 0x014D}, {0x014E, 0x014E, 0x014F},
+  {0x0150, 0x0150, 0x0151}, {0x0152, 0x0152, 0x0153}, {0x0154, 0x0154, 0x0155},
+  {0x0156, 0x0156, 0x0157}, {0x0158, 0x0158, 0x0159}, {0x015A, 0x015A, 0x015B},
+  {0x015C, 0x015C, 0x015D}, {0x015E, 0x015E, 0x015F}, {0x0160, 0x0160, 0x0161},
+  {0x0162, 0x0162, 0x0163}, {0x0164, 0x0164, 0x0165}, {0x0166, 0x0166, 0x0167},
+  {0x0168, 0x0168, 0x0169}, {0x016A, 0x016A, 0x016B}, {0x016C, 0x016C, 0x016D},
+  {0x016E, 0x016E, 0x016F}, {0x0170, 0x0170, 0x0171}, {0x0172, 0x0172, 0x0173},
+  {0x0174, 0x0174, 0x0175}, {0x0176, 0x0176, 0x0177}, {0x0178, 0x0178, 0x00FF},
+  {0x0179, 0x0179, 0x017A}, {0x017B, 0x017B, 0x017C}, {0x017D, 0x017D, 0x017E},
+  {0x0181, 0x0181, 0x0253}, {0x0182, 0x0182, 0x0183}, {0x0184, 0x0184, 0x0185},
+  {0x0186, 0x0186, 0x0254}, {0x0187, 0x0187, 0x0188}, {0x0189, 0x018A, 0x0256},
+  {0x018B, 0x018B, 0x018C}, {0x018E, 0x018E, 0x01DD}, {0x018F, 0x018F, 0x0259},
+  {0x0190, 0x0190, 0x025B}, {0x0191, 0x0191, 0x0192}, {0x0193, 0x0193, 0x0260},
+  {0x0194, 0x0194, 0x0263}, {0x0196, 0x0196, 0x0269}, {0x0197, 0x0197, 0x0268},
+  {0x0198, 0x0198, 0x0199}, {0x019C, 0x019C, 0x026F}, {0x019D, 0x019D, 0x0272},
+  {0x019F, 0x019F, 0x0275}, {0x01A0, 0x01A0, 0x01A1}, {0x01A2, 0x01A2, 0x01A3},
+  {0x01A4, 0x01A4, 0x01A5}, {0x01A6, 0x01A6, 0x0280}, {0x01A7, 0x01A7, 0x01A8},
+  {0x01A9, 0x01A9, 0x0283}, {0x01AC, 0x01AC, 0x01AD}, {0x01AE, 0x01AE, 0x0288},
+  {0x01AF, 0x01AF, 0x01B0}, {0x01B1, 0x01B2, 0x028A}, {0x01B3, 0x01B3, 0x01B4},
+  {0x01B5, 0x01B5, 0x01B6}, {0x01B7, 0x01B7, 0x0292}, {0x01B8, 0x01B8, 0x01B9},
+  {0x01BC, 0x01BC, 0x01BD}, {0x01C4, 0x01C4, 0x01C6}, {0x01C5, 0x01C5, 0x01C6},
+  {0x01C7, 0x01C7, 0x01C9}, {0x01C8, 0x01C8, 0x01C9}, {0x01CA, 0x01CA, 0x01CC},
+  {0x01CB, 0x01CB, 0x01CC}, {0x01CD, 0x01CD, 0x01CE}, {0x01CF, 0x01CF, 0x01D0},
+  {0x01D1, 0x01D1, 0x01D2}, {0x01D3, 0x01D3, 0x01D4}, {0x01D5, 0x01D5, 0x01D6},
+  {0x01D7, 0x01D7, 0x01D8}, {0x01D9, 0x01D9, 0x01DA}, {0x01DB, 0x01DB, 0x01DC},
+  {0x01DE, 0x01DE, 0x01DF}, {0x01E0, 0x01E0, 0x01E1}, {0x01E2, 0x01E2, 0x01E3},
+  {0x01E4, 0x01E4, 0x01E5}, {0x01E6, 0x01E6, 0x01E7}, {0x01E8, 0x01E8, 0x01E9},
+  {0x01EA, 0x01EA, 0x01EB}, {0x01EC, 0x01EC, 0x01ED}, {0x01EE, 0x01EE, 0x01EF},
+  {0x01F1, 0x01F1, 0x01F3}, {0x01F2, 0x01F2, 0x01F3}, {0x01F4, 0x01F4, 0x01F5},
+  {0x01F6, 0x01F6, 0x0195}, {0x01F7, 0x01F7, 0x01BF}, {0x01F8, 0x01F8, 0x01F9},
+  {0x01FA, 0x01FA, 0x01FB}, {0x01FC, 0x01FC, 0x01FD}, {0x01FE, 0x01FE, 0x01FF},
+  {0x0200, 0x0200, 0x0201}, {0x0202, 0x0202, 0x0203}, {0x0204, 0x0204, 0x0205},
+  {0x0206, 0x0206, 0x0207}, {0x0208, 0x0208, 0x0209}, {0x020A, 0x020A, 0x020B},
+  {0x020C, 0x020C, 0x020D}, {0x020E, 0x020E, 0x020F}, {0x0210, 0x0210, 0x0211},
+  {0x0212, 0x0212, 0x0213}, {0x0214, 0x0214, 0x0215}, {0x0216, 0x0216, 0x0217},
+  {0x0218, 0x0218, 0x0219}, {0x021A, 0x021A, 0x021B}, {0x021C, 0x021C, 0x021D},
+  {0x021E, 0x021E, 0x021F}, {0x0220, 0x0220, 0x019E}, {0x0222, 0x0222, 0x0223},
+  {0x0224, 0x0224, 0x0225}, {0x0226, 0x0226, 0x0227}, {0x0228, 0x0228, 0x0229},
+  {0x022A, 0x022A, 0x022B}, {0x022C, 0x022C, 0x022D}, {0x022E, 0x022E, 0x022F},
+  {0x0230, 0x0230, 0x0231}, {0x0232, 0x0232, 0x0233}, {0x023A, 0x023A, 0x2C65},
+  {0x023B, 0x023B, 0x023C}, {0x023D, 0x023D, 0x019A}, {0x023E, 0x023E, 0x2C66},
+  {0x0241, 0x0241, 0x0242}, {0x0243, 0x0243, 0x0180}, {0x0244, 0x0244, 0x0289},
+  {0x0245, 0x0245, 0x028C}, {0x0246, 0x0246, 0x0247}, {0x0248, 0x0248, 0x0249},
+  {0x024A, 0x024A, 0x024B}, {0x024C, 0x024C, 0x024D}, {0x024E, 0x024E, 0x024F},
+  {0x0370, 0x0370, 0x0371}, {0x0372, 0x0372, 0x0373}, {0x0376, 0x0376, 0x0377},
+  {0x037F, 0x037F, 0x03F3}, {0x0386, 0x0386, 0x03AC}, {0x0388, 0x038A, 0x03AD},
+  {0x038C, 0x038C, 0x03CC}, {0x038E, 0x038F, 0x03CD}, {0x0391, 0x03A1, 0x03B1},
+  {0x03A3, 0x03AB, 0x03C3}, {0x03CF, 0x03CF, 0x03D7}, {0x03D8, 0x03D8, 0x03D9},
+  {0x03DA, 0x03DA, 0x03DB}, {0x03DC, 0x03DC, 0x03DD}, {0x03DE, 0x03DE, 0x03DF},
+  {0x03E0, 0x03E0, 0x03E1}, {0x03E2, 0x03E2, 0x03E3}, {0x03E4, 0x03E4, 0x03E5},
+  {0x03E6, 0x03E6, 0x03E7}, {0x03E8, 0x03E8, 0x03E9}, {0x03EA, 0x03EA, 0x03EB},
+  {0x03EC, 0x03EC, 0x03ED}, {0x03EE, 0x03EE, 0x03EF}, {0x03F4, 0x03F4, 0x03B8},
+  {0x03F7, 0x03F7, 0x03F8}, {0x03F9, 0x03F9, 0x03F2}, {0x03FA, 0x03FA, 0x03FB},
+  {0x03FD, 0x03FF, 0x037B}, {0x0400, 0x040F, 0x0450}, {0x0410, 0x042F, 0x0430},
+  {0x0460, 0x0460, 0x0461}, {0x0462, 0x0462, 0x0463}, {0x0464, 0x0464, 0x0465},
+  {0x0466, 0x0466, 0x0467}, {0x0468, 0x0468, 0x0469}, {0x046A, 0x046A, 0x046B},
+  {0x046C, 0x046C, 0x046D}, {0x046E, 0x046E, 0x046F}, {0x0470, 0x0470, 0x0471},
+  {0x0472, 0x0472, 0x0473}, {0x0474, 0x0474, 0x0475}, {0x0476, 0x0476, 0x0477},
+  {0x0478, 0x0478, 0x0479}, {0x047A, 0x047A, 0x047B}, {0x047C, 0x047C, 0x047D},
+  {0x047E, 0x047E, 0x047F}, {0x0480, 0x0480, 0x0481}, {0x048A, 0x048A, 0x048B},
+  {0x048C, 0x048C, 0x048D}, {0x048E, 0x048E, 0x048F}, {0x0490, 0x0490, 0x0491},
+  {0x0492, 0x0492, 0x0493}, {0x0494, 0x0494, 0x0495}, {0x0496, 0x0496, 0x0497},
+  {0x0498, 0x0498, 0x0499}, {0x049A, 0x049A, 0x049B}, {0x049C, 0x049C, 0x049D},
+  {0x049E, 0x049E, 0x049F}, {0x04A0, 0x04A0, 0x04A1}, {0x04A2, 0x04A2, 0x04A3},
+  {0x04A4, 0x04A4, 0x04A5}, {0x04A6, 0x04A6, 0x04A7}, {0x04A8, 0x04A8, 0x04A9},
+  {0x04AA, 0x04AA, 0x04AB}, {0x04AC, 0x04AC, 0x04AD}, {0x04AE, 0x04AE, 0x04AF},
+  {0x04B0, 0x04B0, 0x04B1}, {0x04B2, 0x04B2, 0x04B3}, {0x04B4, 0x04B4, 0x04B5},
+  {0x04B6, 0x04B6, 0x04B7}, {0x04B8, 0x04B8, 0x04B9}, {0x04BA, 0x04BA, 0x04BB},
+  {0x04BC, 0x04BC, 0x04BD}, {0x04BE, 0x04BE, 0x04BF}, {0x04C0, 0x04C0, 0x04CF},
+  {0x04C1, 0x04C1, 0x04C2}, {0x04C3, 0x04C3, 0x04C4}, {0x04C5, 0x04C5, 0x04C6},
+  {0x04C7, 0x04C7, 0x04C8}, {0x04C9, 0x04C9, 0x04CA}, {0x04CB, 0x04CB, 0x04CC},
+  {0x04CD, 0x04CD, 0x04CE}, {0x04D0, 0x04D0, 0x04D1}, {0x04D2, 0x04D2, 0x04D3},
+  {0x04D4, 0x04D4, 0x04D5}, {0x04D6, 0x04D6, 0x04D7}, {0x04D8, 0x04D8, 0x04D9},
+  {0x04DA, 0x04DA, 0x04DB}, {0x04DC, 0x04DC, 0x04DD}, {0x04DE, 0x04DE, 0x04DF},
+  {0x04E0, 0x04E0, 0x04E1}, {0x04E2, 0x04E2, 0x04E3}, {0x04E4, 0x04E4, 0x04E5},
+  {0x04E6, 0x04E6, 0x04E7}, {0x04E8, 0x04E8, 0x04E9}, {0x04EA, 0x04EA, 0x04EB},
+  {0x04EC, 0x04EC, 0x04ED}, {0x04EE, 0x04EE, 0x04EF}, {0x04F0, 0x04F0, 0x04F1},
+  {0x04F2, 0x04F2, 0x04F3}, {0x04F4, 0x04F4, 0x04F5}, {0x04F6, 0x04F6, 0x04F7},
+  {0x04F8, 0x04F8, 0x04F9}, {0x04FA, 0x04FA, 0x04FB}, {0x04FC, 0x04FC, 0x04FD},
+  {0x04FE, 0x04FE, 0x04FF}, {0x0500, 0x0500, 0x0501}, {0x0502, 0x0502, 0x0503},
+  {0x0504, 0x0504, 0x0505}, {0x0506, 0x0506, 0x0507}, {0x0508, 0x0508, 0x0509},
+  {0x050A, 0x050A, 0x050B}, {0x050C, 0x050C, 0x050D}, {0x050E, 0x050E, 0x050F},
+  {0x0510, 0x0510, 0x0511}, {0x0512, 0x0512, 0x0513}, {0x0514, 0x0514, 0x0515},
+  {0x0516, 0x0516, 0x0517}, {0x0518, 0x0518, 0x0519}, {0x051A, 0x051A, 0x051B},
+  {0x051C, 0x051C, 0x051D}, {0x051E, 0x051E, 0x051F}, {0x0520, 0x0520, 0x0521},
+  {0x0522, 0x0522, 0x0523}, {0x0524, 0x0524, 0x0525}, {0x0526, 0x0526, 0x0527},
+  {0x0528, 0x0528, 0x0529}, {0x052A, 0x052A, 0x052B}, {0x052C, 0x052C, 0x052D},
+  {0x052E, 0x052E, 0x052F}, {0x0531, 0x0556, 0x0561}, {0x10A0, 0x10C5, 0x2D00},
+  {0x10C7, 0x10C7, 0x2D27}, {0x10CD, 0x10CD, 0x2D2D}, {0x13A0, 0x13EF, 0xAB70},
+  {0x13F0, 0x13F5, 0x13F8}, {0x1C90, 0x1CBA, 0x10D0}, {0x1CBD, 0x1CBF, 0x10FD},
+  {0x1E00, 0x1E00, 0x1E01}, {0x1E02, 0x1E02, 0x1E03}, {0x1E04, 0x1E04, 0x1E05},
+  {0x1E06, 0x1E06, 0x1E07}, {0x1E08, 0x1E08, 0x1E09}, {0x1E0A, 0x1E0A, 0x1E0B},
+  {0x1E0C, 0x1E0C, 0x1E0D}, {0x1E0E, 0x1E0E, 0x1E0F}, {0x1E10, 0x1E10, 0x1E11},
+  {0x1E12, 0x1E12, 0x1E13}, {0x1E14, 0x1E14, 0x1E15}, {0x1E16, 0x1E16, 0x1E17},
+  {0x1E18, 0x1E18, 0x1E19}, {0x1E1A, 0x1E1A, 0x1E1B}, {0x1E1C, 0x1E1C, 0x1E1D},
+  {0x1E1E, 0x1E1E, 0x1E1F}, {0x1E20, 0x1E20, 0x1E21}, {0x1E22, 0x1E22, 0x1E23},
+  {0x1E24, 0x1E24, 0x1E25}, {0x1E26, 0x1E26, 0x1E27}, {0x1E28, 0x1E28, 0x1E29},
+  {0x1E2A, 0x1E2A, 0x1E2B}, {0x1E2C, 0x1E2C, 0x1E2D}, {0x1E2E, 0x1E2E, 0x1E2F},
+  {0x1E30, 0x1E30, 0x1E31}, {0x1E32, 0x1E32, 0x1E33}, {0x1E34, 0x1E34, 0x1E35},
+  {0x1E36, 0x1E36, 0x1E37}, {0x1E38, 0x1E38, 0x1E39}, {0x1E3A, 0x1E3A, 0x1E3B},
+  {0x1E3C, 0x1E3C, 0x1E3D}, {0x1E3E, 0x1E3E, 0x1E3F}, {0x1E40, 0x1E40, 0x1E41},
+  {0x1E42, 0x1E42, 0x1E43}, {0x1E44, 0x1E44, 0x1E45}, {0x1E46, 0x1E46, 0x1E47},
+  {0x1E48, 0x1E48, 0x1E49}, {0x1E4A, 0x1E4A, 0x1E4B}, {0x1E4C, 0x1E4C, 0x1E4D},
+  {0x1E4E, 0x1E4E, 0x1E4F}, {0x1E50, 0x1E50, 0x1E51}, {0x1E52, 0x1E52, 0x1E53},
+  {0x1E54, 0x1E54, 0x1E55}, {0x1E56, 0x1E56, 0x1E57}, {0x1E58, 0x1E58, 0x1E59},
+  {0x1E5A, 0x1E5A, 0x1E5B}, {0x1E5C, 0x1E5C, 0x1E5D}, {0x1E5E, 0x1E5E, 0x1E5F},
+  {0x1E60, 0x1E60, 0x1E61}, {0x1E62, 0x1E62, 0x1E63}, {0x1E64, 0x1E64, 0x1E65},
+  {0x1E66, 0x1E66, 0x1E67}, {0x1E68, 0x1E68, 0x1E69}, {0x1E6A, 0x1E6A, 0x1E6B},
+  {0x1E6C, 0x1E6C, 0x1E6D}, {0x1E6E, 0x1E6E, 0x1E6F}, {0x1E70, 0x1E70, 0x1E71},
+  {0x1E72, 0x1E72, 0x1E73}, {0x1E74, 0x1E74, 0x1E75}, {0x1E76, 0x1E76, 0x1E77},
+  {0x1E78, 0x1E78, 0x1E79}, {0x1E7A, 0x1E7A, 0x1E7B}, {0x1E7C, 0x1E7C, 0x1E7D},
+  {0x1E7E, 0x1E7E, 0x1E7F}, {0x1E80, 0x1E80, 0x1E81}, {0x1E82, 0x1E82, 0x1E83},
+  {0x1E84, 0x1E84, 0x1E85}, {0x1E86, 0x1E86, 0x1E87}, {0x1E88, 0x1E88, 0x1E89},
+  {0x1E8A, 0x1E8A, 0x1E8B}, {0x1E8C, 0x1E8C, 0x1E8D}, {0x1E8E, 0x1E8E, 0x1E8F},
+  {0x1E90, 0x1E90, 0x1E91}, {0x1E92, 0x1E92, 0x1E93}, {0x1E94, 0x1E94, 0x1E95},
+  {0x1E9E, 0x1E9E, 0x00DF}, {0x1EA0, 0x1EA0, 0x1EA1}, {0x1EA2, 0x1EA2, 0x1EA3},
+  {0x1EA4, 0x1EA4, 0x1EA5}, {0x1EA6, 0x1EA6, 0x1EA7}, {0x1EA8, 0x1EA8, 0x1EA9},
+  {0x1EAA, 0x1EAA, 0x1EAB}, {0x1EAC, 0x1EAC, 0x1EAD}, {0x1EAE, 0x1EAE, 0x1EAF},
+  {0x1EB0, 0x1EB0, 0x1EB1}, {0x1EB2, 0x1EB2, 0x1EB3}, {0x1EB4, 0x1EB4, 0x1EB5},
+  {0x1EB6, 0x1EB6, 0x1EB7}, {0x1EB8, 0x1EB8, 0x1EB9}, {0x1EBA, 0x1EBA, 0x1EBB},
+  {0x1EBC, 0x1EBC, 0x1EBD}, {0x1EBE, 0x1EBE, 0x1EBF}, {0x1EC0, 0x1EC0, 0x1EC1},
+  {0x1EC2, 0x1EC2, 0x1EC3}, {0x1EC4, 0x1EC4, 0x1EC5}, {0x1EC6, 0x1EC6, 0x1EC7},
+  {0x1EC8, 0x1EC8, 0x1EC9}, {0x1ECA, 0x1ECA, 0x1ECB}, {0x1ECC, 0x1ECC, 0x1ECD},
+  {0x1ECE, 0x1ECE, 0x1ECF}, {0x1ED0, 0x1ED0, 0x1ED1}, {0x1ED2, 0x1ED2, 0x1ED3},
+  {0x1ED4, 0x1ED4, 0x1ED5}, {0x1ED6, 0x1ED6, 0x1ED7}, {0x1ED8, 0x1ED8, 0x1ED9},
+  {0x1EDA, 0x1EDA, 0x1EDB}, {0x1EDC, 0x1EDC, 0x1EDD}, {0x1EDE, 0x1EDE, 0x1EDF},
+  {0x1EE0, 0x1EE0, 0x1EE1}, {0x1EE2, 0x1EE2, 0x1EE3}, {0x1EE4, 0x1EE4, 0x1EE5},
+  {0x1EE6, 0x1EE6, 0x1EE7}, {0x1EE8, 0x1EE8, 0x1EE9}, {0x1EEA, 0x1EEA, 0x1EEB},
+  {0x1EEC, 0x1EEC, 0x1EED}, {0x1EEE, 0x1EEE, 0x1EEF}, {0x1EF0, 0x1EF0, 0x1EF1},
+  {0x1EF2, 0x1EF2, 0x1EF3}, {0x1EF4, 0x1EF4, 0x1EF5}, {0x1EF6, 0x1EF6, 0x1EF7},
+  {0x1EF8, 0x1EF8, 0x1EF9}, {0x1EFA, 0x1EFA, 0x1EFB}, {0x1EFC, 0x1EFC, 0x1EFD},
+  {0x1EFE, 0x1EFE, 0x1EFF}, {0x1F08, 0x1F0F, 0x1F00}, {0x1F18, 0x1F1D, 0x1F10},
+  {0x1F28, 0x1F2F, 0x1F20}, {0x1F38, 0x1F3F, 0x1F30}, {0x1F48, 0x1F4D, 0x1F40},
+  {0x1F59, 0x1F59, 0x1F51}, {0x1F5B, 0x1F5B, 0x1F53}, {0x1F5D, 0x1F5D, 0x1F55},
+  {0x1F5F, 0x1F5F, 0x1F57}, {0x1F68, 0x1F6F, 0x1F60}, {0x1F88, 0x1F8F, 0x1F80},
+  {0x1F98, 0x1F9F, 0x1F90}, {0x1FA8, 0x1FAF, 0x1FA0}, {0x1FB8, 0x1FB9, 0x1FB0},
+  {0x1FBA, 0x1FBB, 0x1F70}, {0x1FBC, 0x1FBC, 0x1FB3}, {0x1FC8, 0x1FCB, 0x1F72},
+  {0x1FCC, 0x1FCC, 0x1FC3}, {0x1FD8, 0x1FD9, 0x1FD0}, {0x1FDA, 0x1FDB, 0x1F76},
+  {0x1FE8, 0x1FE9, 0x1FE0}, {0x1FEA, 0x1FEB, 0x1F7A}, {0x1FEC, 0x1FEC, 0x1FE5},
+  {0x1FF8, 0x1FF9, 0x1F78}, {0x1FFA, 0x1FFB, 0x1F7C}, {0x1FFC, 0x1FFC, 0x1FF3},
+  {0x2126, 0x2126, 0x03C9}, {0x212A, 0x212A, 0x006B}, {0x212B, 0x212B, 0x00E5},
+  {0x2132, 0x2132, 0x214E}, {0x2160, 0x216F, 0x2170}, {0x2183, 0x2183, 0x2184},
+  {0x24B6, 0x24CF, 0x24D0}, {0x2C00, 0x2C2F, 0x2C30}, {0x2C60, 0x2C60, 0x2C61},
+  {0x2C62, 0x2C62, 0x026B}, {0x2C63, 0x2C63, 0x1D7D}, {0x2C64, 0x2C64, 0x027D},
+  {0x2C67, 0x2C67, 0x2C68}, {0x2C69, 0x2C69, 0x2C6A}, {0x2C6B, 0x2C6B, 0x2C6C},
+  {0x2C6D, 0x2C6D, 0x0251}, {0x2C6E, 0x2C6E, 0x0271}, {0x2C6F, 0x2C6F, 0x0250},
+  {0x2C70, 0x2C70, 0x0252}, {0x2C72, 0x2C72, 0x2C73}, {0x2C75, 0x2C75, 0x2C76},
+  {0x2C7E, 0x2C7F, 0x023F}, {0x2C80, 0x2C80, 0x2C81}, {0x2C82, 0x2C82, 0x2C83},
+  {0x2C84, 0x2C84, 0x2C85}, {0x2C86, 0x2C86, 0x2C87}, {0x2C88, 0x2C88, 0x2C89},
+  {0x2C8A, 0x2C8A, 0x2C8B}, {0x2C8C, 0x2C8C, 0x2C8D}, {0x2C8E, 0x2C8E, 0x2C8F},
+  {0x2C90, 0x2C90, 0x2C91}, {0x2C92, 0x2C92, 0x2C93}, {0x2C94, 0x2C94, 0x2C95},
+  {0x2C96, 0x2C96, 0x2C97}, {0x2C98, 0x2C98, 0x2C99}, {0x2C9A, 0x2C9A, 0x2C9B},
+  {0x2C9C, 0x2C9C, 0x2C9D}, {0x2C9E, 0x2C9E, 0x2C9F}, {0x2CA0, 0x2CA0, 0x2CA1},
+  {0x2CA2, 0x2CA2, 0x2CA3}, {0x2CA4, 0x2CA4, 0x2CA5}, {0x2CA6, 0x2CA6, 0x2CA7},
+  {0x2CA8, 0x2CA8, 0x2CA9}, {0x2CAA, 0x2CAA, 0x2CAB}, {0x2CAC, 0x2CAC, 0x2CAD},
+  {0x2CAE, 0x2CAE, 0x2CAF}, {0x2CB0, 0x2CB0, 0x2CB1}, {0x2CB2, 0x2CB2, 0x2CB3},
+  {0x2CB4, 0x2CB4, 0x2CB5}, {0x2CB6, 0x2CB6, 0x2CB7}, {0x2CB8, 0x2CB8, 0x2CB9},
+  {0x2CBA, 0x2CBA, 0x2CBB}, {0x2CBC, 0x2CBC, 0x2CBD}, {0x2CBE, 0x2CBE, 0x2CBF},
+  {0x2CC0, 0x2CC0, 0x2CC1}, {0x2CC2, 0x2CC2, 0x2CC3}, {0x2CC4, 0x2CC4, 0x2CC5},
+  {0x2CC6, 0x2CC6, 0x2CC7}, {0x2CC8, 0x2CC8, 0x2CC9}, {0x2CCA, 0x2CCA, 0x2CCB},
+  {0x2CCC, 0x2CCC, 0x2CCD}, {0x2CCE, 0x2CCE, 0x2CCF}, {0x2CD0, 0x2CD0, 0x2CD1},
+  {0x2CD2, 0x2CD2, 0x2CD3}, {0x2CD4, 0x2CD4, 0x2CD5}, {0x2CD6, 0x2CD6, 0x2CD7},
+  {0x2CD8, 0x2CD8, 0x2CD9}, {0x2CDA, 0x2CDA, 0x2CDB}, {0x2CDC, 0x2CDC, 0x2CDD},
+  {0x2CDE, 0x2CDE, 0x2CDF}, {0x2CE0, 0x2CE0, 0x2CE1}, {0x2CE2, 0x2CE2, 0x2CE3},
+  {0x2CEB, 0x2CEB, 0x2CEC}, {0x2CED, 0x2CED, 0x2CEE}, {0x2CF2, 0x2CF2, 0x2CF3},
+  {0xA640, 0xA640, 0xA641}, {0xA642, 0xA642, 0xA643}, {0xA644, 0xA644, 0xA645},
+  {0xA646, 0xA646, 0xA647}, {0xA648, 0xA648, 0xA649}, {0xA64A, 0xA64A, 0xA64B},
+  {0xA64C, 0xA64C, 0xA64D}, {0xA64E, 0xA64E, 0xA64F}, {0xA650, 0xA650, 0xA651},
+  {0xA652, 0xA652, 0xA653}, {0xA654, 0xA654, 0xA655}, {0xA656, 0xA656, 0xA657},
+  {0xA658, 0xA658, 0xA659}, {0xA65A, 0xA65A, 0xA65B}, {0xA65C, 0xA65C, 0xA65D},
+  {0xA65E, 0xA65E, 0xA65F}, {0xA660, 0xA660, 0xA661}, {0xA662, 0xA662, 0xA663},
+  {0xA664, 0xA664, 0xA665}, {0xA666, 0xA666, 0xA667}, {0xA668, 0xA668, 0xA669},
+  {0xA66A, 0xA66A, 0xA66B}, {0xA66C, 0xA66C, 0xA66D}, {0xA680, 0xA680, 0xA681},
+  {0xA682, 0xA682, 0xA683}, {0xA684, 0xA684, 0xA685}, {0xA686, 0xA686, 0xA687},
+  {0xA688, 0xA688, 0xA689}, {0xA68A, 0xA68A, 0xA68B}, {0xA68C, 0xA68C, 0xA68D},
+  {0xA68E, 0xA68E, 0xA68F}, {0xA690, 0xA690, 0xA691}, {0xA692, 0xA692, 0xA693},
+  {0xA694, 0xA694, 0xA695}, {0xA696, 0xA696, 0xA697}, {0xA698, 0xA698, 0xA699},
+  {0xA69A, 0xA69A, 0xA69B}, {0xA722, 0xA722, 0xA723}, {0xA724, 0xA724, 0xA725},
+  {0xA726, 0xA726, 0xA727}, {0xA728, 0xA728, 0xA729}, {0xA72A, 0xA72A, 0xA72B},
+  {0xA72C, 0xA72C, 0xA72D}, {0xA72E, 0xA72E, 0xA72F}, {0xA732, 0xA732, 0xA733},
+  {0xA734, 0xA734, 0xA735}, {0xA736, 0xA736, 0xA737}, {0xA738, 0xA738, 0xA739},
+  {0xA73A, 0xA73A, 0xA73B}, {0xA73C, 0xA73C, 0xA73D}, {0xA73E, 0xA73E, 0xA73F},
+  {0xA740, 0xA740, 0xA741}, {0xA742, 0xA742, 0xA743}, {0xA744, 0xA744, 0xA745},
+  {0xA746, 0xA746, 0xA747}, {0xA748, 0xA748, 0xA749}, {0xA74A, 0xA74A, 0xA74B},
+  {0xA74C, 0xA74C, 0xA74D}, {0xA74E, 0xA74E, 0xA74F}, {0xA750, 0xA750, 0xA751},
+  {0xA752, 0xA752, 0xA753}, {0xA754, 0xA754, 0xA755}, {0xA756, 0xA756, 0xA757},
+  {0xA758, 0xA758, 0xA759}, {0xA75A, 0xA75A, 0xA75B}, {0xA75C, 0xA75C, 0xA75D},
+  {0xA75E, 0xA75E, 0xA75F}, {0xA760, 0xA760, 0xA761}, {0xA762, 0xA762, 0xA763},
+  {0xA764, 0xA764, 0xA765}, {0xA766, 0xA766, 0xA767}, {0xA768, 0xA768, 0xA769},
+  {0xA76A, 0xA76A, 0xA76B}, {0xA76C, 0xA76C, 0xA76D}, {0xA76E, 0xA76E, 0xA76F},
+  {0xA779, 0xA779, 0xA77A}, {0xA77B, 0xA77B, 0xA77C}, {0xA77D, 0xA77D, 0x1D79},
+  {0xA77E, 0xA77E, 0xA77F}, {0xA780, 0xA780, 0xA781}, {0xA782, 0xA782, 0xA783},
+  {0xA784, 0xA784, 0xA785}, {0xA786, 0xA786, 0xA787}, {0xA78B, 0xA78B, 0xA78C},
+  {0xA78D, 0xA78D, 0x0265}, {0xA790, 0xA790, 0xA791}, {0xA792, 0xA792, 0xA793},
+  {0xA796, 0xA796, 0xA797}, {0xA798, 0xA798, 0xA799}, {0xA79A, 0xA79A, 0xA79B},
+  {0xA79C, 0xA79C, 0xA79D}, {0xA79E, 0xA79E, 0xA79F}, {0xA7A0, 0xA7A0, 0xA7A1},
+  {0xA7A2, 0xA7A2, 0xA7A3}, {0xA7A4, 0xA7A4, 0xA7A5}, {0xA7A6, 0xA7A6, 0xA7A7},
+  {0xA7A8, 0xA7A8, 0xA7A9}, {0xA7AA, 0xA7AA, 0x0266}, {0xA7AB, 0xA7AB, 0x025C},
+  {0xA7AC, 0xA7AC, 0x0261}, {0xA7AD, 0xA7AD, 0x026C}, {0xA7AE, 0xA7AE, 0x026A},
+  {0xA7B0, 0xA7B0, 0x029E}, {0xA7B1, 0xA7B1, 0x0287}, {0xA7B2, 0xA7B2, 0x029D},
+  {0xA7B3, 0xA7B3, 0xAB53}, {0xA7B4, 0xA7B4, 0xA7B5}, {0xA7B6, 0xA7B6, 0xA7B7},
+  {0xA7B8, 0xA7B8, 0xA7B9}, {0xA7BA, 0xA7BA, 0xA7BB}, {0xA7BC, 0xA7BC, 0xA7BD},
+  {0xA7BE, 0xA7BE, 0xA7BF}, {0xA7C0, 0xA7C0, 0xA7C1}, {0xA7C2, 0xA7C2, 0xA7C3},
+  {0xA7C4, 0xA7C4, 0xA794}, {0xA7C5, 0xA7C5, 0x0282}, {0xA7C6, 0xA7C6, 0x1D8E},
+  {0xA7C7, 0xA7C7, 0xA7C8}, {0xA7C9, 0xA7C9, 0xA7CA}, {0xA7D0, 0xA7D0, 0xA7D1},
+  {0xA7D6, 0xA7D6, 0xA7D7}, {0xA7D8, 0xA7D8, 0xA7D9}, {0xA7F5, 0xA7F5, 0xA7F6},
+  {0xFF21, 0xFF3A, 0xFF41}, {0x10400, 0x10427, 0x10428}, {0x104B0, 0x104D3, 0x104D8},
+  {0x10570, 0x1057A, 0x10597}, {0x1057C, 0x1058A, 0x105A3}, {0x1058C, 0x10592, 0x105B3},
+  {0x10594, 0x10595, 0x105BB}, {0x10C80, 0x10CB2, 0x10CC0}, {0x118A0, 0x118BF, 0x118C0},
+  {0x16E40, 0x16E5F, 0x16E60}, {0x1E900, 0x1E921, 0x1E922}
+};
+
+#endif